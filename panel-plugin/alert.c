@@ -0,0 +1,318 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Low battery alerts
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gio/gio.h>
+
+#include <libxfce4util/libxfce4util.h>
+
+#include <stdlib.h>
+
+#include "alert.h"
+
+#define NOTIFY_NAME "org.freedesktop.Notifications"
+#define NOTIFY_PATH "/org/freedesktop/Notifications"
+#define LOGIN1_NAME "org.freedesktop.login1"
+#define LOGIN1_PATH "/org/freedesktop/login1"
+#define LOGIN1_MANAGER LOGIN1_NAME ".Manager"
+
+/* A forecast that moved by less than this keeps the timer as it is */
+#define ALERT_SLACK_US G_USEC_PER_SEC
+/* Close to the threshold the forecast keeps coming up a little short while
+   the firmware has not stepped the charge yet. Samples are then not taken
+   more often than this, and the delay doubles with every one that finds
+   the charge where it was, up to ALERT_MAX_DELAY_MS */
+#define ALERT_MIN_DELAY_MS 1000
+#define ALERT_MAX_DELAY_MS (64 * 1000)
+/* Nothing is forecast further out, the next poll will be in by then */
+#define ALERT_HORIZON_S (6 * 3600)
+
+struct alert_t {
+  char *acName;
+  alertconf_t oConf;
+  AlertFunc pfFunc;
+  void *pvData;
+  int bFired;      /* Below the threshold, waiting for the hysteresis */
+  unsigned int iTimerId;
+  int64_t iDue_us; /* Monotonic time the timer was armed for */
+  int bDue;        /* The timer expired, the next sample is its answer */
+  long lDueNow;    /* Charge the last answer found */
+  unsigned int iMinDelay_ms;
+};
+
+typedef struct buscall_t {
+  const char *pcName;
+  const char *pcPath;
+  const char *pcIface;
+  const char *pcMethod;
+  GVariant *poParams;
+} buscall_t;
+
+static void OnCalled(GObject *source, GAsyncResult *res, gpointer data) {
+  buscall_t *poCall = (buscall_t *)data;
+  GVariant *poReply;
+  GError *poError = NULL;
+
+  poReply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res,
+                                          &poError);
+  if (poReply)
+    g_variant_unref(poReply);
+  else {
+    g_warning("Battmon: %s.%s failed: %s", poCall->pcIface, poCall->pcMethod,
+              poError->message);
+    g_error_free(poError);
+  }
+  g_free(poCall);
+}
+
+static void OnBus(GObject *source, GAsyncResult *res, gpointer data) {
+  buscall_t *poCall = (buscall_t *)data;
+  GDBusConnection *poConn;
+  GError *poError = NULL;
+
+  if (!(poConn = g_bus_get_finish(res, &poError))) {
+    g_warning("Battmon: cannot call %s: %s", poCall->pcName,
+              poError->message);
+    g_error_free(poError);
+    g_variant_unref(poCall->poParams);
+    g_free(poCall);
+    return;
+  }
+
+  g_dbus_connection_call(poConn, poCall->pcName, poCall->pcPath,
+                         poCall->pcIface, poCall->pcMethod, poCall->poParams,
+                         NULL, G_DBUS_CALL_FLAGS_NONE, -1, NULL, OnCalled,
+                         poCall);
+  g_variant_unref(poCall->poParams);
+  g_object_unref(poConn);
+}
+
+static void CallBus(GBusType eBus, const char *name, const char *path,
+                    const char *iface, const char *method, GVariant *params)
+/* Fire and forget, a failure is only logged */
+{
+  buscall_t *poCall;
+
+  poCall = g_new0(buscall_t, 1);
+  poCall->pcName = name;
+  poCall->pcPath = path;
+  poCall->pcIface = iface;
+  poCall->pcMethod = method;
+  poCall->poParams = g_variant_ref_sink(params);
+  g_bus_get(eBus, NULL, OnBus, poCall);
+}
+
+static void Notify(alert_t *poAlert, const char *body) {
+  GVariantBuilder oHints;
+
+  g_variant_builder_init(&oHints, G_VARIANT_TYPE("a{sv}"));
+  g_variant_builder_add(&oHints, "{sv}", "urgency", g_variant_new_byte(2));
+  CallBus(G_BUS_TYPE_SESSION, NOTIFY_NAME, NOTIFY_PATH, NOTIFY_NAME,
+          "Notify",
+          g_variant_new("(susssasa{sv}i)", "Battery Monitor", 0,
+                        "battery-caution", poAlert->acName, body, NULL,
+                        &oHints, -1));
+}
+
+static void RunCommand(alert_t *poAlert) {
+  GError *poError = NULL;
+  char **argv = NULL;
+
+  if (!poAlert->oConf.acCommand || !*poAlert->oConf.acCommand)
+    return;
+
+  /* No waiting for the child, GLib reaps it */
+  if (!g_shell_parse_argv(poAlert->oConf.acCommand, NULL, &argv, &poError) ||
+      !g_spawn_async(NULL, argv, NULL, G_SPAWN_SEARCH_PATH, NULL, NULL, NULL,
+                     &poError)) {
+    g_warning("Battmon: cannot run \"%s\": %s", poAlert->oConf.acCommand,
+              poError->message);
+    g_error_free(poError);
+  }
+  g_strfreev(argv);
+}
+
+static void Fire(alert_t *poAlert, double level) {
+  char *body;
+
+  body = poAlert->oConf.eUnit == AlertUnit_Minutes
+             ? g_strdup_printf("About %d minutes left", (int)level)
+             : g_strdup_printf("%d%% left", (int)level);
+  DBG("%s: %s", poAlert->acName, body);
+
+  switch (poAlert->oConf.eAction) {
+  case AlertAction_Notify:
+    Notify(poAlert, body);
+    break;
+  case AlertAction_Command:
+    RunCommand(poAlert);
+    break;
+  case AlertAction_Suspend:
+    CallBus(G_BUS_TYPE_SYSTEM, LOGIN1_NAME, LOGIN1_PATH, LOGIN1_MANAGER,
+            "Suspend", g_variant_new("(b)", FALSE));
+    break;
+  default:
+    break;
+  }
+  g_free(body);
+}
+
+static void Disarm(alert_t *poAlert) {
+  if (poAlert->iTimerId)
+    g_source_remove(poAlert->iTimerId);
+  poAlert->iTimerId = 0;
+  poAlert->iDue_us = 0;
+}
+
+static gboolean OnDue(gpointer data) {
+  alert_t *poAlert = (alert_t *)data;
+
+  poAlert->iTimerId = 0;
+  poAlert->iDue_us = 0;
+  poAlert->bDue = 1;
+  /* The sample decides, the forecast may have been off */
+  poAlert->pfFunc(poAlert->pvData);
+  return G_SOURCE_REMOVE;
+}
+
+static void Arm(alert_t *poAlert, double seconds) {
+  int64_t now = g_get_monotonic_time();
+  int64_t iDue_us = now + (int64_t)(seconds * G_USEC_PER_SEC);
+  unsigned int iDelay_ms;
+
+  if (poAlert->iTimerId && llabs(iDue_us - poAlert->iDue_us) < ALERT_SLACK_US)
+    return;
+
+  Disarm(poAlert);
+  iDelay_ms = MAX((unsigned int)(seconds * 1000), poAlert->iMinDelay_ms);
+  DBG("%s due in %u ms", poAlert->acName, iDelay_ms);
+  /* Not g_timeout_add_seconds(), whose wakeups may be a second late */
+  poAlert->iTimerId = g_timeout_add(iDelay_ms, OnDue, poAlert);
+  poAlert->iDue_us = now + (int64_t)iDelay_ms * 1000;
+}
+
+static double GetLevel(const alert_t *poAlert, const battsample_t *poSample,
+                       double hours)
+/* Where the battery stands in the unit of the alert, < 0 if unknown */
+{
+  if (poAlert->oConf.eUnit == AlertUnit_Minutes)
+    return hours < 0 ? -1.0 : hours * 60.0;
+  /* Finer than the rounded capacity, so that the forecast is */
+  if (poSample->lNow >= 0 && poSample->lFull > 0)
+    return 100.0 * poSample->lNow / poSample->lFull;
+  return poSample->iPercent;
+}
+
+void alert_update(alert_t *poAlert, const battsample_t *poSample,
+                  double hours) {
+  const alertconf_t *poConf = &(poAlert->oConf);
+  double level, seconds;
+  int bDue = poAlert->bDue;
+
+  poAlert->bDue = 0;
+  if (!poConf->bEnabled)
+    return;
+
+  /* Back off while the timer's samples find the charge unchanged */
+  if (poSample->lNow != poAlert->lDueNow)
+    poAlert->iMinDelay_ms = ALERT_MIN_DELAY_MS;
+  else if (bDue)
+    poAlert->iMinDelay_ms =
+        MIN(poAlert->iMinDelay_ms * 2, ALERT_MAX_DELAY_MS);
+  if (bDue)
+    poAlert->lDueNow = poSample->lNow;
+
+  if (poSample->eStatus != BattStatus_Discharging) {
+    poAlert->bFired = 0;
+    Disarm(poAlert);
+    return;
+  }
+
+  level = GetLevel(poAlert, poSample, hours);
+  if (level < 0) {
+    /* Nothing to forecast from, the next poll will tell */
+    Disarm(poAlert);
+    return;
+  }
+
+  if (poAlert->bFired) {
+    if (level > poConf->iValue + poConf->iHysteresis)
+      poAlert->bFired = 0;
+    else
+      return;
+  }
+
+  if (level <= poConf->iValue) {
+    Disarm(poAlert);
+    poAlert->bFired = 1;
+    Fire(poAlert, level);
+    return;
+  }
+
+  /* Time to the crossing at the current rate. Minutes left go down one
+     per minute, the charge in proportion to the time to empty */
+  if (poConf->eUnit == AlertUnit_Minutes)
+    seconds = (level - poConf->iValue) * 60.0;
+  else if (hours > 0)
+    seconds = hours * 3600.0 * (level - poConf->iValue) / level;
+  else {
+    Disarm(poAlert);
+    return;
+  }
+
+  if (seconds > ALERT_HORIZON_S)
+    Disarm(poAlert);
+  else
+    Arm(poAlert, seconds);
+}
+
+void alert_configure(alert_t *poAlert, const alertconf_t *poConf) {
+  g_free(poAlert->oConf.acCommand);
+  poAlert->oConf = *poConf;
+  poAlert->oConf.acCommand = g_strdup(poConf->acCommand);
+  poAlert->bFired = 0;
+  poAlert->iMinDelay_ms = ALERT_MIN_DELAY_MS;
+  Disarm(poAlert);
+}
+
+alert_t *alert_new(const char *name, AlertFunc func, void *data) {
+  alert_t *poAlert;
+
+  poAlert = g_new0(alert_t, 1);
+  poAlert->acName = g_strdup(name);
+  poAlert->pfFunc = func;
+  poAlert->pvData = data;
+  poAlert->lDueNow = -1;
+  poAlert->iMinDelay_ms = ALERT_MIN_DELAY_MS;
+  return poAlert;
+}
+
+void alert_free(alert_t *poAlert) {
+  if (!poAlert)
+    return;
+
+  Disarm(poAlert);
+  g_free(poAlert->oConf.acCommand);
+  g_free(poAlert->acName);
+  g_free(poAlert);
+}
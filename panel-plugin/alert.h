@@ -0,0 +1,69 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Low battery alerts
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef BATTMON_ALERT_H
+#define BATTMON_ALERT_H
+
+#include "battery.h"
+
+typedef enum alertunit_t {
+  AlertUnit_Percent,
+  AlertUnit_Minutes, /* Time left as estimated */
+  AlertUnit_Max
+} alertunit_t;
+
+typedef enum alertaction_t {
+  AlertAction_Notify,
+  AlertAction_Command,
+  AlertAction_Suspend,
+  AlertAction_Max
+} alertaction_t;
+
+typedef struct alertconf_t {
+  int bEnabled;
+  alertunit_t eUnit;
+  int iValue;      /* Fires once the charge drops to this */
+  int iHysteresis; /* and again only after it rose above iValue plus this */
+  alertaction_t eAction;
+  char *acCommand; /* Run through the shell rules of g_shell_parse_argv() */
+} alertconf_t;
+
+/* Called when the crossing is due and a fresh sample should be taken. The
+   alert itself only fires from alert_update() */
+typedef void (*AlertFunc)(void *data);
+
+typedef struct alert_t alert_t;
+
+/* name is what the notification calls the alert, e.g. "Low battery" */
+alert_t *alert_new(const char *name, AlertFunc func, void *data);
+void alert_free(alert_t *poAlert);
+
+/* Copies poConf. Re-arms, a threshold already crossed fires with the next
+   update */
+void alert_configure(alert_t *poAlert, const alertconf_t *poConf);
+
+/* Feed every sample. hours is the time to empty while discharging, < 0 if
+   unknown. Fires the action on a crossing, otherwise forecasts from the
+   hours left when the threshold will be crossed and arms a single timer
+   for that moment */
+void alert_update(alert_t *poAlert, const battsample_t *poSample,
+                  double hours);
+
+#endif /* BATTMON_ALERT_H */
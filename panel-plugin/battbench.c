@@ -0,0 +1,276 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Benchmark of the battery sampling path
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Not part of the plugin. "make check" runs it with a few iterations,
+   "./battbench [iterations]" for numbers. A power_supply tree is generated
+   on tmpfs for every layout the sampler has to handle, so numbers from
+   before and after a change to the hot path can be compared on the same
+   machine. It fails if a layout does not read back as expected */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "battery.h"
+#include "estimator.h"
+#include "sysfs.h"
+
+#define DEFAULT_ITERATIONS 100000
+
+typedef struct layout_t {
+  const char *acName;
+  const char *const *apcAttrs; /* name, value, name, value, ..., NULL */
+  int bUevent;                 /* Also write a uevent file */
+  battsample_t oExpected;
+} layout_t;
+
+static const char *const apcCharge[] = {
+  "status", "Discharging\n",
+  "capacity", "57\n",
+  "charge_now", "2850000\n",
+  "charge_full", "5000000\n",
+  "current_now", "1250000\n",
+  NULL
+};
+
+static const char *const apcEnergy[] = {
+  "status", "Charging\n",
+  "capacity", "57\n",
+  "energy_now", "32490000\n",
+  "energy_full", "57000000\n",
+  "power_now", "14250000\n",
+  NULL
+};
+
+/* Both families, as bq27xxx reports them. Charge is picked */
+static const char *const apcBoth[] = {
+  "status", "Discharging\n",
+  "capacity", "57\n",
+  "charge_now", "2850000\n",
+  "charge_full", "5000000\n",
+  "current_now", "1250000\n",
+  "energy_now", "32490000\n",
+  "energy_full", "57000000\n",
+  "power_now", "14250000\n",
+  NULL
+};
+
+static const layout_t aoLayouts[] = {
+  {"charge, uevent", apcCharge, 1,
+   {BattStatus_Discharging, 57, 2850000, 5000000, 1250000}},
+  {"charge, attributes", apcCharge, 0,
+   {BattStatus_Discharging, 57, 2850000, 5000000, 1250000}},
+  {"energy, uevent", apcEnergy, 1,
+   {BattStatus_Charging, 57, 32490000, 57000000, 14250000}},
+  {"energy, attributes", apcEnergy, 0,
+   {BattStatus_Charging, 57, 32490000, 57000000, 14250000}},
+  {"both, uevent", apcBoth, 1,
+   {BattStatus_Discharging, 57, 2850000, 5000000, 1250000}},
+  {"missing battery", NULL, 0, {BattStatus_NoBatt, 0, -1, -1, -1}},
+};
+
+/* malloc() is interposed to count what the sampling path allocates, GLib
+   allocates through it as well */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static unsigned long iAllocs;
+
+void *malloc(size_t size) {
+  iAllocs++;
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+  iAllocs++;
+  return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  iAllocs++;
+  return __libc_realloc(ptr, size);
+}
+
+static gint64 NowNs(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (gint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static const char *GetTmpfs(void) {
+  /* Real sysfs attributes never touch a disk either */
+  if (g_file_test("/dev/shm", G_FILE_TEST_IS_DIR))
+    return "/dev/shm";
+  return g_get_tmp_dir();
+}
+
+static void WriteAttr(const char *dir, const char *name, const char *value) {
+  char *path = g_build_filename(dir, name, NULL);
+
+  if (!g_file_set_contents(path, value, -1, NULL))
+    g_error("battbench: cannot write %s", path);
+  g_free(path);
+}
+
+static char *MakeTree(const char *tmp, const layout_t *poLayout)
+/* Returns the power_supply root, BAT0 below it follows poLayout */
+{
+  GString *uevent;
+  char *root, *dir, *key;
+  int i;
+
+  root = g_build_filename(tmp, "battbench-XXXXXX", NULL);
+  if (!g_mkdtemp(root))
+    g_error("battbench: cannot create %s", root);
+
+  if (!poLayout->apcAttrs)
+    return root;
+
+  dir = g_build_filename(root, "BAT0", NULL);
+  g_mkdir(dir, 0755);
+  uevent = g_string_new("POWER_SUPPLY_NAME=BAT0\n");
+  for (i = 0; poLayout->apcAttrs[i]; i += 2) {
+    WriteAttr(dir, poLayout->apcAttrs[i], poLayout->apcAttrs[i + 1]);
+    key = g_ascii_strup(poLayout->apcAttrs[i], -1);
+    g_string_append_printf(uevent, "POWER_SUPPLY_%s=%s", key,
+                           poLayout->apcAttrs[i + 1]);
+    g_free(key);
+  }
+  if (poLayout->bUevent)
+    WriteAttr(dir, "uevent", uevent->str);
+  g_string_free(uevent, TRUE);
+  g_free(dir);
+  return root;
+}
+
+static void RemoveTree(const char *root) {
+  const char *name;
+  char *dir, *path;
+  GDir *d;
+
+  dir = g_build_filename(root, "BAT0", NULL);
+  if ((d = g_dir_open(dir, 0, NULL))) {
+    while ((name = g_dir_read_name(d))) {
+      path = g_build_filename(dir, name, NULL);
+      g_unlink(path);
+      g_free(path);
+    }
+    g_dir_close(d);
+    g_rmdir(dir);
+  }
+  g_free(dir);
+  g_rmdir(root);
+}
+
+static int RunLayout(const char *tmp, const layout_t *poLayout,
+                     unsigned int iIterations)
+/* Returns 0 if the layout did not read back as expected */
+{
+  battsample_t oSample;
+  estimator_t oEst;
+  double hours, confidence;
+  unsigned long iAllocsBefore;
+  unsigned int i, iSyscalls;
+  gint64 iStart, iTime_ns;
+  sysfs_t *poSysfs;
+  char *root;
+
+  root = MakeTree(tmp, poLayout);
+  poSysfs = sysfs_new(root, "BAT0");
+  sysfs_probe(poSysfs);
+  estimator_reset(&oEst);
+
+  /* Warm up, and leave the setup out of the counters */
+  sysfs_sample(poSysfs, &oSample);
+  sysfs_take_syscalls(poSysfs);
+
+  iAllocsBefore = iAllocs;
+  iStart = NowNs();
+  for (i = 0; i < iIterations; i++) {
+    /* Everything a timer tick does before the view is built */
+    if (!sysfs_is_present(poSysfs))
+      sysfs_probe(poSysfs);
+    sysfs_sample(poSysfs, &oSample);
+    estimator_add(&oEst, &oSample, (gint64)i * 30 * G_USEC_PER_SEC);
+    estimator_get_hours(&oEst, &oSample, &hours, &confidence);
+  }
+  iTime_ns = NowNs() - iStart;
+  iSyscalls = sysfs_take_syscalls(poSysfs);
+
+  printf("%-20s %10.0f %10.2f %10.2f   %d%% status %d\n", poLayout->acName,
+         (double)iTime_ns / iIterations, (double)iSyscalls / iIterations,
+         (double)(iAllocs - iAllocsBefore) / iIterations, oSample.iPercent,
+         oSample.eStatus);
+
+  sysfs_free(poSysfs);
+  RemoveTree(root);
+  g_free(root);
+
+  if (oSample.eStatus != poLayout->oExpected.eStatus ||
+      oSample.iPercent != poLayout->oExpected.iPercent ||
+      oSample.lNow != poLayout->oExpected.lNow ||
+      oSample.lFull != poLayout->oExpected.lFull ||
+      oSample.lRate != poLayout->oExpected.lRate) {
+    fprintf(stderr,
+            "%s: read status %d, %d%%, %ld/%ld, rate %ld, expected status "
+            "%d, %d%%, %ld/%ld, rate %ld\n",
+            poLayout->acName, oSample.eStatus, oSample.iPercent, oSample.lNow,
+            oSample.lFull, oSample.lRate, poLayout->oExpected.eStatus,
+            poLayout->oExpected.iPercent, poLayout->oExpected.lNow,
+            poLayout->oExpected.lFull, poLayout->oExpected.lRate);
+    return 0;
+  }
+  return 1;
+}
+
+int main(int argc, char **argv) {
+  unsigned int iIterations = DEFAULT_ITERATIONS;
+  const char *tmp = GetTmpfs();
+  const char *pc = g_getenv("BATTBENCH_ITERATIONS");
+  unsigned int i;
+  int bOK = 1;
+
+  /* From "make check" */
+  if (pc && *pc)
+    iIterations = strtoul(pc, NULL, 10);
+  if ((argc > 1 && (iIterations = strtoul(argv[1], NULL, 10)) == 0) ||
+      iIterations == 0) {
+    fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+    return 1;
+  }
+
+  printf("%u iterations in %s\n", iIterations, tmp);
+  printf("%-20s %10s %10s %10s\n", "layout", "ns/sample", "syscalls",
+         "allocs");
+  for (i = 0; i < G_N_ELEMENTS(aoLayouts); i++)
+    bOK &= RunLayout(tmp, &aoLayouts[i], iIterations);
+
+  return bOK ? 0 : 1;
+}
@@ -0,0 +1,59 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Battery state shared by the plugin and its data sources
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef BATTMON_BATTERY_H
+#define BATTMON_BATTERY_H
+
+typedef enum battstatus_t {
+  BattStatus_NoBatt,
+  BattStatus_Full,
+  BattStatus_Charging,
+  BattStatus_Discharging,
+  BattStatus_Unknown
+} battstatus_t;
+
+typedef enum battlevel_t {
+  BattLevel_Full,
+  BattLevel_OK,
+  BattLevel_Low,
+  BattLevel_Critical,
+  BattLevel_Unknown,
+} battlevel_t;
+
+/* One reading of the battery. Quantities that are not known are -1 */
+typedef struct battsample_t {
+  battstatus_t eStatus;
+  int iPercent;
+  long lNow;  /* Charge (uAh) or energy (uWh) left */
+  long lFull; /* Charge or energy when full */
+  long lRate; /* Current (uA) or power (uW) being drawn */
+  int bCharge; /* The above are in uAh and uA rather than uWh and uW */
+} battsample_t;
+
+/* Attributes only needed for the tooltip, read on demand. Unknown values
+   are -1 */
+typedef struct battdetails_t {
+  int bCharge;        /* Quantities in uAh and uA rather than uWh and uW */
+  long lFullDesign;   /* Charge or energy when full and new */
+  long lVoltage;      /* uV */
+  int iCycles;
+} battdetails_t;
+
+#endif /* BATTMON_BATTERY_H */
@@ -0,0 +1,83 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Prints the battery state published by the plugin
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Usage: battmon-state [battery]
+   Prints the state the plugin published with "Share with other programs"
+   as KEY=value lines, e.g. for scripts and status bars that would
+   otherwise poll sysfs themselves. Exits with 1 if nothing is published */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "battshm.h"
+
+static const char *const apcStatus[] = {
+  "None", "Full", "Charging", "Discharging", "Unknown"
+};
+
+int main(int argc, char **argv) {
+  const char *battery = argc > 1 ? argv[1] : "BAT0";
+  battshm_t oState;
+  struct stat st;
+  char path[256];
+  void *pv;
+  int fd, i, ok = 0;
+
+  snprintf(path, sizeof(path), "%s/%s%u-%s", BATTSHM_DIR, BATTSHM_PREFIX,
+           (unsigned int)getuid(), battery);
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    fprintf(stderr, "%s: nothing published at %s\n", argv[0], path);
+    return 1;
+  }
+  /* Mapping past the end of a shorter file would fault on access */
+  if (!battshm_is_trusted(fd) || fstat(fd, &st) < 0 ||
+      st.st_size < (off_t)sizeof(battshm_t))
+    pv = MAP_FAILED;
+  else
+    pv = mmap(NULL, sizeof(battshm_t), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  /* battshm_read() only gives up if the writer was preempted mid-update */
+  for (i = 0; pv != MAP_FAILED && i < 10; i++) {
+    if ((ok = battshm_read((const battshm_t *)pv, &oState)))
+      break;
+    usleep(1000);
+  }
+  if (!ok) {
+    fprintf(stderr, "%s: no state in %s\n", argv[0], path);
+    return 1;
+  }
+
+  printf("TIME=%lld\n", (long long)oState.iTime);
+  printf("STATUS=%s\n", oState.iStatus >= 0 && oState.iStatus <= 4
+                            ? apcStatus[oState.iStatus]
+                            : "Unknown");
+  printf("PERCENT=%d\n", oState.iPercent);
+  printf("NOW=%lld\n", (long long)oState.iNow);
+  printf("FULL=%lld\n", (long long)oState.iFull);
+  printf("RATE=%lld\n", (long long)oState.iRate);
+  printf("MINUTES=%d\n", oState.iMinutes);
+  printf("PID=%d\n", oState.iPid);
+  return 0;
+}
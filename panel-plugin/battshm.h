@@ -0,0 +1,89 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Layout of the battery state published in shared memory
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef BATTMON_BATTSHM_H
+#define BATTMON_BATTSHM_H
+
+/* Included by external readers too, keep it free of GLib */
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* The segment is /dev/shm/battmon-<uid>-<battery>, e.g.
+   /dev/shm/battmon-1000-BAT0, readable by everybody, written by a single
+   plugin instance at a time */
+#define BATTSHM_DIR "/dev/shm"
+#define BATTSHM_PREFIX "battmon-"
+
+#define BATTSHM_MAGIC 0x4d534242 /* "BBSM" */
+#define BATTSHM_VERSION 1
+
+/* Only appended to, readers check iSize for fields they know */
+typedef struct battshm_t {
+  uint32_t iMagic;
+  uint32_t iVersion;
+  uint32_t iSize;   /* sizeof(battshm_t) of the writer */
+  /* Odd while the writer is in the middle of an update. A snapshot is
+     consistent if it was even and unchanged before and after copying */
+  uint32_t iSeq;
+  int64_t iTime;    /* Seconds since the epoch when the sample was taken */
+  int64_t iNow;     /* uAh or uWh left, -1 if unknown */
+  int64_t iFull;    /* uAh or uWh when full, -1 if unknown */
+  int64_t iRate;    /* uA or uW drawn, -1 if unknown */
+  int32_t iStatus;  /* 0 no battery, 1 full, 2 charging, 3 discharging,
+                       4 unknown */
+  int32_t iPercent;
+  int32_t iMinutes; /* Estimated until empty or full, -1 if unknown */
+  int32_t iPid;     /* Of the writer */
+} battshm_t;
+
+/* /dev/shm is writable by everybody, another user could create the
+   segment first, hold it or shrink it under a mapping (SIGBUS). Only map
+   a plain file of our own that has no other names */
+static inline int battshm_is_trusted(int fd) {
+  struct stat st;
+
+  return fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+         st.st_uid == getuid() && st.st_nlink == 1;
+}
+
+/* Copy a consistent snapshot of the segment at poShm to poOut. Never
+   blocks, returns 0 if the writer kept getting in the way or the segment
+   is not initialised */
+static inline int battshm_read(const battshm_t *poShm, battshm_t *poOut) {
+  const volatile battshm_t *poVol = poShm;
+  uint32_t iSeq;
+  int i;
+
+  for (i = 0; i < 1000; i++) {
+    iSeq = __atomic_load_n(&poShm->iSeq, __ATOMIC_ACQUIRE);
+    if (iSeq & 1)
+      continue;
+    memcpy(poOut, (const void *)poVol, sizeof(*poOut));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&poShm->iSeq, __ATOMIC_RELAXED) == iSeq)
+      return poOut->iMagic == BATTSHM_MAGIC && iSeq != 0;
+  }
+  return 0;
+}
+
+#endif /* BATTMON_BATTSHM_H */
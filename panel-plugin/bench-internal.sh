@@ -0,0 +1,73 @@
+#!/bin/sh
+#
+#  Battery Monitor plugin for the Xfce4 panel
+#  Memory and startup time of the plugin in and out of the panel process
+#
+#  Not run by "make check", it needs a running Xfce session with a Battmon
+#  instance on the panel and write access to the installed desktop file.
+#  The panel is restarted once per mode and round, X-XFCE-Internal is put
+#  back as it was afterwards.
+#
+#  usage: bench-internal.sh [rounds] [desktop file]
+
+ROUNDS=${1:-5}
+DESKTOP=${2:-/usr/share/xfce4/panel/plugins/applet-batt.desktop}
+
+if ! pgrep -x xfce4-panel >/dev/null; then
+  echo "no xfce4-panel running" >&2
+  exit 1
+fi
+if [ ! -w "$DESKTOP" ]; then
+  echo "cannot write $DESKTOP" >&2
+  exit 1
+fi
+
+ORIGINAL=$(sed -n 's/^X-XFCE-Internal=//p' "$DESKTOP")
+trap 'sed -i "s/^X-XFCE-Internal=.*/X-XFCE-Internal=$ORIGINAL/" "$DESKTOP"' EXIT
+
+# Processes that have the plugin mapped: the panel itself when internal,
+# one wrapper per instance otherwise
+plugin_pids() {
+  grep -l libappletbatt /proc/[0-9]*/maps 2>/dev/null | cut -d/ -f3
+}
+
+# Resident kB of the panel and of every wrapper, shared pages counted once
+# per process as the kernel reports them
+total_rss() {
+  for pid in $(pgrep -x xfce4-panel) $(pgrep -f panel/wrapper); do
+    sed -n 's/^VmRSS: *\([0-9]*\) kB/\1/p' /proc/$pid/status
+  done | awk '{ s += $1 } END { print s + 0 }'
+}
+
+# Restart the panel, print ms until the plugin is mapped and kB resident
+# once the panel has settled
+measure() {
+  start=$(date +%s%N)
+  xfce4-panel -r
+  # The old panel may still have it mapped for a moment
+  sleep 0.2
+  i=0
+  while [ -z "$(plugin_pids)" ]; do
+    i=$((i + 1))
+    if [ $i -gt 300 ]; then
+      echo "plugin did not come up" >&2
+      exit 1
+    fi
+    sleep 0.05
+  done
+  end=$(date +%s%N)
+  sleep 5
+  echo "$(( (end - start) / 1000000 )) $(total_rss)"
+}
+
+printf "%-10s %10s %10s\n" mode "startup/ms" "RSS/kB"
+for mode in false true; do
+  sed -i "s/^X-XFCE-Internal=.*/X-XFCE-Internal=$mode/" "$DESKTOP"
+  [ $mode = true ] && name=internal || name=wrapper
+  n=1
+  while [ $n -le "$ROUNDS" ]; do
+    measure
+    n=$((n + 1))
+  done | awk -v name=$name '{ ms += $1; kb += $2 }
+    END { if (NR) printf "%-10s %10.0f %10.0f\n", name, ms / NR, kb / NR }'
+done
@@ -0,0 +1,270 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Battery state exported on the session bus
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gio/gio.h>
+
+#include <libxfce4util/libxfce4util.h>
+
+#include <string.h>
+
+#include "busexport.h"
+
+#define BUSEXPORT_NAME "org.xfce.Battmon"
+#define BUSEXPORT_PATH "/org/xfce/Battmon"
+#define BUSEXPORT_IFACE BUSEXPORT_NAME ".Battery"
+
+static const char acIntrospection[] =
+    "<node>"
+    "  <interface name='" BUSEXPORT_IFACE "'>"
+    "    <property name='Percent' type='i' access='read'/>"
+    "    <property name='Status' type='s' access='read'/>"
+    "    <property name='Level' type='s' access='read'/>"
+    "    <property name='TimeToEmpty' type='x' access='read'/>"
+    "    <property name='TimeToFull' type='x' access='read'/>"
+    "    <property name='Rate' type='x' access='read'/>"
+    "    <property name='RateUnit' type='s' access='read'/>"
+    "  </interface>"
+    "</node>";
+
+static const char *const apcStatus[] = {
+  [BattStatus_NoBatt] = "none",
+  [BattStatus_Full] = "full",
+  [BattStatus_Charging] = "charging",
+  [BattStatus_Discharging] = "discharging",
+  [BattStatus_Unknown] = "unknown",
+};
+
+static const char *const apcLevel[] = {
+  [BattLevel_Full] = "full",
+  [BattLevel_OK] = "ok",
+  [BattLevel_Low] = "low",
+  [BattLevel_Critical] = "critical",
+  [BattLevel_Unknown] = "unknown",
+};
+
+/* What is exported, in the order of the introspection data */
+typedef enum busprop_t {
+  BusProp_Percent,
+  BusProp_Status,
+  BusProp_Level,
+  BusProp_TimeToEmpty,
+  BusProp_TimeToFull,
+  BusProp_Rate,
+  BusProp_RateUnit,
+  BusProp_Max
+} busprop_t;
+
+static const char *const apcPropNames[BusProp_Max] = {
+  [BusProp_Percent] = "Percent",
+  [BusProp_Status] = "Status",
+  [BusProp_Level] = "Level",
+  [BusProp_TimeToEmpty] = "TimeToEmpty",
+  [BusProp_TimeToFull] = "TimeToFull",
+  [BusProp_Rate] = "Rate",
+  [BusProp_RateUnit] = "RateUnit",
+};
+
+/* Names owned by an instance of this process, to busexport_t. Instances
+   share the connection, a second one would only find the object taken */
+static GHashTable *poOwnedTable;
+
+struct busexport_t {
+  char *acName;
+  guint iOwnerId;
+  guint iObjectId;
+  GDBusConnection *poConn; /* Set while the object is registered */
+  GDBusNodeInfo *poInfo;
+  /* Current values, all integers so that changes are a comparison */
+  int64_t aiValues[BusProp_Max];
+};
+
+static GVariant *GetValue(const busexport_t *poExp, busprop_t eProp) {
+  int64_t v = poExp->aiValues[eProp];
+
+  switch (eProp) {
+  case BusProp_Percent:
+    return g_variant_new_int32((gint32)v);
+  case BusProp_Status:
+    return g_variant_new_string(apcStatus[v]);
+  case BusProp_Level:
+    return g_variant_new_string(apcLevel[v]);
+  case BusProp_RateUnit:
+    return g_variant_new_string(v ? "uA" : "uW");
+  default:
+    return g_variant_new_int64(v);
+  }
+}
+
+static GVariant *OnGetProperty(GDBusConnection *conn, const gchar *sender,
+                               const gchar *path, const gchar *iface,
+                               const gchar *name, GError **error,
+                               gpointer data) {
+  busexport_t *poExp = (busexport_t *)data;
+  int i;
+
+  for (i = 0; i < BusProp_Max; i++)
+    if (strcmp(name, apcPropNames[i]) == 0)
+      return GetValue(poExp, i);
+
+  g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY,
+              "No property %s", name);
+  return NULL;
+}
+
+static const GDBusInterfaceVTable oVTable = {NULL, OnGetProperty, NULL};
+
+static void Unexport(busexport_t *poExp) {
+  if (poExp->iObjectId)
+    g_dbus_connection_unregister_object(poExp->poConn, poExp->iObjectId);
+  poExp->iObjectId = 0;
+  if (poExp->poConn)
+    g_object_unref(poExp->poConn);
+  poExp->poConn = NULL;
+}
+
+static void OnNameAcquired(GDBusConnection *conn, const gchar *name,
+                           gpointer data)
+/* Only the owner of the name exports the object */
+{
+  busexport_t *poExp = (busexport_t *)data;
+  GError *poError = NULL;
+
+  poExp->iObjectId = g_dbus_connection_register_object(
+      conn, BUSEXPORT_PATH, poExp->poInfo->interfaces[0], &oVTable, poExp,
+      NULL, &poError);
+  if (!poExp->iObjectId) {
+    g_warning("Battmon: cannot export %s: %s", BUSEXPORT_PATH,
+              poError->message);
+    g_error_free(poError);
+    return;
+  }
+  poExp->poConn = g_object_ref(conn);
+}
+
+static void OnNameLost(GDBusConnection *conn, const gchar *name,
+                       gpointer data) {
+  /* Also when there is no bus at all, conn is NULL then, and when somebody
+     else has the name. We do not queue for it */
+  DBG("%s not owned", name);
+  Unexport((busexport_t *)data);
+}
+
+busexport_t *busexport_open(const char *battery) {
+  busexport_t *poExp;
+  char *name, *p;
+  int i;
+
+  poExp = g_new0(busexport_t, 1);
+  poExp->poInfo = g_dbus_node_info_new_for_xml(acIntrospection, NULL);
+  for (i = 0; i < BusProp_Max; i++)
+    poExp->aiValues[i] = -1;
+  poExp->aiValues[BusProp_Status] = BattStatus_Unknown;
+  poExp->aiValues[BusProp_Level] = BattLevel_Unknown;
+  poExp->aiValues[BusProp_RateUnit] = 0;
+
+  /* Bus name elements are [A-Za-z0-9_-] */
+  name = g_strconcat(BUSEXPORT_NAME ".", battery, NULL);
+  for (p = name + strlen(BUSEXPORT_NAME) + 1; *p; p++)
+    if (!g_ascii_isalnum(*p) && *p != '_')
+      *p = '_';
+
+  if (!poOwnedTable)
+    poOwnedTable = g_hash_table_new(g_str_hash, g_str_equal);
+  if (g_hash_table_lookup(poOwnedTable, name)) {
+    DBG("%s is exported by another instance", name);
+    g_free(name);
+    return poExp;
+  }
+  poExp->acName = name;
+  g_hash_table_insert(poOwnedTable, poExp->acName, poExp);
+
+  poExp->iOwnerId = g_bus_own_name(
+      G_BUS_TYPE_SESSION, name, G_BUS_NAME_OWNER_FLAGS_DO_NOT_QUEUE, NULL,
+      OnNameAcquired, OnNameLost, poExp, NULL);
+  return poExp;
+}
+
+void busexport_close(busexport_t *poExp) {
+  if (!poExp)
+    return;
+
+  Unexport(poExp);
+  if (poExp->iOwnerId) {
+    /* No callbacks after this */
+    g_bus_unown_name(poExp->iOwnerId);
+    g_hash_table_remove(poOwnedTable, poExp->acName);
+    if (g_hash_table_size(poOwnedTable) == 0) {
+      g_hash_table_destroy(poOwnedTable);
+      poOwnedTable = NULL;
+    }
+  }
+  g_dbus_node_info_unref(poExp->poInfo);
+  g_free(poExp->acName);
+  g_free(poExp);
+}
+
+void busexport_update(busexport_t *poExp, const battsample_t *poSample,
+                      battlevel_t eLevel, int minutes) {
+  int64_t aiNew[BusProp_Max];
+  GVariantBuilder oChanged;
+  int i, n = 0;
+
+  aiNew[BusProp_Percent] =
+      poSample->eStatus == BattStatus_NoBatt ? -1 : poSample->iPercent;
+  aiNew[BusProp_Status] = (unsigned int)poSample->eStatus <= BattStatus_Unknown
+                              ? poSample->eStatus
+                              : BattStatus_Unknown;
+  aiNew[BusProp_Level] = poSample->eStatus == BattStatus_NoBatt
+                             ? BattLevel_Unknown
+                             : eLevel;
+  aiNew[BusProp_TimeToEmpty] =
+      poSample->eStatus == BattStatus_Discharging && minutes >= 0
+          ? minutes * 60
+          : -1;
+  aiNew[BusProp_TimeToFull] =
+      poSample->eStatus == BattStatus_Charging && minutes >= 0 ? minutes * 60
+                                                               : -1;
+  aiNew[BusProp_Rate] = poSample->lRate;
+  aiNew[BusProp_RateUnit] = poSample->bCharge;
+
+  g_variant_builder_init(&oChanged, G_VARIANT_TYPE("a{sv}"));
+  for (i = 0; i < BusProp_Max; i++) {
+    if (aiNew[i] == poExp->aiValues[i])
+      continue;
+    poExp->aiValues[i] = aiNew[i];
+    g_variant_builder_add(&oChanged, "{sv}", apcPropNames[i],
+                          GetValue(poExp, i));
+    n++;
+  }
+
+  /* Consumers only hear from us when there is something new */
+  if (n == 0 || !poExp->poConn) {
+    g_variant_builder_clear(&oChanged);
+    return;
+  }
+  g_dbus_connection_emit_signal(
+      poExp->poConn, NULL, BUSEXPORT_PATH, "org.freedesktop.DBus.Properties",
+      "PropertiesChanged",
+      g_variant_new("(sa{sv}as)", BUSEXPORT_IFACE, &oChanged, NULL), NULL);
+}
@@ -0,0 +1,56 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Battery state exported on the session bus
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef BATTMON_BUSEXPORT_H
+#define BATTMON_BUSEXPORT_H
+
+#include "battery.h"
+
+/* Owns org.xfce.Battmon.<battery> on the session bus and exports the last
+   sample at /org/xfce/Battmon as the properties of org.xfce.Battmon.Battery:
+
+     Percent      i  0 to 100, -1 if unknown
+     Status       s  "none", "full", "charging", "discharging" or "unknown"
+     Level        s  "full", "ok", "low", "critical" or "unknown"
+     TimeToEmpty  x  Seconds, -1 unless discharging with an estimate
+     TimeToFull   x  Seconds, -1 unless charging with an estimate
+     Rate         x  Being drawn in RateUnit, -1 if unknown
+     RateUnit     s  "uW", or "uA" for batteries that only count charge
+
+   org.freedesktop.DBus.Properties.PropertiesChanged carries the values
+   that changed with an update, nothing is emitted when none did. The bus
+   is looked up the usual way, so DBUS_SESSION_BUS_ADDRESS can point it at
+   a private dbus-daemon, and BATTMON_SYSFS_ROOT at a fake battery. E.g.
+
+     gdbus monitor --session --dest org.xfce.Battmon.BAT0 */
+
+typedef struct busexport_t busexport_t;
+
+/* Everything is asynchronous, until the name is acquired updates are only
+   remembered. If another process owns the name, or another instance in
+   this one exports the battery already, nothing is exported */
+busexport_t *busexport_open(const char *battery);
+void busexport_close(busexport_t *poExp);
+
+/* minutes is the estimate until empty or full, -1 if unknown */
+void busexport_update(busexport_t *poExp, const battsample_t *poSample,
+                      battlevel_t eLevel, int minutes);
+
+#endif /* BATTMON_BUSEXPORT_H */
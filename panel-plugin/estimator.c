@@ -0,0 +1,190 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Time remaining estimated from the change of the stored energy
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include <string.h>
+
+#include "estimator.h"
+
+/* Span of history after which the driver's rate is ignored altogether */
+#define ESTIMATOR_SPAN_S (10 * 60)
+/* Older samples say more about the past than about the next hour */
+#define ESTIMATOR_MAX_AGE_S (30 * 60)
+/* Slots are kept at least this far apart, so that refreshes every few
+   seconds cannot crowd the span out of the ring. A closer sample replaces
+   the newest one */
+#define ESTIMATOR_SPACING_US                                                   \
+  ((int64_t)ESTIMATOR_SPAN_S * 1000000 / ESTIMATOR_SAMPLES)
+/* Confidence given to the driver's instantaneous rate */
+#define INSTANT_CONFIDENCE 0.3
+
+#define US_PER_HOUR (3600.0 * 1000000.0)
+
+void estimator_reset(estimator_t *poEst) {
+  memset(poEst, 0, sizeof(*poEst));
+  poEst->eStatus = BattStatus_NoBatt;
+}
+
+void estimator_add(estimator_t *poEst, const battsample_t *poSample,
+                   int64_t time_us) {
+  int iLast, iPrev;
+
+  if (poSample->eStatus != BattStatus_Charging &&
+      poSample->eStatus != BattStatus_Discharging) {
+    estimator_reset(poEst);
+    return;
+  }
+
+  /* Start over when the direction changes, when the value disappears and
+     when it moves the wrong way (the firmware recalibrated) */
+  if (poSample->eStatus != poEst->eStatus || poSample->lNow < 0)
+    estimator_reset(poEst);
+  else if (poEst->iCount > 0) {
+    iLast = (poEst->iHead + ESTIMATOR_SAMPLES - 1) % ESTIMATOR_SAMPLES;
+    if (time_us <= poEst->aiTime_us[iLast])
+      return;
+    if ((poSample->eStatus == BattStatus_Discharging &&
+         poSample->lNow > poEst->alNow[iLast]) ||
+        (poSample->eStatus == BattStatus_Charging &&
+         poSample->lNow < poEst->alNow[iLast]))
+      estimator_reset(poEst);
+  }
+
+  if (poSample->lNow < 0)
+    return;
+
+  poEst->eStatus = poSample->eStatus;
+  if (poEst->iCount >= 2) {
+    iPrev = (poEst->iHead + ESTIMATOR_SAMPLES - 2) % ESTIMATOR_SAMPLES;
+    if (time_us - poEst->aiTime_us[iPrev] < ESTIMATOR_SPACING_US) {
+      iLast = (iPrev + 1) % ESTIMATOR_SAMPLES;
+      poEst->aiTime_us[iLast] = time_us;
+      poEst->alNow[iLast] = poSample->lNow;
+      return;
+    }
+  }
+  poEst->aiTime_us[poEst->iHead] = time_us;
+  poEst->alNow[poEst->iHead] = poSample->lNow;
+  poEst->iHead = (poEst->iHead + 1) % ESTIMATOR_SAMPLES;
+  if (poEst->iCount < ESTIMATOR_SAMPLES)
+    poEst->iCount++;
+}
+
+static int GetHistoryRate(const estimator_t *poEst, double *rate,
+                          double *span_s) {
+  int iNewest, iOldest, iCount, i, j;
+  int64_t iSpan_us;
+  double t, y, mean_t = 0.0, mean_y = 0.0, cov = 0.0, var = 0.0;
+
+  if (poEst->iCount < 2)
+    return 0;
+
+  iNewest = (poEst->iHead + ESTIMATOR_SAMPLES - 1) % ESTIMATOR_SAMPLES;
+  iOldest = (poEst->iHead + ESTIMATOR_SAMPLES - poEst->iCount) %
+            ESTIMATOR_SAMPLES;
+  iCount = poEst->iCount;
+
+  /* Skip what is too old to matter */
+  for (i = 0; i < poEst->iCount - 1; i++) {
+    if (poEst->aiTime_us[iNewest] - poEst->aiTime_us[iOldest] <=
+        (int64_t)ESTIMATOR_MAX_AGE_S * 1000000)
+      break;
+    iOldest = (iOldest + 1) % ESTIMATOR_SAMPLES;
+    iCount--;
+  }
+  if (iOldest == iNewest)
+    return 0;
+
+  iSpan_us = poEst->aiTime_us[iNewest] - poEst->aiTime_us[iOldest];
+  /* The value has not moved yet, most firmwares update it in steps */
+  if (poEst->alNow[iNewest] == poEst->alNow[iOldest] || iSpan_us <= 0)
+    return 0;
+
+  /* Least squares over every slot rather than the two ends: the steps the
+     value moves in would otherwise swing the rate by a step per span each
+     time a slot drops out. Times relative to the oldest keep it exact */
+  for (i = 0, j = iOldest; i < iCount; i++, j = (j + 1) % ESTIMATOR_SAMPLES) {
+    mean_t += (poEst->aiTime_us[j] - poEst->aiTime_us[iOldest]) / US_PER_HOUR;
+    mean_y += poEst->alNow[j] - poEst->alNow[iOldest];
+  }
+  mean_t /= iCount;
+  mean_y /= iCount;
+  for (i = 0, j = iOldest; i < iCount; i++, j = (j + 1) % ESTIMATOR_SAMPLES) {
+    t = (poEst->aiTime_us[j] - poEst->aiTime_us[iOldest]) / US_PER_HOUR -
+        mean_t;
+    y = poEst->alNow[j] - poEst->alNow[iOldest] - mean_y;
+    cov += t * y;
+    var += t * t;
+  }
+  if (var <= 0.0)
+    return 0;
+
+  *rate = cov / var;
+  if (*rate < 0.0)
+    *rate = -*rate;
+  *span_s = iSpan_us / 1000000.0;
+  return 1;
+}
+
+int estimator_get_hours(const estimator_t *poEst, const battsample_t *poSample,
+                        double *hours, double *confidence) {
+  double rate = 0.0, history = 0.0, span_s = 0.0, weight = 0.0;
+  double left;
+  int bHistory;
+
+  *hours = 0.0;
+  *confidence = 0.0;
+
+  if (poSample->lNow < 0)
+    return 0;
+  if (poSample->eStatus == BattStatus_Discharging)
+    left = poSample->lNow;
+  else if (poSample->eStatus == BattStatus_Charging && poSample->lFull >= 0)
+    left = MAX(poSample->lFull - poSample->lNow, 0);
+  else
+    return 0;
+
+  bHistory = poEst->eStatus == poSample->eStatus &&
+             GetHistoryRate(poEst, &history, &span_s);
+  if (bHistory)
+    weight = MIN(span_s / ESTIMATOR_SPAN_S, 1.0);
+
+  /* Blend towards the measured rate as history builds up */
+  if (poSample->lRate > 0) {
+    rate = weight * history + (1.0 - weight) * poSample->lRate;
+    *confidence = INSTANT_CONFIDENCE + (1.0 - INSTANT_CONFIDENCE) * weight;
+  } else if (bHistory) {
+    rate = history;
+    *confidence = weight;
+  }
+
+  if (rate <= 0.0) {
+    *confidence = 0.0;
+    return 0;
+  }
+
+  *hours = left / rate;
+  return 1;
+}
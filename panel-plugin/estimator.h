@@ -0,0 +1,56 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Time remaining estimated from the change of the stored energy
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef BATTMON_ESTIMATOR_H
+#define BATTMON_ESTIMATOR_H
+
+#include <stdint.h>
+
+#include "battery.h"
+
+/* Number of (time, charge/energy) pairs kept, spread over at least ten
+   minutes however often samples come in. Memory use is fixed */
+#define ESTIMATOR_SAMPLES 16
+
+/* Many firmwares report current_now/power_now as 0, stale or very noisy.
+   The rate is therefore derived from how fast the stored charge/energy
+   actually moves over the last samples. The instantaneous rate reported by
+   the driver is only used while there is not enough history yet */
+typedef struct estimator_t {
+  int64_t aiTime_us[ESTIMATOR_SAMPLES];
+  long alNow[ESTIMATOR_SAMPLES];
+  int iHead;  /* Where the next sample goes */
+  int iCount;
+  battstatus_t eStatus; /* The history is only valid for one direction */
+} estimator_t;
+
+void estimator_reset(estimator_t *poEst);
+
+/* Record a sample taken at time_us (monotonic clock) */
+void estimator_add(estimator_t *poEst, const battsample_t *poSample,
+                   int64_t time_us);
+
+/* Hours until empty (discharging) or full (charging). confidence goes from
+   0 (no estimate, the function returns 0) through about 0.3 (the driver's
+   instantaneous rate only) to 1 (ten minutes or more of history) */
+int estimator_get_hours(const estimator_t *poEst, const battsample_t *poSample,
+                        double *hours, double *confidence);
+
+#endif /* BATTMON_ESTIMATOR_H */
@@ -0,0 +1,249 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Custom-drawn charge gauge
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gtk/gtk.h>
+
+#include <libxfce4util/libxfce4util.h>
+
+#include <string.h>
+
+#include "gauge.h"
+
+/* Same as the padding the label used to have */
+#define GAUGE_PADDING 4
+
+struct gauge_t {
+  GtkWidget *wArea;
+  PangoLayout *poLayout;
+  PangoFontDescription *poFont; /* NULL for the theme's */
+  char acText[8];
+  int iColour;
+  int iLevel;
+  /* Background and text as last drawn, exposes just paint it */
+  cairo_surface_t *poCache;
+  int bValid;
+  int iWidth, iHeight;
+};
+
+static void GetColour(int colour, double *r, double *g, double *b)
+/* Continuous version of the old 20-step red-yellow-green label backgrounds.
+   Red rises (green falls) by 0x1A per 5% and both are at full strength
+   around 50% */
+{
+  double x;
+
+  switch (colour) {
+  case GAUGE_COLOUR_CHARGING: /* skyblue */
+    *r = 135 / 255.0;
+    *g = 206 / 255.0;
+    *b = 235 / 255.0;
+    return;
+  case GAUGE_COLOUR_UNKNOWN: /* darkgray */
+    *r = *g = *b = 169 / 255.0;
+    return;
+  }
+
+  x = CLAMP(colour / 5.0, 0.0, 19.0);
+  *r = MIN(26.84 * (19.0 - x), 255.0) / 255.0;
+  *g = MIN(26.84 * x, 255.0) / 255.0;
+  *b = 0.0;
+}
+
+static void Measure(gauge_t *poGauge)
+/* Ask for the room the text needs, which only changes with the text
+   length or the font */
+{
+  int w, h;
+
+  pango_layout_set_text(poGauge->poLayout, poGauge->acText, -1);
+  pango_layout_get_pixel_size(poGauge->poLayout, &w, &h);
+  gtk_widget_set_size_request(poGauge->wArea, w + 2 * GAUGE_PADDING,
+                              h + 2 * GAUGE_PADDING);
+}
+
+static void Render(gauge_t *poGauge) {
+  GtkStyleContext *context = gtk_widget_get_style_context(poGauge->wArea);
+  GdkWindow *window = gtk_widget_get_window(poGauge->wArea);
+  double r, g, b;
+  GdkRGBA fg;
+  cairo_t *cr;
+  int w, h;
+
+  poGauge->iWidth = gtk_widget_get_allocated_width(poGauge->wArea);
+  poGauge->iHeight = gtk_widget_get_allocated_height(poGauge->wArea);
+  if (poGauge->poCache)
+    cairo_surface_destroy(poGauge->poCache);
+  poGauge->poCache = gdk_window_create_similar_surface(
+      window, CAIRO_CONTENT_COLOR_ALPHA, poGauge->iWidth, poGauge->iHeight);
+  cr = cairo_create(poGauge->poCache);
+
+  GetColour(poGauge->iColour, &r, &g, &b);
+  cairo_set_source_rgb(cr, r, g, b);
+  cairo_paint(cr);
+
+  if (poGauge->iLevel >= 0) {
+    cairo_set_source_rgba(cr, 0, 0, 0, 0.35);
+    cairo_rectangle(cr, 0, poGauge->iHeight - GAUGE_BAR,
+                    poGauge->iWidth * CLAMP(poGauge->iLevel, 0, 100) / 100.0,
+                    GAUGE_BAR);
+    cairo_fill(cr);
+  }
+
+  gtk_style_context_get_color(context, gtk_widget_get_state_flags(
+                                           poGauge->wArea), &fg);
+  gdk_cairo_set_source_rgba(cr, &fg);
+  pango_layout_get_pixel_size(poGauge->poLayout, &w, &h);
+  cairo_move_to(cr, (poGauge->iWidth - w) / 2, (poGauge->iHeight - h) / 2);
+  pango_cairo_show_layout(cr, poGauge->poLayout);
+
+  cairo_destroy(cr);
+  poGauge->bValid = 1;
+}
+
+static gboolean OnDraw(GtkWidget *widget, cairo_t *cr, gpointer data) {
+  gauge_t *poGauge = (gauge_t *)data;
+
+  if (!poGauge->bValid ||
+      poGauge->iWidth != gtk_widget_get_allocated_width(widget) ||
+      poGauge->iHeight != gtk_widget_get_allocated_height(widget))
+    Render(poGauge);
+
+  cairo_set_source_surface(cr, poGauge->poCache, 0, 0);
+  cairo_paint(cr);
+  return FALSE;
+}
+
+static void OnStyleUpdated(GtkWidget *widget, gpointer data) {
+  gauge_t *poGauge = (gauge_t *)data;
+
+  /* Text colour, theme font or DPI may have changed */
+  pango_layout_context_changed(poGauge->poLayout);
+  Measure(poGauge);
+  poGauge->bValid = 0;
+}
+
+static void OnScaleChanged(GObject *object, GParamSpec *pspec, gpointer data) {
+  gauge_t *poGauge = (gauge_t *)data;
+
+  poGauge->bValid = 0;
+  gtk_widget_queue_draw(poGauge->wArea);
+}
+
+static void OnUnrealize(GtkWidget *widget, gpointer data) {
+  gauge_t *poGauge = (gauge_t *)data;
+
+  /* The cache was made for the window that is going away */
+  if (poGauge->poCache)
+    cairo_surface_destroy(poGauge->poCache);
+  poGauge->poCache = NULL;
+  poGauge->bValid = 0;
+}
+
+static void GaugeFree(gpointer data) {
+  gauge_t *poGauge = (gauge_t *)data;
+
+  if (poGauge->poCache)
+    cairo_surface_destroy(poGauge->poCache);
+  if (poGauge->poFont)
+    pango_font_description_free(poGauge->poFont);
+  g_object_unref(poGauge->poLayout);
+  g_free(poGauge);
+}
+
+void gauge_set(gauge_t *poGauge, const char *text, int colour, int level) {
+  int bText = strcmp(text, poGauge->acText) != 0;
+
+  if (!bText && colour == poGauge->iColour && level == poGauge->iLevel)
+    return;
+
+  if (bText) {
+    g_strlcpy(poGauge->acText, text, sizeof(poGauge->acText));
+    Measure(poGauge);
+  }
+  poGauge->iColour = colour;
+  poGauge->iLevel = level;
+  poGauge->bValid = 0;
+  gtk_widget_queue_draw(poGauge->wArea);
+}
+
+void gauge_set_font(gauge_t *poGauge, const char *font) {
+  PangoFontDescription *poFont = NULL;
+
+  if (font && strcmp(font, "(default)") != 0)
+    poFont = pango_font_description_from_string(font);
+  /* The configured size has always been applied in pixels, as the label's
+     stylesheet did, not in points */
+  if (poFont && !pango_font_description_get_size_is_absolute(poFont) &&
+      pango_font_description_get_size(poFont) > 0)
+    pango_font_description_set_absolute_size(
+        poFont,
+        pango_font_description_get_size(poFont) / PANGO_SCALE * PANGO_SCALE);
+  if ((!poFont && !poGauge->poFont) ||
+      (poFont && poGauge->poFont &&
+       pango_font_description_equal(poFont, poGauge->poFont))) {
+    if (poFont)
+      pango_font_description_free(poFont);
+    return;
+  }
+
+  if (poGauge->poFont)
+    pango_font_description_free(poGauge->poFont);
+  poGauge->poFont = poFont;
+  pango_layout_set_font_description(poGauge->poLayout, poFont);
+  Measure(poGauge);
+  poGauge->bValid = 0;
+  gtk_widget_queue_draw(poGauge->wArea);
+}
+
+gauge_t *gauge_new(void) {
+  gauge_t *poGauge;
+
+  poGauge = g_new0(gauge_t, 1);
+  poGauge->iColour = GAUGE_COLOUR_UNKNOWN;
+  poGauge->iLevel = -1;
+
+  poGauge->wArea = gtk_drawing_area_new();
+#if GTK_CHECK_VERSION(3, 16, 0)
+  gtk_style_context_add_class(gtk_widget_get_style_context(poGauge->wArea),
+                              "battmon_value");
+#endif
+  poGauge->poLayout = gtk_widget_create_pango_layout(poGauge->wArea, "");
+  Measure(poGauge);
+
+  g_object_set_data_full(G_OBJECT(poGauge->wArea), "battmon-gauge", poGauge,
+                         GaugeFree);
+  g_signal_connect(poGauge->wArea, "draw", G_CALLBACK(OnDraw), poGauge);
+  g_signal_connect(poGauge->wArea, "style-updated",
+                   G_CALLBACK(OnStyleUpdated), poGauge);
+  g_signal_connect(poGauge->wArea, "notify::scale-factor",
+                   G_CALLBACK(OnScaleChanged), poGauge);
+  g_signal_connect(poGauge->wArea, "unrealize", G_CALLBACK(OnUnrealize),
+                   poGauge);
+
+  return poGauge;
+}
+
+GtkWidget *gauge_get_widget(gauge_t *poGauge) {
+  return poGauge->wArea;
+}
@@ -0,0 +1,49 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Custom-drawn charge gauge
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef BATTMON_GAUGE_H
+#define BATTMON_GAUGE_H
+
+#include <gtk/gtk.h>
+
+/* The charge level is drawn as a bar this high along the bottom edge. It
+   stays within the padding the label used to have, everything above it
+   looks as the label did at the same 5% steps */
+#define GAUGE_BAR 2
+
+/* Colours that do not depend on the charge, see gauge_set() */
+#define GAUGE_COLOUR_CHARGING 101
+#define GAUGE_COLOUR_UNKNOWN 102
+
+typedef struct gauge_t gauge_t;
+
+/* The gauge is freed together with its widget */
+gauge_t *gauge_new(void);
+GtkWidget *gauge_get_widget(gauge_t *poGauge);
+
+/* colour is a charge from 0 (red) to 100 (green) or one of GAUGE_COLOUR_*.
+   level is the charge shown by the bar along the bottom edge, -1 for none.
+   Nothing is redrawn unless one of them changed */
+void gauge_set(gauge_t *poGauge, const char *text, int colour, int level);
+
+/* A Pango font description such as "Sans 10", or "(default)" */
+void gauge_set_font(gauge_t *poGauge, const char *font);
+
+#endif /* BATTMON_GAUGE_H */
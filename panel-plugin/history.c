@@ -0,0 +1,295 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Fixed-size on-disk battery history
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gio/gio.h>
+
+#include <libxfce4util/libxfce4util.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "history.h"
+
+#define HISTORY_MAGIC 0x48544142 /* "BATH" */
+#define HISTORY_VERSION 1
+
+/* Written once when the file is created and never touched afterwards, so
+   there is nothing a crash could tear. The position in the ring is not
+   stored, it is recovered from the sequence numbers of the records */
+typedef struct __attribute__((packed)) historyhdr_t {
+  uint32_t iMagic;
+  uint16_t iVersion;
+  uint16_t iRecSize;
+  uint32_t iCapacity;
+  uint32_t iCheck;
+} historyhdr_t;
+
+/* An open on a worker, see history_open_async() */
+struct historyopen_t {
+  char *acPath;
+  unsigned int iDays;
+  HistoryFunc pfFunc;
+  void *pvData;
+  history_t *poHist; /* What the worker opened */
+  int bCancelled;    /* Close it instead of handing it over */
+};
+
+struct history_t {
+  int iFd;
+  size_t iSize;
+  historyhdr_t *poHdr;
+  historyrec_t *poRecs;
+  uint32_t iCapacity;
+  uint32_t iNext;  /* Slot the next record goes to */
+  uint32_t iCount; /* Valid records */
+  uint32_t iSeq;   /* Sequence number of the newest record */
+};
+
+static uint16_t Fletcher16(const void *data, size_t len) {
+  const uint8_t *p = data;
+  uint16_t a = 0, b = 0;
+
+  while (len--) {
+    a = (a + *p++) % 255;
+    b = (b + a) % 255;
+  }
+  return (b << 8) | a;
+}
+
+static uint16_t RecordCheck(const historyrec_t *poRec) {
+  return Fletcher16(poRec, offsetof(historyrec_t, iCheck));
+}
+
+static uint32_t HeaderCheck(const historyhdr_t *poHdr) {
+  return Fletcher16(poHdr, offsetof(historyhdr_t, iCheck));
+}
+
+static int HeaderValid(const historyhdr_t *poHdr, uint32_t iCapacity) {
+  return poHdr->iMagic == HISTORY_MAGIC &&
+         poHdr->iVersion == HISTORY_VERSION &&
+         poHdr->iRecSize == sizeof(historyrec_t) &&
+         poHdr->iCapacity == iCapacity && poHdr->iCheck == HeaderCheck(poHdr);
+}
+
+static int RecordValid(const historyrec_t *poRec) {
+  return poRec->iSeq != 0 && poRec->iCheck == RecordCheck(poRec);
+}
+
+static void Recover(history_t *poHist) {
+  uint32_t i, iNewest = 0;
+
+  /* Find the newest intact record. A torn record fails its check and is
+     treated like an empty slot */
+  poHist->iSeq = 0;
+  for (i = 0; i < poHist->iCapacity; i++) {
+    if (RecordValid(&poHist->poRecs[i]) &&
+        poHist->poRecs[i].iSeq > poHist->iSeq) {
+      poHist->iSeq = poHist->poRecs[i].iSeq;
+      iNewest = i;
+    }
+  }
+  poHist->iNext = poHist->iSeq ? (iNewest + 1) % poHist->iCapacity : 0;
+  /* Sequence numbers start at 1 in a new file */
+  poHist->iCount = MIN(poHist->iSeq, poHist->iCapacity);
+}
+
+history_t *history_open(const char *path, unsigned int iDays) {
+  history_t *poHist;
+  struct stat oStat;
+  historyhdr_t oHdr;
+  void *pvMap;
+  int bFresh, err;
+
+  g_return_val_if_fail(iDays > 0 && iDays <= HISTORY_MAX_DAYS, NULL);
+
+  poHist = g_new0(history_t, 1);
+  poHist->iCapacity = iDays * 24 * 3600 / HISTORY_INTERVAL_S;
+  poHist->iSize =
+      sizeof(historyhdr_t) + poHist->iCapacity * sizeof(historyrec_t);
+
+  poHist->iFd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (poHist->iFd < 0)
+    goto fail;
+
+  memset(&oHdr, 0, sizeof(oHdr));
+  bFresh = fstat(poHist->iFd, &oStat) < 0 ||
+           (size_t)oStat.st_size != poHist->iSize ||
+           pread(poHist->iFd, &oHdr, sizeof(oHdr), 0) != sizeof(oHdr) ||
+           !HeaderValid(&oHdr, poHist->iCapacity);
+  if (bFresh) {
+    DBG("starting a new history in %s", path);
+    /* Truncating to 0 first makes sure all records read back as empty */
+    if (ftruncate(poHist->iFd, 0) < 0 ||
+        ftruncate(poHist->iFd, poHist->iSize) < 0)
+      goto fail;
+  }
+
+  /* A store to a hole that cannot be filled raises SIGBUS, and that would
+     take the whole panel down. Also for files a sparse one was kept in */
+  if ((err = posix_fallocate(poHist->iFd, 0, poHist->iSize)) != 0) {
+    errno = err;
+    goto fail;
+  }
+
+  pvMap = mmap(NULL, poHist->iSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+               poHist->iFd, 0);
+  if (pvMap == MAP_FAILED)
+    goto fail;
+  /* Nobody may have cut it short in between */
+  if (fstat(poHist->iFd, &oStat) < 0 ||
+      (size_t)oStat.st_size != poHist->iSize) {
+    munmap(pvMap, poHist->iSize);
+    errno = ESTALE;
+    goto fail;
+  }
+  poHist->poHdr = (historyhdr_t *)pvMap;
+  poHist->poRecs = (historyrec_t *)((char *)pvMap + sizeof(historyhdr_t));
+
+  if (bFresh) {
+    oHdr.iMagic = HISTORY_MAGIC;
+    oHdr.iVersion = HISTORY_VERSION;
+    oHdr.iRecSize = sizeof(historyrec_t);
+    oHdr.iCapacity = poHist->iCapacity;
+    oHdr.iCheck = HeaderCheck(&oHdr);
+    *poHist->poHdr = oHdr;
+  }
+
+  Recover(poHist);
+  return poHist;
+
+fail:
+  g_warning("Battmon: cannot open the history %s: %s", path,
+            g_strerror(errno));
+  if (poHist->iFd >= 0)
+    close(poHist->iFd);
+  g_free(poHist);
+  return NULL;
+}
+
+void history_close(history_t *poHist) {
+  if (!poHist)
+    return;
+
+  /* No msync(), the kernel writes the pages back in its own time */
+  munmap(poHist->poHdr, poHist->iSize);
+  close(poHist->iFd);
+  g_free(poHist);
+}
+
+static void OpenWork(GTask *task, gpointer source, gpointer data,
+                     GCancellable *cancellable)
+/* Runs on a thread of the GLib pool */
+{
+  historyopen_t *poOpen = (historyopen_t *)data;
+
+  poOpen->poHist = history_open(poOpen->acPath, poOpen->iDays);
+  g_task_return_boolean(task, TRUE);
+}
+
+static void OnOpened(GObject *source, GAsyncResult *result, gpointer data)
+/* Back on the main loop */
+{
+  historyopen_t *poOpen = (historyopen_t *)data;
+
+  if (poOpen->bCancelled)
+    history_close(poOpen->poHist);
+  else
+    poOpen->pfFunc(poOpen->poHist, poOpen->pvData);
+  g_free(poOpen->acPath);
+  g_free(poOpen);
+}
+
+historyopen_t *history_open_async(const char *path, unsigned int iDays,
+                                  HistoryFunc func, void *data) {
+  historyopen_t *poOpen = g_new0(historyopen_t, 1);
+  GTask *task;
+
+  poOpen->acPath = g_strdup(path);
+  poOpen->iDays = iDays;
+  poOpen->pfFunc = func;
+  poOpen->pvData = data;
+
+  task = g_task_new(NULL, NULL, OnOpened, poOpen);
+  g_task_set_task_data(task, poOpen, NULL);
+  g_task_run_in_thread(task, OpenWork);
+  g_object_unref(task);
+  return poOpen;
+}
+
+void history_open_cancel(historyopen_t *poOpen) {
+  if (poOpen)
+    poOpen->bCancelled = 1;
+}
+
+static int32_t ToMilli(long val) {
+  return val < 0 ? -1 : (int32_t)MIN(val / 1000, INT32_MAX);
+}
+
+void history_append(history_t *poHist, const battsample_t *poSample,
+                    time_t now) {
+  const historyrec_t *poLast;
+  historyrec_t oRec;
+
+  poLast = history_get(poHist, 0);
+  if (poLast && (time_t)poLast->iTime <= now &&
+      now - (time_t)poLast->iTime < HISTORY_INTERVAL_S)
+    return;
+
+  oRec.iSeq = poHist->iSeq + 1;
+  oRec.iTime = (uint32_t)now;
+  oRec.iEnergy = ToMilli(poSample->lNow);
+  oRec.iPower = ToMilli(poSample->lRate);
+  oRec.iPercent = (uint8_t)CLAMP(poSample->iPercent, 0, 100);
+  oRec.iStatus = (uint8_t)poSample->eStatus;
+  oRec.iCheck = RecordCheck(&oRec);
+
+  /* The one and only store to the map for this sample */
+  poHist->poRecs[poHist->iNext] = oRec;
+
+  poHist->iSeq = oRec.iSeq;
+  poHist->iNext = (poHist->iNext + 1) % poHist->iCapacity;
+  if (poHist->iCount < poHist->iCapacity)
+    poHist->iCount++;
+}
+
+unsigned int history_get_count(const history_t *poHist) {
+  return poHist->iCount;
+}
+
+const historyrec_t *history_get(const history_t *poHist, unsigned int i) {
+  const historyrec_t *poRec;
+
+  if (i >= poHist->iCount)
+    return NULL;
+
+  poRec = &poHist->poRecs[(poHist->iNext + poHist->iCapacity - 1 - i) %
+                          poHist->iCapacity];
+  /* Slots torn by a crash stay invalid until they are overwritten */
+  return RecordValid(poRec) ? poRec : NULL;
+}
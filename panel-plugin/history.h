@@ -0,0 +1,77 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Fixed-size on-disk battery history
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef BATTMON_HISTORY_H
+#define BATTMON_HISTORY_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "battery.h"
+
+/* At most one record is kept per HISTORY_INTERVAL_S */
+#define HISTORY_INTERVAL_S 60
+#define HISTORY_DEFAULT_DAYS 7
+#define HISTORY_MAX_DAYS 90
+
+/* One record of the history file. Records are packed, a week at one sample
+   a minute is 10080 * 20 bytes, about 200 KB */
+typedef struct __attribute__((packed)) historyrec_t {
+  uint32_t iSeq;    /* Increases with every record, 0 for unused slots */
+  uint32_t iTime;   /* Seconds since the epoch */
+  int32_t iEnergy;  /* mAh or mWh left, -1 if unknown */
+  int32_t iPower;   /* mA or mW drawn, -1 if unknown */
+  uint8_t iPercent;
+  uint8_t iStatus;  /* battstatus_t */
+  uint16_t iCheck;  /* Over all of the above, catches torn records */
+} historyrec_t;
+
+typedef struct history_t history_t;
+
+/* Map the history at path, creating it or starting it over if it is
+   missing, damaged or sized for another number of days */
+history_t *history_open(const char *path, unsigned int iDays);
+void history_close(history_t *poHist);
+
+/* Called on the main loop with what history_open() returned, which then
+   belongs to the callee */
+typedef void (*HistoryFunc)(history_t *poHist, void *data);
+
+typedef struct historyopen_t historyopen_t;
+
+/* history_open() on a thread of the GLib pool. Creating the file means
+   allocating up to HISTORY_MAX_DAYS of it, which is no job for the main
+   loop. Opening the same path twice at a time is not allowed */
+historyopen_t *history_open_async(const char *path, unsigned int iDays,
+                                  HistoryFunc func, void *data);
+/* func is not called anymore, what the worker opens is closed again.
+   Only allowed until func was called */
+void history_open_cancel(historyopen_t *poOpen);
+
+/* Records the sample unless the last record is less than
+   HISTORY_INTERVAL_S old */
+void history_append(history_t *poHist, const battsample_t *poSample,
+                    time_t now);
+
+unsigned int history_get_count(const history_t *poHist);
+/* i = 0 is the newest record */
+const historyrec_t *history_get(const history_t *poHist, unsigned int i);
+
+#endif /* BATTMON_HISTORY_H */
@@ -0,0 +1,181 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Pre-rendered icons for the panel
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gtk/gtk.h>
+
+#include <libxfce4util/libxfce4util.h>
+
+#include "iconcache.h"
+
+/* Surfaces by "name@size@scale", shared by all instances in the process.
+   NULL values remember icons the theme does not have */
+static GHashTable *poSharedTable;
+static unsigned int iSharedUsers;
+static gulong iSharedThemeId;
+
+typedef struct icon_t {
+  cairo_surface_t *poSurface;
+  int bLoaded; /* Also set when the lookup failed */
+} icon_t;
+
+struct iconcache_t {
+  const char *const *apcNames;
+  int iCount;
+  icon_t *aoIcons;
+  GtkIconTheme *poTheme;
+  gulong iThemeId;
+  int iSize;
+  int iScale;
+  IconCacheFunc pfFunc;
+  void *pvData;
+};
+
+static void Flush(iconcache_t *poCache) {
+  int i;
+
+  for (i = 0; i < poCache->iCount; i++) {
+    if (poCache->aoIcons[i].poSurface)
+      cairo_surface_destroy(poCache->aoIcons[i].poSurface);
+    poCache->aoIcons[i].poSurface = NULL;
+    poCache->aoIcons[i].bLoaded = 0;
+  }
+}
+
+static void OnSharedThemeChanged(GtkIconTheme *theme, gpointer data) {
+  /* Connected before any instance's handler, so they reload from an empty
+     table */
+  g_hash_table_remove_all(poSharedTable);
+}
+
+static void RefShared(GtkIconTheme *poTheme) {
+  if (iSharedUsers++ > 0)
+    return;
+
+  poSharedTable = g_hash_table_new_full(
+      g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify)cairo_surface_destroy);
+  iSharedThemeId = g_signal_connect(poTheme, "changed",
+                                    G_CALLBACK(OnSharedThemeChanged), NULL);
+}
+
+static void UnrefShared(GtkIconTheme *poTheme) {
+  if (--iSharedUsers > 0)
+    return;
+
+  g_signal_handler_disconnect(poTheme, iSharedThemeId);
+  g_hash_table_destroy(poSharedTable);
+  poSharedTable = NULL;
+}
+
+static cairo_surface_t *LoadShared(iconcache_t *poCache, int i)
+/* Returns a new reference, NULL if there is no such icon */
+{
+  cairo_surface_t *poSurface;
+  GError *error = NULL;
+  gpointer pvSurface;
+  char *key;
+
+  key = g_strdup_printf("%s@%d@%d", poCache->apcNames[i], poCache->iSize,
+                        poCache->iScale);
+  if (g_hash_table_lookup_extended(poSharedTable, key, NULL, &pvSurface)) {
+    g_free(key);
+    poSurface = (cairo_surface_t *)pvSurface;
+    return poSurface ? cairo_surface_reference(poSurface) : NULL;
+  }
+
+  /* The only theme lookup and rasterization this icon gets in the process
+     until the theme changes */
+  poSurface = gtk_icon_theme_load_surface(
+      poCache->poTheme, poCache->apcNames[i], poCache->iSize,
+      poCache->iScale, NULL, GTK_ICON_LOOKUP_FORCE_SIZE, &error);
+  if (!poSurface) {
+    DBG("cannot load %s: %s", poCache->apcNames[i], error->message);
+    g_error_free(error);
+  }
+  g_hash_table_insert(poSharedTable, key, poSurface);
+  return poSurface ? cairo_surface_reference(poSurface) : NULL;
+}
+
+static void OnThemeChanged(GtkIconTheme *theme, gpointer data) {
+  iconcache_t *poCache = (iconcache_t *)data;
+
+  DBG("icon theme changed");
+  Flush(poCache);
+  poCache->pfFunc(poCache->pvData);
+}
+
+iconcache_t *iconcache_new(const char *const *names, int count, int size,
+                           IconCacheFunc func, void *data) {
+  iconcache_t *poCache;
+
+  poCache = g_new0(iconcache_t, 1);
+  poCache->apcNames = names;
+  poCache->iCount = count;
+  poCache->aoIcons = g_new0(icon_t, count);
+  poCache->iSize = size;
+  poCache->iScale = 1;
+  poCache->pfFunc = func;
+  poCache->pvData = data;
+
+  poCache->poTheme = g_object_ref(gtk_icon_theme_get_default());
+  RefShared(poCache->poTheme);
+  poCache->iThemeId = g_signal_connect(poCache->poTheme, "changed",
+                                       G_CALLBACK(OnThemeChanged), poCache);
+  return poCache;
+}
+
+void iconcache_free(iconcache_t *poCache) {
+  if (!poCache)
+    return;
+
+  g_signal_handler_disconnect(poCache->poTheme, poCache->iThemeId);
+  Flush(poCache);
+  UnrefShared(poCache->poTheme);
+  g_object_unref(poCache->poTheme);
+  g_free(poCache->aoIcons);
+  g_free(poCache);
+}
+
+void iconcache_set_size(iconcache_t *poCache, int size, int scale) {
+  if (size == poCache->iSize && scale == poCache->iScale)
+    return;
+
+  poCache->iSize = size;
+  poCache->iScale = scale;
+  Flush(poCache);
+  poCache->pfFunc(poCache->pvData);
+}
+
+cairo_surface_t *iconcache_get(iconcache_t *poCache, int i) {
+  icon_t *poIcon;
+
+  g_return_val_if_fail(i >= 0 && i < poCache->iCount, NULL);
+
+  poIcon = &(poCache->aoIcons[i]);
+  if (!poIcon->bLoaded) {
+    poIcon->poSurface = LoadShared(poCache, i);
+    poIcon->bLoaded = 1;
+  }
+  return poIcon->poSurface;
+}
@@ -0,0 +1,46 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Pre-rendered icons for the panel
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef BATTMON_ICONCACHE_H
+#define BATTMON_ICONCACHE_H
+
+#include <gtk/gtk.h>
+
+/* Instances in the same process share the rendered surfaces, an icon is
+   only rasterized once per size and scale */
+typedef struct iconcache_t iconcache_t;
+
+/* Called after the theme, size or scale changed. Surfaces handed out
+   before are gone and should be fetched again */
+typedef void (*IconCacheFunc)(void *data);
+
+/* names must stay valid for the life of the cache */
+iconcache_t *iconcache_new(const char *const *names, int count, int size,
+                           IconCacheFunc func, void *data);
+void iconcache_free(iconcache_t *poCache);
+
+/* size in logical pixels */
+void iconcache_set_size(iconcache_t *poCache, int size, int scale);
+
+/* Rendered on first use, NULL when the theme has no such icon. The cache
+   keeps the reference */
+cairo_surface_t *iconcache_get(iconcache_t *poCache, int i);
+
+#endif /* BATTMON_ICONCACHE_H */
@@ -26,6 +26,7 @@
 #include <config.h>
 #endif
 
+#include <gmodule.h>
 #include <gtk/gtk.h>
 
 #include <libxfce4panel/xfce-panel-convenience.h>
@@ -33,23 +34,105 @@
 #include <libxfce4ui/libxfce4ui.h>
 #include <libxfce4util/libxfce4util.h>
 
+#include <limits.h>
 #include <math.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "alert.h"
+#include "battery.h"
+#include "busexport.h"
+#include "estimator.h"
+#include "gauge.h"
+#include "history.h"
+#include "iconcache.h"
+#include "publish.h"
+#include "sampler.h"
+#include "schedule.h"
+#include "session.h"
+#include "source.h"
+#include "sparkline.h"
+#include "stats.h"
+#include "uevent.h"
+
 #define PLUGIN_NAME "Battmon"
 #define BORDER 2
 
+/* Where the power supplies live. Can be pointed at a fake tree through the
+   BATTMON_SYSFS_ROOT environment variable */
+#define SYSFS_POWER_SUPPLY "/sys/class/power_supply"
+#define BATTERY_NAME "BAT0"
+
+/* Threshold alerts, by rc key prefix and what the notification says */
+#define ALERT_COUNT 2
+
+static const char *const apcAlertKeys[ALERT_COUNT] = {"Low", "Critical"};
+static const char *const apcAlertNames[ALERT_COUNT] = {
+  "Low battery",
+  "Critical battery",
+};
+static const char *const apcAlertUnits[AlertUnit_Max] = {
+  [AlertUnit_Percent] = "percent",
+  [AlertUnit_Minutes] = "minutes",
+};
+static const char *const apcAlertActions[AlertAction_Max] = {
+  [AlertAction_Notify] = "notify",
+  [AlertAction_Command] = "command",
+  [AlertAction_Suspend] = "suspend",
+};
+static const char *const apcSources[SourceType_Max] = {
+  [SourceType_Sysfs] = "sysfs",
+  [SourceType_UPower] = "upower",
+  [SourceType_Replay] = "replay",
+};
+
+/* Building an instance should not hold up the panel's startup for longer,
+   the first sample is only requested once the panel is drawn. Both times
+   show in the "stats" event */
+#define STARTUP_BUDGET_US (20 * 1000)
+
+/* Refresh requests (power_supply events, "refresh" plugin events, clicks
+   and the pointer entering the plugin) within this window are served by
+   one update. Those from the user are fine with a sample of up to
+   REFRESH_MAX_AGE_US, e.g. one another instance just took */
+#define REFRESH_DEBOUNCE_MS 200
+#define REFRESH_MAX_AGE_US (2 * G_USEC_PER_SEC)
+
+/* The tooltip details are read again when shown after this long */
+#define DETAILS_MAX_AGE_US (60 * G_USEC_PER_SEC)
+
+/* Without uevents a missing battery is looked for right after it went
+   missing and then on every PROBE_TICKS-th update */
+#define PROBE_TICKS 3
+
 typedef struct gui_t {
     /* Configuration GUI widgets */
     GtkWidget      *wSc_Period;
+    GtkWidget      *wSc_History;
+    GtkWidget      *wTB_Graph;
+    GtkWidget      *wTB_Publish;
+    GtkWidget      *wTB_Export;
+    GtkWidget      *wCB_Source;
+    GtkWidget      *wFC_Replay;
+    GtkWidget      *awTB_Alert[ALERT_COUNT];
+    GtkWidget      *awSc_Alert[ALERT_COUNT];
+    GtkWidget      *awCB_AlertUnit[ALERT_COUNT];
+    GtkWidget      *awCB_AlertAction[ALERT_COUNT];
+    GtkWidget      *awEn_AlertCommand[ALERT_COUNT];
     GtkWidget      *wPB_Font;
 } gui_t;
 
 typedef struct param_t {
   /* Configurable parameters */
   uint32_t iPeriod_ms;
+  unsigned int iHistoryDays; /* 0 keeps no history */
+  int bShowGraph;
+  int bPublish; /* Battery state in shared memory for other programs */
+  int bExport;  /* and on the session bus */
+  sourcetype_t eSource;
+  char *acReplayFile; /* "" for made up samples */
+  alertconf_t aoAlerts[ALERT_COUNT];
   char *acFont;
 } param_t;
 
@@ -64,33 +147,119 @@ typedef struct monitor_t {
   GtkWidget *wEventBox;
   GtkWidget *wBox;
   GtkWidget *wImgBox;
-  GtkWidget *wValue;
+  gauge_t *poValue; /* Owned by its widget */
   GtkWidget *wImage;
+  sparkline_t *poGraph; /* Owned by its widget */
+  iconcache_t *poIcons; /* Indexed by batticon_t */
 } monitor_t;
 
+typedef enum batticon_t {
+  BattIcon_FullCharging,
+  BattIcon_GoodCharging,
+  BattIcon_LowCharging,
+  BattIcon_FullCharged,
+  BattIcon_Good,
+  BattIcon_Low,
+  BattIcon_Caution,
+  BattIcon_Missing,
+  BattIcon_Max
+} batticon_t;
+
+static const char *const apcIconNames[BattIcon_Max] = {
+  [BattIcon_FullCharging] = "battery-full-charging",
+  [BattIcon_GoodCharging] = "battery-good-charging",
+  [BattIcon_LowCharging] = "battery-low-charging",
+  [BattIcon_FullCharged] = "battery-full-charged",
+  [BattIcon_Good] = "battery-good",
+  [BattIcon_Low] = "battery-low",
+  [BattIcon_Caution] = "battery-caution",
+  [BattIcon_Missing] = "battery-missing",
+};
+
+/* Icon for each status and level. The level is ignored when there is no
+   battery, it is full or its state is unknown */
+static const batticon_t
+    aaeIcons[BattStatus_Unknown + 1][BattLevel_Unknown + 1] = {
+  [BattStatus_NoBatt] = {
+    [BattLevel_Full] = BattIcon_Missing,
+    [BattLevel_OK] = BattIcon_Missing,
+    [BattLevel_Low] = BattIcon_Missing,
+    [BattLevel_Critical] = BattIcon_Missing,
+    [BattLevel_Unknown] = BattIcon_Missing,
+  },
+  [BattStatus_Full] = {
+    [BattLevel_Full] = BattIcon_FullCharging,
+    [BattLevel_OK] = BattIcon_FullCharging,
+    [BattLevel_Low] = BattIcon_FullCharging,
+    [BattLevel_Critical] = BattIcon_FullCharging,
+    [BattLevel_Unknown] = BattIcon_FullCharging,
+  },
+  [BattStatus_Charging] = {
+    [BattLevel_Full] = BattIcon_FullCharging,
+    [BattLevel_OK] = BattIcon_GoodCharging,
+    [BattLevel_Low] = BattIcon_LowCharging,
+    [BattLevel_Critical] = BattIcon_LowCharging,
+    [BattLevel_Unknown] = BattIcon_Missing,
+  },
+  [BattStatus_Discharging] = {
+    [BattLevel_Full] = BattIcon_FullCharged,
+    [BattLevel_OK] = BattIcon_Good,
+    [BattLevel_Low] = BattIcon_Low,
+    [BattLevel_Critical] = BattIcon_Caution,
+    [BattLevel_Unknown] = BattIcon_Missing,
+  },
+  [BattStatus_Unknown] = {
+    [BattLevel_Full] = BattIcon_FullCharged,
+    [BattLevel_OK] = BattIcon_FullCharged,
+    [BattLevel_Low] = BattIcon_FullCharged,
+    [BattLevel_Critical] = BattIcon_FullCharged,
+    [BattLevel_Unknown] = BattIcon_FullCharged,
+  },
+};
+
+/* What GTK_ICON_SIZE_LARGE_TOOLBAR used to give, in logical pixels */
+#define ICON_SIZE 24
+
+typedef struct view_t {
+  /* What is currently shown in the panel */
+  int iIcon;    /* batticon_t, -1 before the first update */
+  int iColour;  /* See gauge_set() */
+  int iLevel;
+  char acText[5];
+} view_t;
+
 typedef struct battmon_t {
   XfcePanelPlugin *plugin;
   unsigned int iTimerId; /* Cyclic update */
+  unsigned int iTimerPeriod_s; /* Period iTimerId was armed with */
+  unsigned int iRefreshId; /* Pending update, see RequestRefresh() */
+  int64_t iRefreshAge_us; /* Oldest sample it may show */
+  unsigned int iStartId; /* Pending first update */
+  int64_t iConstruct_ns; /* When construction began, 0 once shown */
+  uevent_t *poUevent;
+  session_t *poSession;
+  source_t *poSource;
+  sourcetype_t eSource; /* What poSource was opened with */
+  char *acReplayFile;
+  alert_t *apoAlerts[ALERT_COUNT];
   struct conf_t oConf;
   struct monitor_t oMonitor;
+  struct view_t oView;
+  battsample_t oSample; /* Last reading */
+  estimator_t oEstimator;
+  history_t *poHistory;
+  historyopen_t *poHistoryOpen; /* poHistory is being opened */
+  int bGraphLive; /* A sample is in the graph, too late to seed it */
+  publish_t *poPublish;
+  busexport_t *poExport;
+  battdetails_t oDetails; /* For the tooltip, read when it is shown */
+  int64_t iDetails_us;    /* When oDetails was read, 0 never */
+  int bDetailsPending;    /* Requested, refresh the tooltip once in */
+  unsigned int iAbsentTicks; /* Updates since the battery went missing */
+  unsigned int iHistoryDays; /* What poHistory was opened with */
+  stats_t oStats;
 } battmon_t;
 
-typedef enum battstatus_t {
-  BattStatus_NoBatt,
-  BattStatus_Full,
-  BattStatus_Charging,
-  BattStatus_Discharging,
-  BattStatus_Unknown
-} battstatus_t;
-
-typedef enum battlevel_t {
-  BattLevel_Full,
-  BattLevel_OK,
-  BattLevel_Low,
-  BattLevel_Critical,
-  BattLevel_Unknown,
-} battlevel_t;
-
 static battlevel_t GetBatteryLevel(int percent) {
   if(percent > 100)
     percent = 100;
@@ -107,84 +276,28 @@ static battlevel_t GetBatteryLevel(int percent) {
     return BattLevel_Critical;
 }
 
-static int GetBatteryPercent() {
-  const char* file = "/sys/class/power_supply/BAT0/capacity";
-  FILE* fp = NULL;
-  int percent = 0;
-  
-  if(fp = fopen(file, "r")) {
-    fscanf(fp, "%d", &percent);
-    fclose(fp);
-    return percent;
-  }
+static const char *GetSysfsRoot() {
+  const char *root = g_getenv("BATTMON_SYSFS_ROOT");
 
-  return percent;
+  return (root && *root) ? root : SYSFS_POWER_SUPPLY;
 }
 
-static battstatus_t GetBatteryStatus() {
-  const char* file = "/sys/class/power_supply/BAT0/status";
-  char status[256];
-  FILE* fp = NULL;
-  
-  if(fp = fopen(file, "r")) {
-    fgets(status, 256, fp);
-    fclose(fp);
-    if(strcmp(status, "Full\n") == 0)
-      return BattStatus_Full;
-    else if(strcmp(status, "Charging\n") == 0)
-      return BattStatus_Charging;
-    else if(strcmp(status, "Discharging\n") == 0)
-      return BattStatus_Discharging;
-    return BattStatus_Unknown;
-  }
-  
-  return BattStatus_NoBatt;
+static int GetBatteryPercent(const battsample_t *poSample) {
+  return poSample->iPercent;
 }
 
-static long ReadFile(const char* filename) {
-  long val = -1;
-  FILE* fp = NULL;
-  if(fp = fopen(filename, "r")) {
-    fscanf(fp, "%ld", &val);
-    fclose(fp);
-  }
-  return val;
-}
-
-static long ReadFileAlt(const char* filename1, const char* filename2) {
-  long val = -1;
-  val = ReadFile(filename1);
-  if(val == -1)
-    val = ReadFile(filename2);
-  return val;
+static battstatus_t GetBatteryStatus(const battsample_t *poSample) {
+  return poSample->eStatus;
 }
 
-static int GetBatteryTime(battstatus_t status, int* hrs, int* mins) {
-  const char* fileCharge     = "/sys/class/power_supply/BAT0/charge_now";
-  const char* fileChargeFull = "/sys/class/power_supply/BAT0/charge_full";
-  const char* fileEnergy     = "/sys/class/power_supply/BAT0/energy_now";
-  const char* fileEnergyFull = "/sys/class/power_supply/BAT0/energy_full";
-  const char* fileCurrent    = "/sys/class/power_supply/BAT0/current_now";
-  const char* filePower      = "/sys/class/power_supply/BAT0/power_now";
-  long total = 0, now = 1, full = 0;
-  double ratio = 0.0;
+static int GetBatteryTime(const estimator_t *poEst,
+                          const battsample_t *poSample, int *hrs, int *mins) {
+  double ratio = 0.0, confidence = 0.0;
   int read = 0;
 
-  total = ReadFileAlt(fileCharge, fileEnergy);
-  now = ReadFileAlt(fileCurrent, filePower);
-  if(status == BattStatus_Charging) {
-    full = ReadFileAlt(fileChargeFull, fileEnergyFull);
-    if(total != -1 && now != -1 && full != -1 && now > 0) {
-      read = 1;
-      ratio = (float)(full - total) / (float) now;
-    }
-  } else if(status == BattStatus_Discharging) {
-    if(total != -1 && now != -1 && now > 0) {
-      read = 1;
-      ratio = (float) total / (float) now;
-    }
-  }
-  
+  read = estimator_get_hours(poEst, poSample, &ratio, &confidence);
+  DBG("%.2f h left, confidence %.2f", ratio, confidence);
+
   if(read) {
     *hrs = floor(ratio);
     *mins = floor((ratio - *hrs) * 60);
@@ -194,129 +307,552 @@ static int GetBatteryTime(battstatus_t status, int* hrs, int* mins) {
 }
 
 /**************************************************************/
-static int DisplayBatteryLevel(struct battmon_t *p_poPlugin)
-/* Launch the command, get its output and display it in the panel-docked
-   text field */
+static void BuildView(const estimator_t *poEst, const battsample_t *poSample,
+                      struct view_t *poView)
+/* Turn a battery sample into what should be shown in the panel */
 {
-  struct param_t *poConf = &(p_poPlugin->oConf.oParam);
-  struct monitor_t *poMonitor = &(p_poPlugin->oMonitor);
-  const char* icon = NULL;
-  int percent = 0, hrs = -1, mins = -1;
-  battstatus_t status = BattStatus_NoBatt;
-  char text[5] = "----";
-  char class[8];
-  
-  percent = GetBatteryPercent();
-  status = GetBatteryStatus();
-  switch(status) {
-  case BattStatus_Full:
-    icon = "battery-full-charging";
-    break;
-  case BattStatus_Charging:
-    switch(GetBatteryLevel(percent)) {
-    case BattLevel_Full:
-      icon = "battery-full-charging";
-      break;
-    case BattLevel_OK:
-      icon = "battery-good-charging";
-      break;
-    case BattLevel_Low:
-    case BattLevel_Critical:
-      icon = "battery-low-charging";
-      break;
-    default:
-      /* Should never get here */
-      break;
-    }
-    break;
-  case BattStatus_Discharging:
-    switch(GetBatteryLevel(percent)) {
-    case BattLevel_Full:
-      icon = "battery-full-charged";
-      break;
-    case BattLevel_OK:
-      icon = "battery-good";
-      break;
-    case BattLevel_Low:
-      icon = "battery-low";
-      break;
-    case BattLevel_Critical:
-      icon = "battery-caution";
-      break;
-    default:
-      /* Should never get here */
-      break;
-    }
-    break;
-  case BattStatus_Unknown:
-    icon = "battery-full-charged";
-    break;
-  case BattStatus_NoBatt:
-    icon = "battery-missing";
-    break;
-  default:
-    /* Should never get here */
-    break;
-  }
-
-  
-  if(GetBatteryTime(status, &hrs, &mins)) {
+  int percent = GetBatteryPercent(poSample), hrs = -1, mins = -1;
+  battstatus_t status = GetBatteryStatus(poSample);
+
+  poView->iIcon = (unsigned int)status <= BattStatus_Unknown
+                      ? aaeIcons[status][GetBatteryLevel(percent)]
+                      : BattIcon_Missing;
+  poView->iLevel = status == BattStatus_NoBatt ? -1 : CLAMP(percent, 0, 100);
+  strcpy(poView->acText, "----");
+  if(GetBatteryTime(poEst, poSample, &hrs, &mins)) {
     switch(status) {
     case BattStatus_Discharging:
-      snprintf(class, sizeof(class), "p%d", percent/5);
+      poView->iColour = CLAMP(percent, 0, 100);
       break;
     case BattStatus_Charging:
-      snprintf(class, sizeof(class), "%s", "pblue");
+      poView->iColour = GAUGE_COLOUR_CHARGING;
       break;
     default:
-      snprintf(class, sizeof(class), "%s", "pgray");
+      poView->iColour = GAUGE_COLOUR_UNKNOWN;
       break;
     }
-    snprintf(text, sizeof(text), "%1d:%02d", hrs, mins);
+    snprintf(poView->acText, sizeof(poView->acText), "%1d:%02d", hrs, mins);
   } else {
     switch(status) {
     case BattStatus_Charging:
-      snprintf(class, sizeof(class), "%s", "pblue");
+      poView->iColour = GAUGE_COLOUR_CHARGING;
       break;
     default:
-      snprintf(class, sizeof(class), "%s", "pgray");
+      poView->iColour = GAUGE_COLOUR_UNKNOWN;
       break;
     }
   }
+}
+
+static void SetIcon(struct monitor_t *poMonitor, int iIcon) {
+  cairo_surface_t *poSurface = iconcache_get(poMonitor->poIcons, iIcon);
+
+  /* Swapping in a surface that is already rendered. Without one the image
+     shows GTK's own missing icon, like it used to */
+  if (poSurface)
+    gtk_image_set_from_surface(GTK_IMAGE(poMonitor->wImage), poSurface);
+  else
+    gtk_image_set_from_icon_name(GTK_IMAGE(poMonitor->wImage),
+                                 apcIconNames[iIcon],
+                                 GTK_ICON_SIZE_LARGE_TOOLBAR);
+}
+
+static void OnIconsChanged(void *p_pvPlugin) {
+  struct battmon_t *poPlugin = (battmon_t *)p_pvPlugin;
+
+  if (poPlugin->oView.iIcon >= 0)
+    SetIcon(&(poPlugin->oMonitor), poPlugin->oView.iIcon);
+}
+
+static void OnImageScaleChanged(GObject *object, GParamSpec *pspec,
+                                gpointer data) {
+  struct monitor_t *poMonitor = (monitor_t *)data;
+
+  iconcache_set_size(poMonitor->poIcons, ICON_SIZE,
+                     gtk_widget_get_scale_factor(poMonitor->wImage));
+}
+
+static void ApplyView(struct battmon_t *p_poPlugin, const struct view_t *poNew)
+/* Only hand what actually changed to GTK. The gauge just redraws itself,
+   a new icon may relayout the whole panel */
+{
+  struct monitor_t *poMonitor = &(p_poPlugin->oMonitor);
+  struct view_t *poOld = &(p_poPlugin->oView);
+  int changed = 0;
+
+  if(poNew->iColour != poOld->iColour || poNew->iLevel != poOld->iLevel ||
+     strcmp(poNew->acText, poOld->acText) != 0) {
+    gauge_set(poMonitor->poValue, poNew->acText, poNew->iColour,
+              poNew->iLevel);
+    changed = 1;
+  }
+
+  if(poNew->iIcon != poOld->iIcon) {
+    SetIcon(poMonitor, poNew->iIcon);
+    if(poOld->iIcon < 0)
+      gtk_widget_show(poMonitor->wImage);
+    changed = 1;
+  }
+
+  *poOld = *poNew;
+  if(!changed)
+    stats_count(&(p_poPlugin->oStats), StatsCount_UpdatesSkipped, 1);
+}
+
+static void PushGraph(struct battmon_t *poPlugin,
+                      const battsample_t *poSample) {
+  /* Same units as the history, so that seeding from it matches */
+  sparkline_push(poPlugin->oMonitor.poGraph,
+                 poSample->eStatus == BattStatus_NoBatt ? -1
+                                                        : poSample->iPercent,
+                 poSample->lRate < 0 ? -1 : poSample->lRate / 1000,
+                 poSample->eStatus == BattStatus_Charging,
+                 g_get_real_time() / G_USEC_PER_SEC);
+  poPlugin->bGraphLive = 1;
+}
+
+static void SeedGraph(struct battmon_t *poPlugin)
+/* Fill the graph from the history so that it is not empty after a restart */
+{
+  const historyrec_t *poRec;
+  time_t now = g_get_real_time() / G_USEC_PER_SEC;
+  unsigned int i, n;
+
+  /* Older minutes would land on the newest column */
+  if (!poPlugin->poHistory || poPlugin->bGraphLive)
+    return;
+
+  n = MIN(history_get_count(poPlugin->poHistory), SPARKLINE_COLUMNS);
+  for (i = n; i-- > 0;) {
+    poRec = history_get(poPlugin->poHistory, i);
+    if (!poRec || (time_t)poRec->iTime > now ||
+        now - (time_t)poRec->iTime >= SPARKLINE_COLUMNS * SPARKLINE_INTERVAL_S)
+      continue;
+    sparkline_push(poPlugin->oMonitor.poGraph,
+                   poRec->iStatus == BattStatus_NoBatt ? -1 : poRec->iPercent,
+                   poRec->iPower, poRec->iStatus == BattStatus_Charging,
+                   poRec->iTime);
+  }
+}
+
+static void Reschedule(struct battmon_t *poPlugin);
+
+static void OnSample(const samplerresult_t *poResult, void *p_pvPlugin)
+/* Display a reading the sampler took off the main loop in the
+   panel-docked text field */
+{
+  struct battmon_t *p_poPlugin = (battmon_t *)p_pvPlugin;
+  stats_t *poStats = &(p_poPlugin->oStats);
+  const battsample_t *poSample = &(poResult->oSample);
+  struct view_t oView;
+  int64_t iStart_ns;
+  double hours, confidence;
+  int hrs, mins, i;
+  /* Replayed samples are not this battery's. They must not end up in its
+     history, be shown to other programs as its state or suspend the
+     machine */
+  int bReal = p_poPlugin->eSource != SourceType_Replay;
+
+  stats_add(poStats, StatsTime_Sample, poResult->iDuration_ns);
+  stats_count(poStats, StatsCount_Syscalls, poResult->iSyscalls);
+  stats_count(poStats, StatsCount_FailedOpens, poResult->iFailedOpens);
+  stats_count(poStats, StatsCount_Hung, poResult->iHung);
+  stats_count(poStats, StatsCount_Coalesced, poResult->iCoalesced);
+
+  p_poPlugin->oSample = *poSample;
+  estimator_add(&(p_poPlugin->oEstimator), poSample, poResult->iTime_us);
+  if (p_poPlugin->poHistory && bReal)
+    history_append(p_poPlugin->poHistory, poSample,
+                   g_get_real_time() / G_USEC_PER_SEC);
+
+  /* Also while hidden, so the graph is complete when it is turned on */
+  PushGraph(p_poPlugin, poSample);
+
+  if (bReal && (p_poPlugin->poPublish || p_poPlugin->poExport)) {
+    if (!GetBatteryTime(&(p_poPlugin->oEstimator), poSample, &hrs, &mins))
+      hrs = mins = -1;
+    if (p_poPlugin->poPublish)
+      publish_update(p_poPlugin->poPublish, poSample,
+                     hrs < 0 ? -1 : hrs * 60 + mins);
+    if (p_poPlugin->poExport)
+      busexport_update(p_poPlugin->poExport, poSample,
+                       GetBatteryLevel(poSample->iPercent),
+                       hrs < 0 ? -1 : hrs * 60 + mins);
+  }
+
+  if (p_poPlugin->iConstruct_ns) {
+    stats_end(poStats, StatsTime_FirstSample, p_poPlugin->iConstruct_ns);
+    p_poPlugin->iConstruct_ns = 0;
+  }
+
+  iStart_ns = stats_begin();
+  BuildView(&(p_poPlugin->oEstimator), poSample, &oView);
+  ApplyView(p_poPlugin, &oView);
+  stats_end(poStats, StatsTime_Render, iStart_ns);
+
+  if (!estimator_get_hours(&(p_poPlugin->oEstimator), poSample, &hours,
+                           &confidence))
+    hours = -1.0;
+  for (i = 0; bReal && i < ALERT_COUNT; i++)
+    alert_update(p_poPlugin->apoAlerts[i], poSample, hours);
+
+  if (poResult->bDetails) {
+    p_poPlugin->oDetails = poResult->oDetails;
+    p_poPlugin->iDetails_us = poResult->iTime_us;
+    if (p_poPlugin->bDetailsPending) {
+      p_poPlugin->bDetailsPending = 0;
+      gtk_widget_trigger_tooltip_query(p_poPlugin->oMonitor.wEventBox);
+    }
+  }
+
+  /* The new state may ask for another period. Without a timer we are
+     paused or not started yet */
+  if (p_poPlugin->iTimerId)
+    Reschedule(p_poPlugin);
+}
+
+static void AppendQuantity(GString *text, const char *label, long now,
+                           long full, const battdetails_t *poDetails)
+/* e.g. "Energy: 32.5 / 57.0 Wh (design 60.0 Wh)" */
+{
+  const char *unit = poDetails->bCharge ? "Ah" : "Wh";
+
+  if (now < 0)
+    return;
+  g_string_append_printf(text, "\n%s: %.1f", label, now / 1e6);
+  if (full > 0)
+    g_string_append_printf(text, " / %.1f", full / 1e6);
+  g_string_append_printf(text, " %s", unit);
+  if (poDetails->lFullDesign > 0)
+    g_string_append_printf(text, " (design %.1f %s)",
+                           poDetails->lFullDesign / 1e6, unit);
+}
+
+static gchar *BuildTooltip(struct battmon_t *poPlugin)
+/* Only formatted when GTK asks for the tooltip */
+{
+  static const char *const apcStatus[] = {
+    [BattStatus_NoBatt] = N_("No battery"),
+    [BattStatus_Full] = N_("Full"),
+    [BattStatus_Charging] = N_("Charging"),
+    [BattStatus_Discharging] = N_("Discharging"),
+    [BattStatus_Unknown] = N_("Unknown"),
+  };
+  const battsample_t *poSample = &(poPlugin->oSample);
+  const battdetails_t *poDetails = &(poPlugin->oDetails);
+  double hours, confidence, watts = -1.0;
+  GString *text;
+
+  text = g_string_new(NULL);
+  if (poSample->eStatus == BattStatus_NoBatt) {
+    g_string_append(text, _(apcStatus[BattStatus_NoBatt]));
+    return g_string_free(text, FALSE);
+  }
+
+  g_string_append_printf(text, "%d%%, %s", GetBatteryPercent(poSample),
+                         _(apcStatus[poSample->eStatus]));
+
+  /* The units are only known once the details are in */
+  if (poPlugin->iDetails_us) {
+    if (poSample->lRate >= 0 && !poDetails->bCharge)
+      watts = poSample->lRate / 1e6;
+    else if (poSample->lRate >= 0 && poDetails->lVoltage > 0)
+      watts = (poSample->lRate / 1e6) * (poDetails->lVoltage / 1e6);
+    if (watts >= 0)
+      g_string_append_printf(text, _("\nPower: %.1f W"), watts);
+
+    AppendQuantity(text, poDetails->bCharge ? _("Charge") : _("Energy"),
+                   poSample->lNow, poSample->lFull, poDetails);
+  }
+  if (poSample->lFull > 0 && poDetails->lFullDesign > 0)
+    g_string_append_printf(
+        text, _("\nWear: %.0f%%"),
+        MAX(0.0, 100.0 - 100.0 * poSample->lFull / poDetails->lFullDesign));
+  if (poDetails->iCycles > 0)
+    g_string_append_printf(text, _("\nCycles: %d"), poDetails->iCycles);
+  if (poDetails->lVoltage > 0)
+    g_string_append_printf(text, _("\nVoltage: %.2f V"),
+                           poDetails->lVoltage / 1e6);
+
+  if (estimator_get_hours(&(poPlugin->oEstimator), poSample, &hours,
+                          &confidence))
+    g_string_append_printf(text, _("\n%d:%02d %s (confidence %.0f%%)"),
+                           (int)hours, (int)((hours - (int)hours) * 60),
+                           poSample->eStatus == BattStatus_Charging
+                               ? _("until full")
+                               : _("left"),
+                           confidence * 100);
+
+  return g_string_free(text, FALSE);
+}
 
-  gtk_widget_set_name(poMonitor->wValue, class);
-  gtk_label_set_text(GTK_LABEL(poMonitor->wValue), text);
-  gtk_image_set_from_icon_name(GTK_IMAGE(poMonitor->wImage), icon,
-                               GTK_ICON_SIZE_LARGE_TOOLBAR);
+static gboolean OnQueryTooltip(GtkWidget *widget, gint x, gint y,
+                               gboolean keyboard, GtkTooltip *tooltip,
+                               void *p_pvPlugin) {
+  struct battmon_t *poPlugin = (battmon_t *)p_pvPlugin;
+  gchar *text;
+
+  /* Show what is known at once, the details follow when the worker is
+     done with them */
+  if (!poPlugin->bDetailsPending &&
+      (!poPlugin->iDetails_us ||
+       g_get_monotonic_time() - poPlugin->iDetails_us > DETAILS_MAX_AGE_US)) {
+    poPlugin->bDetailsPending = 1;
+    source_request_details(poPlugin->poSource);
+  }
 
-  gtk_widget_show(poMonitor->wImage);
-  gtk_widget_show(poMonitor->wValue);
+  text = BuildTooltip(poPlugin);
+  gtk_tooltip_set_text(tooltip, text);
+  g_free(text);
+  return TRUE;
+}
+
+static int DisplayBatteryLevel(struct battmon_t *p_poPlugin,
+                               int64_t iMaxAge_us)
+/* Read the battery and display its state once the reading is in. Reading
+   may block in the firmware for a long time, so it is done by a worker.
+   Nothing is read if another instance got a sample within iMaxAge_us, it
+   was displayed here as well */
+{
+  stats_count(&(p_poPlugin->oStats), StatsCount_Updates, 1);
+
+  /* Without uevents there is nobody to tell us that a battery was
+     inserted. A read failing with ENODEV or ENOENT marks it missing (see
+     sysfs.c), the next update looks for it, later ones only now and then */
+  if (p_poPlugin->oSample.eStatus != BattStatus_NoBatt)
+    p_poPlugin->iAbsentTicks = 0;
+  else if (!p_poPlugin->poUevent &&
+           p_poPlugin->iAbsentTicks++ % PROBE_TICKS == 0)
+    source_probe(p_poPlugin->poSource, 1);
+  source_request(p_poPlugin->poSource, iMaxAge_us);
 
   return (0);
 
 } /* DisplayBatteryLevel() */
 
+static void OnAlertDue(void *p_pvPlugin)
+/* An alert threshold is forecast to be crossed about now */
+{
+  DisplayBatteryLevel((battmon_t *)p_pvPlugin, 0);
+}
+
 /**************************************************************/
 
+static unsigned int GetTimerPeriod(struct battmon_t *poPlugin)
+/* How long to wait before the next update, see schedule.h */
+{
+  const battsample_t *poSample = &(poPlugin->oSample);
+
+  return schedule_get_period(
+      poSample->eStatus,
+      GetBatteryLevel(poSample->iPercent) == BattLevel_Critical,
+      poPlugin->oConf.oParam.iPeriod_ms,
+      poPlugin->poUevent || source_pushes(poPlugin->poSource));
+}
+
+static gboolean SetTimer(void *p_pvPlugin);
+
+static void ArmTimer(struct battmon_t *poPlugin, unsigned int iPeriod_s) {
+  DBG("next update in %u s", iPeriod_s);
+  poPlugin->iTimerPeriod_s = iPeriod_s;
+  /* Second granularity lets GLib line our wakeups up with everybody
+     else's */
+  poPlugin->iTimerId =
+      g_timeout_add_seconds(iPeriod_s, (GSourceFunc)SetTimer, poPlugin);
+}
+
 static gboolean SetTimer(void *p_pvPlugin)
 /* Recurrently update the panel-docked monitor through a timer */
 /* Warning : should not be called directly (except the 1st time) */
 /* To avoid multiple timers */
 {
   struct battmon_t *poPlugin = (battmon_t *)p_pvPlugin;
-  struct param_t *poConf = &(poPlugin->oConf.oParam);
+  unsigned int iPeriod_s;
 
-  DisplayBatteryLevel(poPlugin);
+  stats_count(&(poPlugin->oStats), StatsCount_Ticks, 1);
+  DisplayBatteryLevel(poPlugin, SAMPLER_SHARE_US);
 
-  if (poPlugin->iTimerId == 0) {
-    poPlugin->iTimerId =
-        g_timeout_add(poConf->iPeriod_ms, (GSourceFunc)SetTimer, poPlugin);
-    return FALSE;
-  }
+  iPeriod_s = GetTimerPeriod(poPlugin);
+  if (poPlugin->iTimerId != 0 && iPeriod_s == poPlugin->iTimerPeriod_s)
+    return TRUE;
 
-  return TRUE;
+  /* First call, or the battery state asks for another period. Returning
+     FALSE drops the source we may have been called from */
+  ArmTimer(poPlugin, iPeriod_s);
+  return FALSE;
 } /* SetTimer() */
 
+static void Reschedule(struct battmon_t *poPlugin)
+/* Adapt the timer to the state found by the latest sample */
+{
+  unsigned int iPeriod_s = GetTimerPeriod(poPlugin);
+
+  if (poPlugin->iTimerId != 0 && iPeriod_s == poPlugin->iTimerPeriod_s)
+    return;
+  if (poPlugin->iTimerId)
+    g_source_remove(poPlugin->iTimerId);
+  ArmTimer(poPlugin, iPeriod_s);
+}
+
+static gboolean OnRefreshDue(void *p_pvPlugin) {
+  struct battmon_t *poPlugin = (battmon_t *)p_pvPlugin;
+
+  poPlugin->iRefreshId = 0;
+  DisplayBatteryLevel(poPlugin, poPlugin->iRefreshAge_us);
+  return FALSE;
+}
+
+static void RequestRefresh(struct battmon_t *poPlugin, int64_t iMaxAge_us)
+/* Update soon. However many requests come in until then, they cost one
+   update, which satisfies the strictest of them */
+{
+  stats_count(&(poPlugin->oStats), StatsCount_Refreshes, 1);
+  if (poPlugin->iRefreshId) {
+    poPlugin->iRefreshAge_us = MIN(poPlugin->iRefreshAge_us, iMaxAge_us);
+    return;
+  }
+  poPlugin->iRefreshAge_us = iMaxAge_us;
+  poPlugin->iRefreshId =
+      g_timeout_add(REFRESH_DEBOUNCE_MS, OnRefreshDue, poPlugin);
+}
+
+static gboolean OnStartIdle(gpointer p_pvPlugin)
+/* The panel has been drawn with the placeholder, now for the real thing.
+   Nothing to do if the session went idle meanwhile, or if a changed
+   configuration or an active session already started the timer */
+{
+  struct battmon_t *poPlugin = (battmon_t *)p_pvPlugin;
+
+  poPlugin->iStartId = 0;
+  if (!poPlugin->iTimerId && session_monitor_is_active(poPlugin->poSession))
+    SetTimer(poPlugin);
+  return G_SOURCE_REMOVE;
+}
+
+static void OnSessionChanged(int bActive, void *p_pvPlugin)
+/* Nobody looks at the panel while the machine sleeps, the session is
+   locked or the screen is blanked. Stop sampling then, and take a fresh
+   sample as soon as somebody is back */
+{
+  struct battmon_t *poPlugin = (battmon_t *)p_pvPlugin;
+
+  if (poPlugin->iRefreshId) {
+    g_source_remove(poPlugin->iRefreshId);
+    poPlugin->iRefreshId = 0;
+  }
+  if (poPlugin->iTimerId) {
+    g_source_remove(poPlugin->iTimerId);
+    poPlugin->iTimerId = 0;
+  }
+
+  if (bActive) {
+    /* The monotonic clock stood still while suspended, the battery did
+       not. It keeps running through a screen lock, the history is good.
+       The battery may have been swapped meanwhile, and attributes that
+       hung before may answer again */
+    if (session_monitor_take_slept(poPlugin->poSession)) {
+      estimator_reset(&(poPlugin->oEstimator));
+      source_probe(poPlugin->poSource, 0);
+    }
+    SetTimer(poPlugin);
+  }
+}
+
+static void WatchBattery(struct battmon_t *poPlugin, int bWatch) {
+  static const char *const apcAttrs[] = {"status", "capacity"};
+  char file[PATH_MAX];
+  const char *path;
+  unsigned int i;
+
+  /* Most drivers never sysfs_notify() these, but those that do will then
+     wake us up even without a uevent */
+  for (i = 0; i < G_N_ELEMENTS(apcAttrs); i++) {
+    if (!(path = source_get_path(poPlugin->poSource, apcAttrs[i], file,
+                                 sizeof(file))))
+      continue;
+    if (bWatch)
+      uevent_monitor_watch_attr(poPlugin->poUevent, path);
+    else
+      uevent_monitor_unwatch_attr(poPlugin->poUevent, path);
+  }
+}
+
+static void OnPowerSupplyEvent(const char *action, const char *name,
+                               void *p_pvPlugin)
+/* A power supply (battery or AC adapter) changed. Several of these usually
+   arrive together, so the update is deferred until the burst is over */
+{
+  struct battmon_t *poPlugin = (battmon_t *)p_pvPlugin;
+
+  stats_count(&(poPlugin->oStats), StatsCount_Events, 1);
+  if (name && strcmp(name, BATTERY_NAME) == 0) {
+    if (strcmp(action, "add") == 0 || strcmp(action, "remove") == 0)
+      source_probe(poPlugin->poSource, 0);
+    if (strcmp(action, "add") == 0)
+      WatchBattery(poPlugin, 1);
+    else if (strcmp(action, "remove") == 0)
+      WatchBattery(poPlugin, 0);
+  }
+
+  /* Whatever happened, the sample taken on wakeup will show it */
+  if (!session_monitor_is_active(poPlugin->poSession))
+    return;
+
+  /* The kernel says something changed, no older sample will do */
+  RequestRefresh(poPlugin, 0);
+}
+
+static void OpenSource(struct battmon_t *poPlugin)
+/* (Re)open the configured data source. Only sysfs needs the uevents */
+{
+  struct param_t *poConf = &(poPlugin->oConf.oParam);
+
+  uevent_monitor_free(poPlugin->poUevent);
+  poPlugin->poUevent = NULL;
+  source_free(poPlugin->poSource);
+
+  poPlugin->eSource = poConf->eSource;
+  g_free(poPlugin->acReplayFile);
+  poPlugin->acReplayFile = g_strdup(poConf->acReplayFile);
+  poPlugin->poSource = source_new(
+      poConf->eSource,
+      poConf->eSource == SourceType_Sysfs ? GetSysfsRoot()
+                                          : poConf->acReplayFile,
+      BATTERY_NAME, OnSample, poPlugin);
+
+  /* Rates from the old source say nothing about the new one, and details
+     it was asked for will not come */
+  estimator_reset(&(poPlugin->oEstimator));
+  poPlugin->iDetails_us = 0;
+  poPlugin->bDetailsPending = 0;
+
+  if (poConf->eSource == SourceType_Sysfs) {
+    poPlugin->poUevent =
+        uevent_monitor_new(GetSysfsRoot(), OnPowerSupplyEvent, poPlugin);
+    if (poPlugin->poUevent)
+      WatchBattery(poPlugin, 1);
+  }
+}
+
+
+static gboolean OnButtonPress(GtkWidget *widget, GdkEventButton *event,
+                              gpointer p_pvPlugin)
+/* Somebody wants to know, make sure they see a recent sample. The menu
+   still gets the right button */
+{
+  if (event->button == 1 && event->type == GDK_BUTTON_PRESS)
+    RequestRefresh((battmon_t *)p_pvPlugin, REFRESH_MAX_AGE_US);
+  return FALSE;
+}
+
+static gboolean OnEnter(GtkWidget *widget, GdkEventCrossing *event,
+                        gpointer p_pvPlugin)
+/* Likely about to read the panel or the tooltip */
+{
+  if (event->detail != GDK_NOTIFY_INFERIOR)
+    RequestRefresh((battmon_t *)p_pvPlugin, REFRESH_MAX_AGE_US);
+  return FALSE;
+}
 
 static battmon_t *battmon_create_control(XfcePanelPlugin *plugin)
 /* Plugin API */
@@ -328,11 +864,10 @@ static battmon_t *battmon_create_control(XfcePanelPlugin *plugin)
   GtkOrientation orientation = xfce_panel_plugin_get_orientation(plugin);
   GtkSettings *settings;
   gchar *default_font;
+  int i;
 
 #if GTK_CHECK_VERSION(3, 16, 0)
   GtkStyleContext *context;
-  GtkCssProvider *css_provider;
-  gchar *css;
 #endif
 
   poPlugin = g_new(battmon_t, 1);
@@ -343,8 +878,29 @@ static battmon_t *battmon_create_control(XfcePanelPlugin *plugin)
   poPlugin->plugin = plugin;
 
   poConf->iPeriod_ms = 30 * 1000;
+  poConf->iHistoryDays = HISTORY_DEFAULT_DAYS;
   poPlugin->iTimerId = 0;
 
+  /* Alerts are off until configured */
+  poConf->aoAlerts[0].iValue = 10;
+  poConf->aoAlerts[1].iValue = 5;
+  for (i = 0; i < ALERT_COUNT; i++) {
+    poConf->aoAlerts[i].eUnit = AlertUnit_Percent;
+    poConf->aoAlerts[i].iHysteresis = 5;
+    poConf->aoAlerts[i].eAction = AlertAction_Notify;
+    poConf->aoAlerts[i].acCommand = g_strdup("");
+  }
+  poConf->acReplayFile = g_strdup("");
+
+  estimator_reset(&(poPlugin->oEstimator));
+  stats_reset(&(poPlugin->oStats));
+
+  /* Nothing has been rendered yet, make the first update apply everything */
+  poPlugin->oView.iIcon = -1;
+  poPlugin->oView.iColour = -1;
+  poPlugin->oDetails.lFullDesign = poPlugin->oDetails.lVoltage = -1;
+  poPlugin->oDetails.iCycles = -1;
+
   // PangoFontDescription needs a font and we can't use "(Default)" anymore.
   // Use GtkSettings to get the current default font and use that, or set
   // default to "Sans 10"
@@ -361,6 +917,15 @@ static battmon_t *battmon_create_control(XfcePanelPlugin *plugin)
   gtk_widget_show(poMonitor->wEventBox);
 
   xfce_panel_plugin_add_action_widget(plugin, poMonitor->wEventBox);
+  gtk_widget_set_has_tooltip(poMonitor->wEventBox, TRUE);
+  g_signal_connect(poMonitor->wEventBox, "query-tooltip",
+                   G_CALLBACK(OnQueryTooltip), poPlugin);
+  gtk_widget_add_events(poMonitor->wEventBox,
+                        GDK_BUTTON_PRESS_MASK | GDK_ENTER_NOTIFY_MASK);
+  g_signal_connect(poMonitor->wEventBox, "button-press-event",
+                   G_CALLBACK(OnButtonPress), poPlugin);
+  g_signal_connect(poMonitor->wEventBox, "enter-notify-event",
+                   G_CALLBACK(OnEnter), poPlugin);
 
   poMonitor->wBox = gtk_box_new(orientation, 0);
 #if GTK_CHECK_VERSION(3, 16, 0)
@@ -389,94 +954,23 @@ static battmon_t *battmon_create_control(XfcePanelPlugin *plugin)
 #endif
   gtk_box_pack_start(GTK_BOX(poMonitor->wImgBox), GTK_WIDGET(poMonitor->wImage),
                      TRUE, FALSE, 0);
+  poMonitor->poIcons = iconcache_new(apcIconNames, BattIcon_Max, ICON_SIZE,
+                                     OnIconsChanged, poPlugin);
+  g_signal_connect(poMonitor->wImage, "notify::scale-factor",
+                   G_CALLBACK(OnImageScaleChanged), poMonitor);
 
   /* Add Value */
-  poMonitor->wValue = gtk_label_new("");
-#if GTK_CHECK_VERSION(3, 16, 0)
-  context = gtk_widget_get_style_context(poMonitor->wValue);
-  gtk_style_context_add_class(context, "battmon_value");
-#endif
-  gtk_widget_show(poMonitor->wValue);
-  gtk_box_pack_start(GTK_BOX(poMonitor->wImgBox), GTK_WIDGET(poMonitor->wValue),
-                     TRUE, FALSE, 0);
-
-/* make widget padding consistent */
-#if GTK_CHECK_VERSION(3, 16, 0)
-#if GTK_CHECK_VERSION(3, 20, 0)
-  css = g_strdup_printf("\
-            label { background-color: #0000FF; padding: 4px; } \
-            label#p0 { background-color: #FF0000; } \
-            label#p1 { background-color: #FF1A00; } \
-            label#p2 { background-color: #FF3500; } \
-            label#p3 { background-color: #FF5000; } \
-            label#p4 { background-color: #FF6B00; } \
-            label#p5 { background-color: #FF8600; } \
-            label#p6 { background-color: #FFA100; } \
-            label#p7 { background-color: #FFBB00; } \
-            label#p8 { background-color: #FFD600; } \
-            label#p9 { background-color: #FFF100; } \
-            label#p10 { background-color: #F1FF00; } \
-            label#p11 { background-color: #D6FF00; } \
-            label#p12 { background-color: #BBFF00; } \
-            label#p13 { background-color: #A1FF00; } \
-            label#p14 { background-color: #86FF00; } \
-            label#p15 { background-color: #6BFF00; } \
-            label#p16 { background-color: #50FF00; } \
-            label#p17 { background-color: #35FF00; } \
-            label#p18 { background-color: #1AFF00; } \
-            label#p19 { background-color: #00FF00; } \
-            label#p20 { background-color: #00FF00; } \
-            label#pblue { background-color: skyblue; } \
-            label#pgray { background-color: darkgray; } \
-            progressbar.horizontal trough { min-height: 6px; }\
-            progressbar.horizontal progress { min-height: 6px; }\
-            progressbar.vertical trough { min-width: 6px; }\
-            progressbar.vertical progress { min-width: 6px; }");
-#else
-  css = g_strdup_printf("\
-            label { background-color: #0000FF; padding: 4px; } \
-            label#p0 { background-color: #FF0000; } \
-            label#p1 { background-color: #FF1A00; } \
-            label#p2 { background-color: #FF3500; } \
-            label#p3 { background-color: #FF5000; } \
-            label#p4 { background-color: #FF6B00; } \
-            label#p5 { background-color: #FF8600; } \
-            label#p6 { background-color: #FFA100; } \
-            label#p7 { background-color: #FFBB00; } \
-            label#p8 { background-color: #FFD600; } \
-            label#p9 { background-color: #FFF100; } \
-            label#p10 { background-color: #F1FF00; } \
-            label#p11 { background-color: #D6FF00; } \
-            label#p12 { background-color: #BBFF00; } \
-            label#p13 { background-color: #A1FF00; } \
-            label#p14 { background-color: #86FF00; } \
-            label#p15 { background-color: #6BFF00; } \
-            label#p16 { background-color: #50FF00; } \
-            label#p17 { background-color: #35FF00; } \
-            label#p18 { background-color: #1AFF00; } \
-            label#p19 { background-color: #00FF00; } \
-            label#p20 { background-color: #00FF00; } \
-            label#pblue { background-color: skyblue; } \
-            label#pgray { background-color: darkgray; } \
-            .progressbar.horizontal trough { min-height: 6px; }\
-            .progressbar.horizontal progress { min-height: 6px; }\
-            .progressbar.vertical trough { min-width: 6px; }\
-            .progressbar.vertical progress { min-width: 6px; }");
-#endif
-
-  css_provider = gtk_css_provider_new();
-  gtk_css_provider_load_from_data(css_provider, css, strlen(css), NULL);
-  gtk_style_context_add_provider(GTK_STYLE_CONTEXT(gtk_widget_get_style_context(
-                                     GTK_WIDGET(poMonitor->wImage))),
-                                 GTK_STYLE_PROVIDER(css_provider),
-                                 GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
-  gtk_style_context_add_provider(GTK_STYLE_CONTEXT(gtk_widget_get_style_context(
-                                     GTK_WIDGET(poMonitor->wValue))),
-                                 GTK_STYLE_PROVIDER(css_provider),
-                                 GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
-
-  g_free(css);
-#endif
+  poMonitor->poValue = gauge_new();
+  /* Until the first sample is in */
+  gauge_set(poMonitor->poValue, "----", GAUGE_COLOUR_UNKNOWN, -1);
+  gtk_widget_show(gauge_get_widget(poMonitor->poValue));
+  gtk_box_pack_start(GTK_BOX(poMonitor->wImgBox),
+                     gauge_get_widget(poMonitor->poValue), TRUE, FALSE, 0);
+
+  /* Add Graph, shown once the configuration has been read */
+  poMonitor->poGraph = sparkline_new(orientation);
+  gtk_box_pack_start(GTK_BOX(poMonitor->wImgBox),
+                     sparkline_get_widget(poMonitor->poGraph), TRUE, FALSE, 0);
 
   g_free(default_font);
 
@@ -487,12 +981,46 @@ static battmon_t *battmon_create_control(XfcePanelPlugin *plugin)
 static void battmon_free(XfcePanelPlugin *plugin, battmon_t *poPlugin)
 /* Plugin API */
 {
+  int i;
+
   TRACE("battmon_free()\n");
 
+  /* We share the panel's process, nothing may call back into us once this
+     returns */
+  g_signal_handlers_disconnect_by_data(plugin, poPlugin);
+  g_signal_handlers_disconnect_by_data(poPlugin->oMonitor.wEventBox,
+                                       poPlugin);
+  if (poPlugin->oConf.wTopLevel) {
+    g_signal_handlers_disconnect_by_data(poPlugin->oConf.wTopLevel, poPlugin);
+    gtk_widget_destroy(poPlugin->oConf.wTopLevel);
+    xfce_panel_plugin_unblock_menu(plugin);
+  }
+
   if (poPlugin->iTimerId)
     g_source_remove(poPlugin->iTimerId);
+  if (poPlugin->iRefreshId)
+    g_source_remove(poPlugin->iRefreshId);
+  if (poPlugin->iStartId)
+    g_source_remove(poPlugin->iStartId);
+  uevent_monitor_free(poPlugin->poUevent);
+  session_monitor_free(poPlugin->poSession);
+  history_open_cancel(poPlugin->poHistoryOpen);
+  history_close(poPlugin->poHistory);
+  publish_close(poPlugin->poPublish);
+  busexport_close(poPlugin->poExport);
+  source_free(poPlugin->poSource);
+  for (i = 0; i < ALERT_COUNT; i++) {
+    alert_free(poPlugin->apoAlerts[i]);
+    g_free(poPlugin->oConf.oParam.aoAlerts[i].acCommand);
+  }
+  g_signal_handlers_disconnect_by_func(poPlugin->oMonitor.wImage,
+                                       OnImageScaleChanged,
+                                       &(poPlugin->oMonitor));
+  iconcache_free(poPlugin->oMonitor.poIcons);
 
   g_free(poPlugin->oConf.oParam.acFont);
+  g_free(poPlugin->oConf.oParam.acReplayFile);
+  g_free(poPlugin->acReplayFile);
   g_free(poPlugin);
 } /* battmon_free() */
 
@@ -502,63 +1030,70 @@ static int SetMonitorFont(void *p_pvPlugin) {
   struct monitor_t *poMonitor = &(poPlugin->oMonitor);
   struct param_t *poConf = &(poPlugin->oConf.oParam);
 
-#if GTK_CHECK_VERSION(3, 16, 0)
-  GtkCssProvider *css_provider;
-  gchar *css;
-#if GTK_CHECK_VERSION(3, 20, 0)
-  PangoFontDescription *font;
-  font = pango_font_description_from_string(poConf->acFont);
-  if (G_LIKELY(font)) {
-    css = g_strdup_printf(
-        "label { font-family: %s; font-size: %dpx; font-style: %s; "
-        "font-weight: %s }",
-        pango_font_description_get_family(font),
-        pango_font_description_get_size(font) / PANGO_SCALE,
-        (pango_font_description_get_style(font) == PANGO_STYLE_ITALIC ||
-         pango_font_description_get_style(font) == PANGO_STYLE_OBLIQUE)
-            ? "italic"
-            : "normal",
-        (pango_font_description_get_weight(font) >= PANGO_WEIGHT_BOLD)
-            ? "bold"
-            : "normal");
-    pango_font_description_free(font);
-  } else
-    css = g_strdup_printf("label { font: %s; }",
-#else
-  css = g_strdup_printf(".label { font: %s; }",
-#endif
-                          poConf->acFont);
-  /* Setup Gtk style */
-  DBG("css: %s", css);
-
-  css_provider = gtk_css_provider_new();
-  gtk_css_provider_load_from_data(css_provider, css, strlen(css), NULL);
-  gtk_style_context_add_provider(GTK_STYLE_CONTEXT(gtk_widget_get_style_context(
-                                     GTK_WIDGET(poMonitor->wValue))),
-                                 GTK_STYLE_PROVIDER(css_provider),
-                                 GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
-  g_free(css);
-#else
+  /* The gauge lays the text out itself, no stylesheet to reload and no
+     restyle of the panel. Unchanged fonts are ignored */
+  gauge_set_font(poMonitor->poValue, poConf->acFont);
 
-  PangoFontDescription *poFont;
-
-  if (!strcmp(poConf->acFont, "(default)")) /* Default font */
-    return (1);
-  poFont = pango_font_description_from_string(poConf->acFont);
-  if (!poFont)
-    return (-1);
+  return (0);
+} /* SetMonitorFont() */
 
-  gtk_widget_override_font(poMonitor->wValue, poFont);
-  gtk_widget_override_font(poMonitor->wValButton, poFont);
+      
+static int ReadChoice(XfceRc *rc, const char *key, const char *const *names,
+                      int count, int def) {
+  const char *pc = xfce_rc_read_entry(rc, key, NULL);
+  int i;
+
+  for (i = 0; pc && i < count; i++)
+    if (strcmp(pc, names[i]) == 0)
+      return i;
+  return def;
+}
 
-  pango_font_description_free(poFont);
+static void ReadAlert(XfceRc *rc, const char *prefix, alertconf_t *poAlert)
+/* Keys are e.g. LowAlert, LowAlertUnit, LowAlertValue */
+{
+  char key[64];
+  const char *pc;
 
-#endif
+  snprintf(key, sizeof(key), "%sAlert", prefix);
+  poAlert->bEnabled = xfce_rc_read_bool_entry(rc, key, poAlert->bEnabled);
+  snprintf(key, sizeof(key), "%sAlertUnit", prefix);
+  poAlert->eUnit = ReadChoice(rc, key, apcAlertUnits, AlertUnit_Max,
+                              poAlert->eUnit);
+  snprintf(key, sizeof(key), "%sAlertValue", prefix);
+  poAlert->iValue =
+      CLAMP(xfce_rc_read_int_entry(rc, key, poAlert->iValue), 0, 100);
+  snprintf(key, sizeof(key), "%sAlertHysteresis", prefix);
+  poAlert->iHysteresis =
+      MAX(xfce_rc_read_int_entry(rc, key, poAlert->iHysteresis), 0);
+  snprintf(key, sizeof(key), "%sAlertAction", prefix);
+  poAlert->eAction = ReadChoice(rc, key, apcAlertActions, AlertAction_Max,
+                                poAlert->eAction);
+  snprintf(key, sizeof(key), "%sAlertCommand", prefix);
+  if ((pc = xfce_rc_read_entry(rc, key, NULL))) {
+    g_free(poAlert->acCommand);
+    poAlert->acCommand = g_strdup(pc);
+  }
+}
 
-  return (0);
-} /* SetMonitorFont() */
+static void WriteAlert(XfceRc *rc, const char *prefix,
+                       const alertconf_t *poAlert) {
+  char key[64];
+
+  snprintf(key, sizeof(key), "%sAlert", prefix);
+  xfce_rc_write_bool_entry(rc, key, poAlert->bEnabled);
+  snprintf(key, sizeof(key), "%sAlertUnit", prefix);
+  xfce_rc_write_entry(rc, key, apcAlertUnits[poAlert->eUnit]);
+  snprintf(key, sizeof(key), "%sAlertValue", prefix);
+  xfce_rc_write_int_entry(rc, key, poAlert->iValue);
+  snprintf(key, sizeof(key), "%sAlertHysteresis", prefix);
+  xfce_rc_write_int_entry(rc, key, poAlert->iHysteresis);
+  snprintf(key, sizeof(key), "%sAlertAction", prefix);
+  xfce_rc_write_entry(rc, key, apcAlertActions[poAlert->eAction]);
+  snprintf(key, sizeof(key), "%sAlertCommand", prefix);
+  xfce_rc_write_entry(rc, key, poAlert->acCommand);
+}
 
-      
 static void battmon_read_config(XfcePanelPlugin *plugin, battmon_t *poPlugin)
 /* Plugin API */
 /* Executed when the panel is started - Read the configuration
@@ -569,6 +1104,7 @@ static void battmon_read_config(XfcePanelPlugin *plugin, battmon_t *poPlugin)
   const char *pc;
   char *file;
   XfceRc *rc;
+  int i;
 
   if (!(file = xfce_panel_plugin_lookup_rc_file(plugin)))
     return;
@@ -580,6 +1116,20 @@ static void battmon_read_config(XfcePanelPlugin *plugin, battmon_t *poPlugin)
     return;
 
   poConf->iPeriod_ms = xfce_rc_read_int_entry(rc, "UpdatePeriod", 30 * 1000);
+  poConf->iHistoryDays = CLAMP(
+      xfce_rc_read_int_entry(rc, "HistoryDays", HISTORY_DEFAULT_DAYS), 0,
+      HISTORY_MAX_DAYS);
+  poConf->bShowGraph = xfce_rc_read_bool_entry(rc, "ShowGraph", FALSE);
+  poConf->bPublish = xfce_rc_read_bool_entry(rc, "Publish", FALSE);
+  poConf->bExport = xfce_rc_read_bool_entry(rc, "Export", FALSE);
+  poConf->eSource = ReadChoice(rc, "Source", apcSources, SourceType_Max,
+                               SourceType_Sysfs);
+  if ((pc = xfce_rc_read_entry(rc, "ReplayFile", NULL))) {
+    g_free(poConf->acReplayFile);
+    poConf->acReplayFile = g_strdup(pc);
+  }
+  for (i = 0; i < ALERT_COUNT; i++)
+    ReadAlert(rc, apcAlertKeys[i], &(poConf->aoAlerts[i]));
 
   if ((pc = xfce_rc_read_entry(rc, "Font", NULL))) {
     g_free(poConf->acFont);
@@ -594,6 +1144,7 @@ static void battmon_write_config(XfcePanelPlugin *plugin, battmon_t *poPlugin) {
   struct param_t *poConf = &(poPlugin->oConf.oParam);
   XfceRc *rc;
   char *file;
+  int i;
 
   if (!(file = xfce_panel_plugin_save_location(plugin, TRUE)))
     return;
@@ -607,6 +1158,14 @@ static void battmon_write_config(XfcePanelPlugin *plugin, battmon_t *poPlugin) {
   TRACE("battmon_write_config()\n");
 
   xfce_rc_write_int_entry(rc, "Update Period", poConf->iPeriod_ms);
+  xfce_rc_write_int_entry(rc, "HistoryDays", poConf->iHistoryDays);
+  xfce_rc_write_bool_entry(rc, "ShowGraph", poConf->bShowGraph);
+  xfce_rc_write_bool_entry(rc, "Publish", poConf->bPublish);
+  xfce_rc_write_bool_entry(rc, "Export", poConf->bExport);
+  xfce_rc_write_entry(rc, "Source", apcSources[poConf->eSource]);
+  xfce_rc_write_entry(rc, "ReplayFile", poConf->acReplayFile);
+  for (i = 0; i < ALERT_COUNT; i++)
+    WriteAlert(rc, apcAlertKeys[i], &(poConf->aoAlerts[i]));
 
   xfce_rc_write_entry(rc, "Font", poConf->acFont);
 
@@ -623,19 +1182,164 @@ static void SetPeriod(GtkWidget *p_wSc, void *p_pvPlugin) {
   poConf->iPeriod_ms = (r * 1000);
 }
 
+static void SetHistoryDays(GtkWidget *p_wSc, void *p_pvPlugin) {
+  struct battmon_t *poPlugin = (battmon_t *)p_pvPlugin;
+  struct param_t *poConf = &(poPlugin->oConf.oParam);
+
+  TRACE("SetHistoryDays()\n");
+  poConf->iHistoryDays =
+      gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(p_wSc));
+}
+
+static void SetShowGraph(GtkWidget *p_wTB, void *p_pvPlugin) {
+  struct battmon_t *poPlugin = (battmon_t *)p_pvPlugin;
+  struct param_t *poConf = &(poPlugin->oConf.oParam);
+
+  TRACE("SetShowGraph()\n");
+  poConf->bShowGraph =
+      gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(p_wTB));
+  gtk_widget_set_visible(sparkline_get_widget(poPlugin->oMonitor.poGraph),
+                         poConf->bShowGraph);
+}
+
+static void SetPublish(GtkWidget *p_wTB, void *p_pvPlugin) {
+  struct battmon_t *poPlugin = (battmon_t *)p_pvPlugin;
+  struct param_t *poConf = &(poPlugin->oConf.oParam);
+
+  TRACE("SetPublish()\n");
+  poConf->bPublish = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(p_wTB));
+  publish_close(poPlugin->poPublish);
+  poPlugin->poPublish = NULL;
+  if (poConf->bPublish) {
+    poPlugin->poPublish = publish_open(BATTERY_NAME);
+    DisplayBatteryLevel(poPlugin, 0);
+  }
+}
+
+static void SetExport(GtkWidget *p_wTB, void *p_pvPlugin) {
+  struct battmon_t *poPlugin = (battmon_t *)p_pvPlugin;
+  struct param_t *poConf = &(poPlugin->oConf.oParam);
+
+  TRACE("SetExport()\n");
+  poConf->bExport = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(p_wTB));
+  busexport_close(poPlugin->poExport);
+  poPlugin->poExport = NULL;
+  if (poConf->bExport) {
+    poPlugin->poExport = busexport_open(BATTERY_NAME);
+    DisplayBatteryLevel(poPlugin, 0);
+  }
+}
+
+static void SetSource(GtkWidget *p_w, void *p_pvPlugin)
+/* The combo box or the file chooser, the source is reopened when the
+   dialog is closed */
+{
+  struct battmon_t *poPlugin = (battmon_t *)p_pvPlugin;
+  struct gui_t *poGUI = &(poPlugin->oConf.oGUI);
+  struct param_t *poConf = &(poPlugin->oConf.oParam);
+  char *file;
+
+  TRACE("SetSource()\n");
+  poConf->eSource =
+      gtk_combo_box_get_active(GTK_COMBO_BOX(poGUI->wCB_Source));
+  file = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(poGUI->wFC_Replay));
+  g_free(poConf->acReplayFile);
+  poConf->acReplayFile = g_strdup(file ? file : "");
+  g_free(file);
+  gtk_widget_set_sensitive(poGUI->wFC_Replay,
+                           poConf->eSource == SourceType_Replay);
+}
+
+static void SetAlert(GtkWidget *p_w, void *p_pvPlugin)
+/* Any of the widgets of one alert, they carry its index */
+{
+  struct battmon_t *poPlugin = (battmon_t *)p_pvPlugin;
+  struct gui_t *poGUI = &(poPlugin->oConf.oGUI);
+  int i = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(p_w), "alert"));
+  alertconf_t *poAlert = &(poPlugin->oConf.oParam.aoAlerts[i]);
+
+  TRACE("SetAlert()\n");
+  poAlert->bEnabled =
+      gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(poGUI->awTB_Alert[i]));
+  poAlert->iValue =
+      gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(poGUI->awSc_Alert[i]));
+  poAlert->eUnit =
+      gtk_combo_box_get_active(GTK_COMBO_BOX(poGUI->awCB_AlertUnit[i]));
+  poAlert->eAction =
+      gtk_combo_box_get_active(GTK_COMBO_BOX(poGUI->awCB_AlertAction[i]));
+  g_free(poAlert->acCommand);
+  poAlert->acCommand =
+      g_strdup(gtk_entry_get_text(GTK_ENTRY(poGUI->awEn_AlertCommand[i])));
+  gtk_widget_set_sensitive(poGUI->awEn_AlertCommand[i],
+                           poAlert->eAction == AlertAction_Command);
+}
+
+static void OpenHistory(struct battmon_t *poPlugin);
+
+static void OnHistoryOpened(history_t *poHist, void *p_pvPlugin) {
+  struct battmon_t *poPlugin = (battmon_t *)p_pvPlugin;
+
+  poPlugin->poHistoryOpen = NULL;
+  poPlugin->poHistory = poHist;
+  /* Changed again while this one was opened */
+  if (poPlugin->oConf.oParam.iHistoryDays != poPlugin->iHistoryDays)
+    OpenHistory(poPlugin);
+  else
+    SeedGraph(poPlugin);
+}
+
+static void OpenHistory(struct battmon_t *poPlugin)
+/* The history lives next to the rc file, e.g. appletbatt-12.history. It
+   is opened by a worker, samples that come in meanwhile are not kept */
+{
+  struct param_t *poConf = &(poPlugin->oConf.oParam);
+  char *file, *path;
+
+  /* Same file, the open in flight starts this one once it is done */
+  if (poPlugin->poHistoryOpen)
+    return;
+
+  history_close(poPlugin->poHistory);
+  poPlugin->poHistory = NULL;
+  poPlugin->iHistoryDays = poConf->iHistoryDays;
+
+  if (poConf->iHistoryDays == 0)
+    return;
+  if (!(file = xfce_panel_plugin_save_location(poPlugin->plugin, TRUE)))
+    return;
+
+  if (g_str_has_suffix(file, ".rc"))
+    file[strlen(file) - 3] = '\0';
+  path = g_strconcat(file, ".history", NULL);
+  poPlugin->poHistoryOpen = history_open_async(path, poConf->iHistoryDays,
+                                               OnHistoryOpened, poPlugin);
+  g_free(path);
+  g_free(file);
+}
+
 static void UpdateConf(void *p_pvPlugin) {
   struct battmon_t *poPlugin = (battmon_t *)p_pvPlugin;
   struct conf_t *poConf = &(poPlugin->oConf);
   struct gui_t *poGUI = &(poConf->oGUI);
+  int i;
 
   TRACE("UpdateConf()\n");
   SetMonitorFont(poPlugin);
+  for (i = 0; i < ALERT_COUNT; i++)
+    alert_configure(poPlugin->apoAlerts[i], &(poConf->oParam.aoAlerts[i]));
+  if (poPlugin->oConf.oParam.iHistoryDays != poPlugin->iHistoryDays)
+    OpenHistory(poPlugin);
+  if (poConf->oParam.eSource != poPlugin->eSource ||
+      (poConf->oParam.eSource == SourceType_Replay &&
+       strcmp(poConf->oParam.acReplayFile, poPlugin->acReplayFile) != 0))
+    OpenSource(poPlugin);
   /* Restart timer */
   if (poPlugin->iTimerId) {
     g_source_remove(poPlugin->iTimerId);
     poPlugin->iTimerId = 0;
   }
-  SetTimer(p_pvPlugin);
+  if (session_monitor_is_active(poPlugin->poSession))
+    SetTimer(p_pvPlugin);
 }
  
 
@@ -690,19 +1394,33 @@ static void ChooseFont(GtkWidget *p_wPB, void *p_pvPlugin) {
 static void battmon_dialog_response(GtkWidget *dlg, int response,
                                     battmon_t *battmon) {
   UpdateConf(battmon);
+  battmon->oConf.wTopLevel = NULL;
   gtk_widget_destroy(dlg);
   xfce_panel_plugin_unblock_menu(battmon->plugin);
   battmon_write_config(battmon->plugin, battmon);
-  DisplayBatteryLevel(battmon);
+  DisplayBatteryLevel(battmon, 0);
 }
 
  
 static int battmon_CreateConfigGUI(GtkWidget *vbox1, struct gui_t *p_poGUI) {
+  int i, j;
   GtkWidget *table1;
   GtkWidget *eventbox1;
   GtkAdjustment *wSc_Period_adj;
   GtkWidget *wSc_Period;
   GtkWidget *label2;
+  GtkAdjustment *wSc_History_adj;
+  GtkWidget *wSc_History;
+  GtkWidget *label3;
+  GtkWidget *wTB_Graph;
+  GtkWidget *wTB_Publish;
+  GtkWidget *wTB_Export;
+  GtkWidget *label4;
+  GtkWidget *hbox6;
+  GtkWidget *wCB_Source;
+  GtkWidget *wFC_Replay;
+  GtkWidget *hbox5;
+  GtkAdjustment *wSc_Alert_adj;
   GtkWidget *hseparator10;
   GtkWidget *wPB_Font;
   GtkWidget *hbox4;
@@ -713,6 +1431,36 @@ static int battmon_CreateConfigGUI(GtkWidget *vbox1, struct gui_t *p_poGUI) {
   gtk_widget_show(table1);
   gtk_box_pack_start(GTK_BOX(vbox1), table1, FALSE, TRUE, 0);
 
+  label4 = gtk_label_new(_("Data source "));
+  gtk_widget_show(label4);
+  gtk_grid_attach(GTK_GRID(table1), label4, 0, 1, 1, 1);
+  gtk_label_set_justify(GTK_LABEL(label4), GTK_JUSTIFY_LEFT);
+  gtk_widget_set_valign(label4, GTK_ALIGN_CENTER);
+
+  hbox6 = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 2);
+  gtk_widget_show(hbox6);
+  gtk_grid_attach(GTK_GRID(table1), hbox6, 1, 1, 1, 1);
+
+  /* In sourcetype_t order */
+  wCB_Source = gtk_combo_box_text_new();
+  gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(wCB_Source),
+                                 _("Kernel (sysfs)"));
+  gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(wCB_Source), _("UPower"));
+  gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(wCB_Source), _("Replay"));
+  gtk_widget_show(wCB_Source);
+  gtk_box_pack_start(GTK_BOX(hbox6), wCB_Source, FALSE, FALSE, 0);
+  gtk_widget_set_tooltip_text(wCB_Source,
+                              "Read the battery directly, follow the UPower "
+                              "daemon, or play samples back for testing");
+
+  wFC_Replay = gtk_file_chooser_button_new(_("Samples to replay"),
+                                           GTK_FILE_CHOOSER_ACTION_OPEN);
+  gtk_widget_show(wFC_Replay);
+  gtk_box_pack_start(GTK_BOX(hbox6), wFC_Replay, TRUE, TRUE, 0);
+  gtk_widget_set_tooltip_text(wFC_Replay,
+                              "One sample per line: seconds status percent "
+                              "now full rate. None for a made up battery");
+
   eventbox1 = gtk_event_box_new();
   gtk_widget_show(eventbox1);
   gtk_grid_attach(GTK_GRID(table1), eventbox1, 1, 2, 1, 1);
@@ -721,12 +1469,13 @@ static int battmon_CreateConfigGUI(GtkWidget *vbox1, struct gui_t *p_poGUI) {
   gtk_widget_set_vexpand(GTK_WIDGET(eventbox1), TRUE);
   gtk_widget_set_hexpand(GTK_WIDGET(eventbox1), TRUE);
 
-  wSc_Period_adj = gtk_adjustment_new(15, .25, 60 * 60 * 24, .25, 1, 0);
-  wSc_Period = gtk_spin_button_new(GTK_ADJUSTMENT(wSc_Period_adj), .25, 2);
+  /* The timer has second granularity */
+  wSc_Period_adj = gtk_adjustment_new(30, 1, 60 * 60 * 24, 1, 10, 0);
+  wSc_Period = gtk_spin_button_new(GTK_ADJUSTMENT(wSc_Period_adj), 1, 0);
   gtk_widget_show(wSc_Period);
   gtk_container_add(GTK_CONTAINER(eventbox1), wSc_Period);
   gtk_widget_set_tooltip_text(wSc_Period,
-                              "Interval between 2 consecutive spawns");
+                              "Interval between 2 updates while discharging");
   gtk_spin_button_set_numeric(GTK_SPIN_BUTTON(wSc_Period), TRUE);
 
   label2 = gtk_label_new(_("Period (s) "));
@@ -735,6 +1484,91 @@ static int battmon_CreateConfigGUI(GtkWidget *vbox1, struct gui_t *p_poGUI) {
   gtk_label_set_justify(GTK_LABEL(label2), GTK_JUSTIFY_LEFT);
   gtk_widget_set_valign(label2, GTK_ALIGN_CENTER);
 
+  wSc_History_adj = gtk_adjustment_new(HISTORY_DEFAULT_DAYS, 0,
+                                       HISTORY_MAX_DAYS, 1, 7, 0);
+  wSc_History = gtk_spin_button_new(GTK_ADJUSTMENT(wSc_History_adj), 1, 0);
+  gtk_widget_show(wSc_History);
+  gtk_grid_attach(GTK_GRID(table1), wSc_History, 1, 3, 1, 1);
+  gtk_widget_set_halign(GTK_WIDGET(wSc_History), GTK_ALIGN_CENTER);
+  gtk_widget_set_tooltip_text(wSc_History,
+                              "Days of battery history to keep, 0 for none");
+  gtk_spin_button_set_numeric(GTK_SPIN_BUTTON(wSc_History), TRUE);
+
+  label3 = gtk_label_new(_("History (days) "));
+  gtk_widget_show(label3);
+  gtk_grid_attach(GTK_GRID(table1), label3, 0, 3, 1, 1);
+  gtk_label_set_justify(GTK_LABEL(label3), GTK_JUSTIFY_LEFT);
+  gtk_widget_set_valign(label3, GTK_ALIGN_CENTER);
+
+  wTB_Graph = gtk_check_button_new_with_label(_("Show the last hour"));
+  gtk_widget_show(wTB_Graph);
+  gtk_grid_attach(GTK_GRID(table1), wTB_Graph, 0, 4, 2, 1);
+  gtk_widget_set_tooltip_text(wTB_Graph,
+                              "Graph of the charge and power draw per minute");
+
+  wTB_Publish = gtk_check_button_new_with_label(_("Share with other programs"));
+  gtk_widget_show(wTB_Publish);
+  gtk_grid_attach(GTK_GRID(table1), wTB_Publish, 0, 5, 2, 1);
+  gtk_widget_set_tooltip_text(wTB_Publish,
+                              "Publish the battery state in /dev/shm, see "
+                              "battmon-state");
+
+  wTB_Export = gtk_check_button_new_with_label(_("Export on the session bus"));
+  gtk_widget_show(wTB_Export);
+  gtk_grid_attach(GTK_GRID(table1), wTB_Export, 0, 6, 2, 1);
+  gtk_widget_set_tooltip_text(wTB_Export,
+                              "Own org.xfce.Battmon.BAT0 and signal every "
+                              "change of its properties");
+
+  for (i = 0; i < ALERT_COUNT; i++) {
+    p_poGUI->awTB_Alert[i] = gtk_check_button_new_with_label(apcAlertNames[i]);
+    gtk_widget_show(p_poGUI->awTB_Alert[i]);
+    gtk_grid_attach(GTK_GRID(table1), p_poGUI->awTB_Alert[i], 0, 7 + i, 1, 1);
+    gtk_widget_set_tooltip_text(p_poGUI->awTB_Alert[i],
+                                "Act when the battery runs down to this "
+                                "level, again once it was charged a bit");
+
+    hbox5 = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 2);
+    gtk_widget_show(hbox5);
+    gtk_grid_attach(GTK_GRID(table1), hbox5, 1, 7 + i, 1, 1);
+
+    wSc_Alert_adj = gtk_adjustment_new(10, 0, 100, 1, 5, 0);
+    p_poGUI->awSc_Alert[i] =
+        gtk_spin_button_new(GTK_ADJUSTMENT(wSc_Alert_adj), 1, 0);
+    gtk_widget_show(p_poGUI->awSc_Alert[i]);
+    gtk_spin_button_set_numeric(GTK_SPIN_BUTTON(p_poGUI->awSc_Alert[i]),
+                                TRUE);
+    gtk_box_pack_start(GTK_BOX(hbox5), p_poGUI->awSc_Alert[i], FALSE, FALSE,
+                       0);
+
+    p_poGUI->awCB_AlertUnit[i] = gtk_combo_box_text_new();
+    gtk_combo_box_text_append_text(
+        GTK_COMBO_BOX_TEXT(p_poGUI->awCB_AlertUnit[i]), _("% left"));
+    gtk_combo_box_text_append_text(
+        GTK_COMBO_BOX_TEXT(p_poGUI->awCB_AlertUnit[i]), _("min left"));
+    gtk_widget_show(p_poGUI->awCB_AlertUnit[i]);
+    gtk_box_pack_start(GTK_BOX(hbox5), p_poGUI->awCB_AlertUnit[i], FALSE,
+                       FALSE, 0);
+
+    p_poGUI->awCB_AlertAction[i] = gtk_combo_box_text_new();
+    for (j = 0; j < AlertAction_Max; j++)
+      gtk_combo_box_text_append_text(
+          GTK_COMBO_BOX_TEXT(p_poGUI->awCB_AlertAction[i]),
+          j == AlertAction_Notify    ? _("Notify")
+          : j == AlertAction_Command ? _("Run")
+                                     : _("Suspend"));
+    gtk_widget_show(p_poGUI->awCB_AlertAction[i]);
+    gtk_box_pack_start(GTK_BOX(hbox5), p_poGUI->awCB_AlertAction[i], FALSE,
+                       FALSE, 0);
+
+    p_poGUI->awEn_AlertCommand[i] = gtk_entry_new();
+    gtk_widget_show(p_poGUI->awEn_AlertCommand[i]);
+    gtk_widget_set_tooltip_text(p_poGUI->awEn_AlertCommand[i],
+                                "Command to run, it is not waited for");
+    gtk_box_pack_start(GTK_BOX(hbox5), p_poGUI->awEn_AlertCommand[i], TRUE,
+                       TRUE, 0);
+  }
+
   hseparator10 = gtk_separator_new(GTK_ORIENTATION_HORIZONTAL);
   gtk_widget_show(hseparator10);
   gtk_box_pack_start(GTK_BOX(vbox1), hseparator10, FALSE, FALSE, 0);
@@ -749,6 +1583,12 @@ static int battmon_CreateConfigGUI(GtkWidget *vbox1, struct gui_t *p_poGUI) {
   gtk_container_add(GTK_CONTAINER(vbox1), hbox4);
 
   p_poGUI->wSc_Period = wSc_Period;
+  p_poGUI->wSc_History = wSc_History;
+  p_poGUI->wTB_Graph = wTB_Graph;
+  p_poGUI->wTB_Publish = wTB_Publish;
+  p_poGUI->wTB_Export = wTB_Export;
+  p_poGUI->wCB_Source = wCB_Source;
+  p_poGUI->wFC_Replay = wFC_Replay;
   p_poGUI->wPB_Font = wPB_Font;
 
   return 0;
@@ -760,6 +1600,7 @@ static void battmon_create_options(XfcePanelPlugin *plugin,
   GtkWidget *dlg, *vbox;
   struct param_t *poConf = &(poPlugin->oConf.oParam);
   struct gui_t *poGUI = &(poPlugin->oConf.oGUI);
+  int i;
 
   TRACE("battmon_create_options()\n");
 
@@ -788,6 +1629,75 @@ static void battmon_create_options(XfcePanelPlugin *plugin,
   g_signal_connect(GTK_WIDGET(poGUI->wSc_Period), "value_changed",
                    G_CALLBACK(SetPeriod), poPlugin);
 
+  gtk_spin_button_set_value(GTK_SPIN_BUTTON(poGUI->wSc_History),
+                            poConf->iHistoryDays);
+  g_signal_connect(GTK_WIDGET(poGUI->wSc_History), "value_changed",
+                   G_CALLBACK(SetHistoryDays), poPlugin);
+
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(poGUI->wTB_Graph),
+                               poConf->bShowGraph);
+  g_signal_connect(GTK_WIDGET(poGUI->wTB_Graph), "toggled",
+                   G_CALLBACK(SetShowGraph), poPlugin);
+
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(poGUI->wTB_Publish),
+                               poConf->bPublish);
+  g_signal_connect(GTK_WIDGET(poGUI->wTB_Publish), "toggled",
+                   G_CALLBACK(SetPublish), poPlugin);
+
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(poGUI->wTB_Export),
+                               poConf->bExport);
+  g_signal_connect(GTK_WIDGET(poGUI->wTB_Export), "toggled",
+                   G_CALLBACK(SetExport), poPlugin);
+
+  gtk_combo_box_set_active(GTK_COMBO_BOX(poGUI->wCB_Source), poConf->eSource);
+  if (*poConf->acReplayFile)
+    gtk_file_chooser_set_filename(GTK_FILE_CHOOSER(poGUI->wFC_Replay),
+                                  poConf->acReplayFile);
+  gtk_widget_set_sensitive(poGUI->wFC_Replay,
+                           poConf->eSource == SourceType_Replay);
+  g_signal_connect(GTK_WIDGET(poGUI->wCB_Source), "changed",
+                   G_CALLBACK(SetSource), poPlugin);
+  g_signal_connect(GTK_WIDGET(poGUI->wFC_Replay), "file-set",
+                   G_CALLBACK(SetSource), poPlugin);
+
+  for (i = 0; i < ALERT_COUNT; i++) {
+    alertconf_t *poAlert = &(poConf->aoAlerts[i]);
+
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(poGUI->awTB_Alert[i]),
+                                 poAlert->bEnabled);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(poGUI->awSc_Alert[i]),
+                              poAlert->iValue);
+    gtk_combo_box_set_active(GTK_COMBO_BOX(poGUI->awCB_AlertUnit[i]),
+                             poAlert->eUnit);
+    gtk_combo_box_set_active(GTK_COMBO_BOX(poGUI->awCB_AlertAction[i]),
+                             poAlert->eAction);
+    gtk_entry_set_text(GTK_ENTRY(poGUI->awEn_AlertCommand[i]),
+                       poAlert->acCommand);
+    gtk_widget_set_sensitive(poGUI->awEn_AlertCommand[i],
+                             poAlert->eAction == AlertAction_Command);
+
+    g_object_set_data(G_OBJECT(poGUI->awTB_Alert[i]), "alert",
+                      GINT_TO_POINTER(i));
+    g_object_set_data(G_OBJECT(poGUI->awSc_Alert[i]), "alert",
+                      GINT_TO_POINTER(i));
+    g_object_set_data(G_OBJECT(poGUI->awCB_AlertUnit[i]), "alert",
+                      GINT_TO_POINTER(i));
+    g_object_set_data(G_OBJECT(poGUI->awCB_AlertAction[i]), "alert",
+                      GINT_TO_POINTER(i));
+    g_object_set_data(G_OBJECT(poGUI->awEn_AlertCommand[i]), "alert",
+                      GINT_TO_POINTER(i));
+    g_signal_connect(GTK_WIDGET(poGUI->awTB_Alert[i]), "toggled",
+                     G_CALLBACK(SetAlert), poPlugin);
+    g_signal_connect(GTK_WIDGET(poGUI->awSc_Alert[i]), "value_changed",
+                     G_CALLBACK(SetAlert), poPlugin);
+    g_signal_connect(GTK_WIDGET(poGUI->awCB_AlertUnit[i]), "changed",
+                     G_CALLBACK(SetAlert), poPlugin);
+    g_signal_connect(GTK_WIDGET(poGUI->awCB_AlertAction[i]), "changed",
+                     G_CALLBACK(SetAlert), poPlugin);
+    g_signal_connect(GTK_WIDGET(poGUI->awEn_AlertCommand[i]), "changed",
+                     G_CALLBACK(SetAlert), poPlugin);
+  }
+
   if (strcmp(poConf->acFont, "(default)"))
     gtk_button_set_label(GTK_BUTTON(poGUI->wPB_Font), poConf->acFont);
   g_signal_connect(G_OBJECT(poGUI->wPB_Font), "clicked", G_CALLBACK(ChooseFont),
@@ -806,6 +1716,7 @@ static void battmon_set_orientation(XfcePanelPlugin *plugin,
                                  p_iOrientation);
   gtk_orientable_set_orientation(GTK_ORIENTABLE(poMonitor->wImgBox),
                                  p_iOrientation);
+  sparkline_set_orientation(poMonitor->poGraph, p_iOrientation);
   SetMonitorFont(poPlugin);
 }
 
@@ -816,26 +1727,49 @@ static gboolean battmon_remote_event(XfcePanelPlugin *plugin, const gchar *name,
   if (strcmp(name, "refresh") == 0) {
     if (value != NULL && G_VALUE_HOLDS_BOOLEAN(value) &&
         g_value_get_boolean(value)) {
-      /* update the display */
-      DisplayBatteryLevel(battmon);
+      /* Scripts and udev rules tend to send these in bursts */
+      RequestRefresh(battmon, REFRESH_MAX_AGE_US);
     }
     return TRUE;
   }
+  if (strcmp(name, "stats") == 0) {
+    stats_log(&(battmon->oStats));
+    return TRUE;
+  }
   return FALSE;
 }
 
 
 static void battmon_construct(XfcePanelPlugin *plugin) {
   battmon_t *battmon;
+  int64_t iStart_ns = stats_begin(), iDuration_ns;
+  int i;
   
   battmon = battmon_create_control(plugin);
+  battmon->iConstruct_ns = iStart_ns;
 
   battmon_read_config(plugin, battmon);
+  OpenHistory(battmon);
+  if (battmon->oConf.oParam.bPublish)
+    battmon->poPublish = publish_open(BATTERY_NAME);
+  if (battmon->oConf.oParam.bExport)
+    battmon->poExport = busexport_open(BATTERY_NAME);
+  gtk_widget_set_visible(sparkline_get_widget(battmon->oMonitor.poGraph),
+                         battmon->oConf.oParam.bShowGraph);
 
   gtk_container_add(GTK_CONTAINER(plugin), battmon->oMonitor.wEventBox);
 
   SetMonitorFont(battmon);
-  SetTimer(battmon);
+
+  OpenSource(battmon);
+  for (i = 0; i < ALERT_COUNT; i++) {
+    battmon->apoAlerts[i] = alert_new(apcAlertNames[i], OnAlertDue, battmon);
+    alert_configure(battmon->apoAlerts[i],
+                    &(battmon->oConf.oParam.aoAlerts[i]));
+  }
+  battmon->poSession = session_monitor_new(OnSessionChanged, battmon);
+  /* Default idle priority, i.e. after GTK has drawn the panel */
+  battmon->iStartId = g_idle_add(OnStartIdle, battmon);
 
   g_signal_connect(plugin, "free-data", G_CALLBACK(battmon_free), battmon);
 
@@ -855,6 +1789,24 @@ static void battmon_construct(XfcePanelPlugin *plugin) {
   g_signal_connect(plugin, "remote-event", G_CALLBACK(battmon_remote_event),
                    battmon);
 
+  iDuration_ns = stats_begin() - iStart_ns;
+  stats_add(&(battmon->oStats), StatsTime_Startup, iDuration_ns);
+  DBG("constructed in %.1f ms", iDuration_ns / 1e6);
+  if (iDuration_ns > (int64_t)STARTUP_BUDGET_US * 1000)
+    g_message("Battmon: startup took %.1f ms, the budget is %d ms",
+              iDuration_ns / 1e6, STARTUP_BUDGET_US / 1000);
+
 }
 
 XFCE_PANEL_PLUGIN_REGISTER(battmon_construct)
+
+/* Workers of the sampler, the uevent monitor and the history open keep
+   going after battmon_free() until their read returns, then complete on
+   the main loop. The panel unloads an internal plugin once its last
+   instance is removed, so the code they run stays loaded for good */
+G_MODULE_EXPORT const gchar *g_module_check_init(GModule *module);
+
+G_MODULE_EXPORT const gchar *g_module_check_init(GModule *module) {
+  g_module_make_resident(module);
+  return NULL;
+}
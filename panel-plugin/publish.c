@@ -0,0 +1,128 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Publishing of the battery state in shared memory
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include <libxfce4util/libxfce4util.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "battshm.h"
+#include "publish.h"
+
+struct publish_t {
+  int iFd; /* Holds the lock that makes us the only writer */
+  char *acPath;
+  battshm_t *poShm;
+};
+
+publish_t *publish_open(const char *battery) {
+  publish_t *poPub;
+  void *pv;
+  int fd;
+  char *path;
+
+  path = g_strdup_printf("%s/%s%u-%s", BATTSHM_DIR, BATTSHM_PREFIX,
+                         (unsigned int)getuid(), battery);
+  fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC | O_NOFOLLOW, 0644);
+  if (fd < 0) {
+    g_warning("Battmon: cannot open %s: %s", path, g_strerror(errno));
+    g_free(path);
+    return NULL;
+  }
+
+  if (!battshm_is_trusted(fd)) {
+    g_warning("Battmon: %s is not ours, not publishing", path);
+    close(fd);
+    g_free(path);
+    return NULL;
+  }
+
+  /* A second writer would break the sequence numbers */
+  if (flock(fd, LOCK_EX | LOCK_NB) < 0) {
+    DBG("%s is published by somebody else", path);
+    close(fd);
+    g_free(path);
+    return NULL;
+  }
+
+  if (ftruncate(fd, sizeof(battshm_t)) < 0 ||
+      (pv = mmap(NULL, sizeof(battshm_t), PROT_READ | PROT_WRITE, MAP_SHARED,
+                 fd, 0)) == MAP_FAILED) {
+    g_warning("Battmon: cannot map %s: %s", path, g_strerror(errno));
+    close(fd);
+    g_free(path);
+    return NULL;
+  }
+
+  poPub = g_new0(publish_t, 1);
+  poPub->iFd = fd;
+  poPub->acPath = path;
+  poPub->poShm = (battshm_t *)pv;
+
+  /* Readers ignore the segment until the first update */
+  __atomic_store_n(&poPub->poShm->iSeq, 0, __ATOMIC_RELEASE);
+  poPub->poShm->iMagic = BATTSHM_MAGIC;
+  poPub->poShm->iVersion = BATTSHM_VERSION;
+  poPub->poShm->iSize = sizeof(battshm_t);
+  poPub->poShm->iPid = getpid();
+  return poPub;
+}
+
+void publish_close(publish_t *poPub) {
+  if (!poPub)
+    return;
+
+  /* Readers must not take the last values for current ones */
+  unlink(poPub->acPath);
+  munmap(poPub->poShm, sizeof(battshm_t));
+  close(poPub->iFd);
+  g_free(poPub->acPath);
+  g_free(poPub);
+}
+
+void publish_update(publish_t *poPub, const battsample_t *poSample,
+                    int minutes) {
+  battshm_t *poShm = poPub->poShm;
+  uint32_t iSeq = poShm->iSeq;
+
+  /* Seqlock: odd while writing, readers retry if it moved */
+  __atomic_store_n(&poShm->iSeq, iSeq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  poShm->iTime = g_get_real_time() / G_USEC_PER_SEC;
+  poShm->iNow = poSample->lNow;
+  poShm->iFull = poSample->lFull;
+  poShm->iRate = poSample->lRate;
+  poShm->iStatus = poSample->eStatus;
+  poShm->iPercent = poSample->iPercent;
+  poShm->iMinutes = minutes;
+
+  __atomic_store_n(&poShm->iSeq, iSeq + 2, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,37 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Publishing of the battery state in shared memory
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef BATTMON_PUBLISH_H
+#define BATTMON_PUBLISH_H
+
+#include "battery.h"
+
+typedef struct publish_t publish_t;
+
+/* Create or take over the segment of battery, see battshm.h. Returns NULL
+   if it cannot be mapped or another process publishes it already */
+publish_t *publish_open(const char *battery);
+void publish_close(publish_t *poPub);
+
+/* minutes is the estimate until empty or full, -1 if unknown */
+void publish_update(publish_t *poPub, const battsample_t *poSample,
+                    int minutes);
+
+#endif /* BATTMON_PUBLISH_H */
@@ -0,0 +1,217 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Replayed battery samples for testing
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include <libxfce4util/libxfce4util.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "replay.h"
+
+/* The made up battery, one sample a minute */
+#define REPLAY_FULL_UWH 50000000L
+#define REPLAY_DISCHARGE_MIN 180
+#define REPLAY_CHARGE_MIN 60
+#define REPLAY_EMPTY 5 /* Percent */
+
+typedef struct replayrec_t {
+  int iOffset_s;
+  battsample_t oSample;
+} replayrec_t;
+
+struct replay_t {
+  replayrec_t *aoRecs;
+  int iCount;
+  int iCur;
+  unsigned int iTimerId;
+  unsigned int iIdleId;
+  int bDetails;
+  SamplerFunc pfFunc;
+  void *pvData;
+};
+
+static battstatus_t ParseStatus(const char *word) {
+  if (strcmp(word, "None") == 0)
+    return BattStatus_NoBatt;
+  else if (strcmp(word, "Full") == 0)
+    return BattStatus_Full;
+  else if (strcmp(word, "Charging") == 0)
+    return BattStatus_Charging;
+  else if (strcmp(word, "Discharging") == 0)
+    return BattStatus_Discharging;
+  return BattStatus_Unknown;
+}
+
+static int Load(replay_t *poReplay, const char *path) {
+  GError *poError = NULL;
+  char *contents, **lines, status[32];
+  replayrec_t *poRec;
+  int i, n = 0;
+
+  if (!g_file_get_contents(path, &contents, NULL, &poError)) {
+    g_warning("Battmon: cannot replay %s: %s", path, poError->message);
+    g_error_free(poError);
+    return 0;
+  }
+
+  lines = g_strsplit(contents, "\n", -1);
+  g_free(contents);
+  poReplay->aoRecs = g_new0(replayrec_t, g_strv_length(lines));
+  for (i = 0; lines[i]; i++) {
+    if (lines[i][0] == '#' || lines[i][strspn(lines[i], " \t\r")] == '\0')
+      continue;
+    poRec = &(poReplay->aoRecs[n]);
+    if (sscanf(lines[i], "%d %31s %d %ld %ld %ld", &poRec->iOffset_s, status,
+               &poRec->oSample.iPercent, &poRec->oSample.lNow,
+               &poRec->oSample.lFull, &poRec->oSample.lRate) != 6) {
+      g_warning("Battmon: %s:%d: not a sample", path, i + 1);
+      continue;
+    }
+    poRec->oSample.eStatus = ParseStatus(status);
+    n++;
+  }
+  g_strfreev(lines);
+
+  poReplay->iCount = n;
+  return n > 0;
+}
+
+static void MakeUp(replay_t *poReplay) {
+  replayrec_t *poRec;
+  int i, iMin, percent;
+
+  poReplay->iCount = REPLAY_DISCHARGE_MIN + REPLAY_CHARGE_MIN;
+  g_free(poReplay->aoRecs);
+  poReplay->aoRecs = g_new0(replayrec_t, poReplay->iCount);
+  for (i = 0; i < poReplay->iCount; i++) {
+    poRec = &(poReplay->aoRecs[i]);
+    poRec->iOffset_s = i * 60;
+    if (i < REPLAY_DISCHARGE_MIN) {
+      iMin = i;
+      percent = 100 - (100 - REPLAY_EMPTY) * iMin / REPLAY_DISCHARGE_MIN;
+      poRec->oSample.eStatus = BattStatus_Discharging;
+      poRec->oSample.lRate = REPLAY_FULL_UWH / 100 * (100 - REPLAY_EMPTY) /
+                             (REPLAY_DISCHARGE_MIN / 60);
+    } else {
+      iMin = i - REPLAY_DISCHARGE_MIN;
+      percent = REPLAY_EMPTY + (100 - REPLAY_EMPTY) * iMin / REPLAY_CHARGE_MIN;
+      poRec->oSample.eStatus = BattStatus_Charging;
+      poRec->oSample.lRate = REPLAY_FULL_UWH / 100 * (100 - REPLAY_EMPTY) /
+                             (REPLAY_CHARGE_MIN / 60);
+    }
+    poRec->oSample.iPercent = percent;
+    poRec->oSample.lNow = REPLAY_FULL_UWH / 100 * percent;
+    poRec->oSample.lFull = REPLAY_FULL_UWH;
+  }
+}
+
+static void Deliver(replay_t *poReplay) {
+  samplerresult_t oResult;
+
+  memset(&oResult, 0, sizeof(oResult));
+  oResult.oSample = poReplay->aoRecs[poReplay->iCur].oSample;
+  oResult.iTime_us = g_get_monotonic_time();
+  if (poReplay->bDetails) {
+    /* Nothing recorded */
+    oResult.bDetails = 1;
+    oResult.oDetails.lFullDesign = oResult.oDetails.lVoltage = -1;
+    oResult.oDetails.iCycles = -1;
+    poReplay->bDetails = 0;
+  }
+  poReplay->pfFunc(&oResult, poReplay->pvData);
+}
+
+static gboolean OnNext(gpointer data);
+
+static void ArmNext(replay_t *poReplay) {
+  int iNext = (poReplay->iCur + 1) % poReplay->iCount;
+  int iDelay_s;
+
+  /* Back to the start as long after the end as the last two were apart */
+  if (iNext == 0)
+    iDelay_s = poReplay->iCount > 1
+                   ? poReplay->aoRecs[poReplay->iCur].iOffset_s -
+                         poReplay->aoRecs[poReplay->iCur - 1].iOffset_s
+                   : 60;
+  else
+    iDelay_s = poReplay->aoRecs[iNext].iOffset_s -
+               poReplay->aoRecs[poReplay->iCur].iOffset_s;
+  poReplay->iTimerId =
+      g_timeout_add_seconds(MAX(iDelay_s, 1), OnNext, poReplay);
+}
+
+static gboolean OnNext(gpointer data) {
+  replay_t *poReplay = (replay_t *)data;
+
+  poReplay->iCur = (poReplay->iCur + 1) % poReplay->iCount;
+  ArmNext(poReplay);
+  Deliver(poReplay);
+  return G_SOURCE_REMOVE;
+}
+
+replay_t *replay_new(const char *path, SamplerFunc func, void *data) {
+  replay_t *poReplay;
+
+  poReplay = g_new0(replay_t, 1);
+  poReplay->pfFunc = func;
+  poReplay->pvData = data;
+  if (!path || !*path || !Load(poReplay, path))
+    MakeUp(poReplay);
+  DBG("replaying %d samples", poReplay->iCount);
+
+  ArmNext(poReplay);
+  return poReplay;
+}
+
+void replay_free(replay_t *poReplay) {
+  if (!poReplay)
+    return;
+
+  if (poReplay->iTimerId)
+    g_source_remove(poReplay->iTimerId);
+  if (poReplay->iIdleId)
+    g_source_remove(poReplay->iIdleId);
+  g_free(poReplay->aoRecs);
+  g_free(poReplay);
+}
+
+static gboolean OnIdle(gpointer data) {
+  replay_t *poReplay = (replay_t *)data;
+
+  poReplay->iIdleId = 0;
+  Deliver(poReplay);
+  return G_SOURCE_REMOVE;
+}
+
+void replay_request(replay_t *poReplay) {
+  if (!poReplay->iIdleId)
+    poReplay->iIdleId = g_idle_add(OnIdle, poReplay);
+}
+
+void replay_request_details(replay_t *poReplay) {
+  poReplay->bDetails = 1;
+  replay_request(poReplay);
+}
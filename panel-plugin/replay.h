@@ -0,0 +1,45 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Replayed battery samples for testing
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef BATTMON_REPLAY_H
+#define BATTMON_REPLAY_H
+
+#include "sampler.h"
+
+/* A replay file has one sample per line, blank lines and lines starting
+   with # are skipped:
+
+     <seconds> <status> <percent> <now> <full> <rate>
+
+   seconds is when the sample is due relative to the first one, status one
+   of None, Full, Charging, Discharging or Unknown, and the rest as in
+   battsample_t (-1 if unknown). The samples are played back in real time
+   and over again. Without a file, a made up battery discharges from 100%
+   to 5% in three hours and charges again in one */
+typedef struct replay_t replay_t;
+
+replay_t *replay_new(const char *path, SamplerFunc func, void *data);
+void replay_free(replay_t *poReplay);
+
+/* Deliver the current sample again from an idle callback */
+void replay_request(replay_t *poReplay);
+void replay_request_details(replay_t *poReplay);
+
+#endif /* BATTMON_REPLAY_H */
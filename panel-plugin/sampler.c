@@ -0,0 +1,307 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Battery sampling on a worker thread
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gio/gio.h>
+
+#include <libxfce4util/libxfce4util.h>
+
+#include <time.h>
+
+#include "sampler.h"
+#include "sysfs.h"
+
+/* One per battery and process, shared by all instances watching it */
+typedef struct shared_t {
+  char *acKey; /* sysfs directory, key of poShared */
+  unsigned int iRefs;
+  /* Only used by the worker while bBusy is set, and by the main loop
+     otherwise. Either way by one thread at a time */
+  sysfs_t *poSysfs;
+  GSList *poSubs;   /* sampler_t */
+  int bBusy;
+  int bPending;     /* A subscriber asked again while busy */
+  unsigned int iCoalesced;
+  int bProbe;
+  int bProbeIfAbsent;
+  int bDetails;
+  int bBusyDetails; /* The sample in flight reads them */
+  int64_t iStarted_us;
+  int bHungMarked;  /* Already reported for the current sample */
+  int bFreed;       /* Free once the worker returns */
+  samplerresult_t oLast;
+} shared_t;
+
+/* A subscription, one per instance */
+struct sampler_t {
+  shared_t *poShared;
+  SamplerFunc pfFunc;
+  void *pvData;
+  int bWaiting;     /* Served by the sample in flight */
+  int bPending;     /* Wants the one after that */
+  int64_t iLast_us; /* Time of the last sample delivered */
+};
+
+/* Copied for every run so that the worker does not look at flags the main
+   loop keeps changing */
+typedef struct samplerjob_t {
+  shared_t *poShared;
+  int bProbe;
+  int bProbeIfAbsent;
+  int bDetails;
+  samplerresult_t oResult;
+} samplerjob_t;
+
+static GHashTable *poSharedTable;
+
+static void Start(shared_t *poShared);
+
+static int64_t GetTime_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void FreeShared(shared_t *poShared) {
+  sysfs_free(poShared->poSysfs);
+  g_free(poShared->acKey);
+  g_free(poShared);
+}
+
+static void UnrefShared(shared_t *poShared) {
+  if (--poShared->iRefs > 0)
+    return;
+
+  g_hash_table_remove(poSharedTable, poShared->acKey);
+  if (g_hash_table_size(poSharedTable) == 0) {
+    g_hash_table_destroy(poSharedTable);
+    poSharedTable = NULL;
+  }
+
+  /* A worker still blocked in a read finds out when it returns */
+  if (poShared->bBusy)
+    poShared->bFreed = 1;
+  else
+    FreeShared(poShared);
+}
+
+static void Work(GTask *task, gpointer source, gpointer data,
+                 GCancellable *cancellable)
+/* Runs on a thread of the GLib pool */
+{
+  samplerjob_t *poJob = (samplerjob_t *)data;
+  sysfs_t *poSysfs = poJob->poShared->poSysfs;
+  int64_t iStart_ns = GetTime_ns();
+
+  if (poJob->bProbe ||
+      (poJob->bProbeIfAbsent && !sysfs_is_present(poSysfs)))
+    sysfs_probe(poSysfs);
+  sysfs_sample(poSysfs, &poJob->oResult.oSample);
+  if ((poJob->oResult.bDetails = poJob->bDetails))
+    sysfs_read_details(poSysfs, &poJob->oResult.oDetails);
+
+  poJob->oResult.iTime_us = g_get_monotonic_time();
+  poJob->oResult.iDuration_ns = GetTime_ns() - iStart_ns;
+  poJob->oResult.iSyscalls = sysfs_take_syscalls(poSysfs);
+  poJob->oResult.iFailedOpens = sysfs_take_failed_opens(poSysfs);
+  poJob->oResult.iHung = sysfs_take_hung(poSysfs);
+  g_task_return_boolean(task, TRUE);
+}
+
+static void OnDone(GObject *source, GAsyncResult *result, gpointer data)
+/* Back on the main loop, hand the sample to every subscriber */
+{
+  samplerjob_t *poJob = g_task_get_task_data(G_TASK(result));
+  shared_t *poShared = (shared_t *)data;
+  sampler_t *poSampler;
+  GSList *l, *next;
+
+  poShared->bBusy = 0;
+  if (poShared->bFreed) {
+    FreeShared(poShared);
+    return;
+  }
+
+  /* A callback may unsubscribe, even the last subscriber */
+  poShared->iRefs++;
+  poShared->oLast = poJob->oResult;
+  for (l = poShared->poSubs; l; l = next) {
+    next = l->next;
+    poSampler = (sampler_t *)l->data;
+    poSampler->bWaiting = 0;
+    poSampler->iLast_us = poJob->oResult.iTime_us;
+    poSampler->pfFunc(&poJob->oResult, poSampler->pvData);
+  }
+
+  if (poShared->bPending && !poShared->bBusy && poShared->iRefs > 1)
+    Start(poShared);
+  UnrefShared(poShared);
+}
+
+static void Start(shared_t *poShared) {
+  samplerjob_t *poJob;
+  sampler_t *poSampler;
+  GTask *task;
+  GSList *l;
+
+  /* Those who asked again while the last sample was read are served by
+     this one */
+  for (l = poShared->poSubs; l; l = l->next) {
+    poSampler = (sampler_t *)l->data;
+    poSampler->bWaiting = poSampler->bPending;
+    poSampler->bPending = 0;
+  }
+
+  poJob = g_new0(samplerjob_t, 1);
+  poJob->poShared = poShared;
+  poJob->bProbe = poShared->bProbe;
+  poJob->bProbeIfAbsent = poShared->bProbeIfAbsent;
+  poJob->bDetails = poShared->bDetails;
+  poJob->oResult.iCoalesced = poShared->iCoalesced;
+  poShared->bProbe = 0;
+  poShared->bProbeIfAbsent = 0;
+  poShared->bBusyDetails = poJob->bDetails;
+  poShared->bDetails = 0;
+  poShared->bPending = 0;
+  poShared->iCoalesced = 0;
+  poShared->bBusy = 1;
+  poShared->bHungMarked = 0;
+  poShared->iStarted_us = g_get_monotonic_time();
+
+  task = g_task_new(NULL, NULL, OnDone, poShared);
+  g_task_set_task_data(task, poJob, g_free);
+  g_task_run_in_thread(task, Work);
+  g_object_unref(task);
+}
+
+void sampler_request(sampler_t *poSampler, int64_t iMaxAge_us) {
+  shared_t *poShared = poSampler->poShared;
+
+  if (!poShared->bBusy) {
+    /* Every subscriber got the last sample when it came in, except those
+       that subscribed later */
+    if (iMaxAge_us > 0 && poShared->oLast.iTime_us &&
+        poSampler->iLast_us == poShared->oLast.iTime_us &&
+        g_get_monotonic_time() - poShared->oLast.iTime_us <= iMaxAge_us) {
+      DBG("sample shared with another instance");
+      return;
+    }
+    poSampler->bPending = 1;
+    Start(poShared);
+    return;
+  }
+
+  /* A sample started by somebody else will do if it began within
+     iMaxAge_us. A request for a fresh one, e.g. after a uevent, needs a
+     read that begins after it. So does one asking again while a sample
+     started for it is in flight, it may predate whatever changed */
+  if (!poSampler->bWaiting && iMaxAge_us > 0 &&
+      g_get_monotonic_time() - poShared->iStarted_us <= iMaxAge_us) {
+    poSampler->bWaiting = 1;
+    return;
+  }
+  if (poShared->bPending)
+    poShared->iCoalesced++;
+  poShared->bPending = 1;
+  poSampler->bPending = 1;
+
+  /* A read that takes this long will not come back any time soon. The
+     worker skips the attribute once it does */
+  if (!poShared->bHungMarked &&
+      g_get_monotonic_time() - poShared->iStarted_us > SAMPLER_HUNG_US) {
+    poShared->bHungMarked = sysfs_mark_hung(poShared->poSysfs);
+    DBG("sample busy for %" G_GINT64_FORMAT " us",
+        g_get_monotonic_time() - poShared->iStarted_us);
+  }
+}
+
+void sampler_request_details(sampler_t *poSampler) {
+  shared_t *poShared = poSampler->poShared;
+
+  /* The sample in flight only answers if it reads them too. Otherwise the
+     request for a fresh sample below makes sure one follows that does */
+  if (poShared->bBusy && poShared->bBusyDetails && !poSampler->bWaiting) {
+    poSampler->bWaiting = 1;
+    return;
+  }
+  poShared->bDetails = 1;
+  sampler_request(poSampler, 0);
+}
+
+void sampler_probe(sampler_t *poSampler, int bIfAbsent) {
+  if (bIfAbsent)
+    poSampler->poShared->bProbeIfAbsent = 1;
+  else
+    poSampler->poShared->bProbe = 1;
+}
+
+const char *sampler_get_path(const sampler_t *poSampler, const char *attr,
+                             char *buf, size_t len) {
+  /* The path never changes, no need to wait for the worker */
+  return sysfs_get_path(poSampler->poShared->poSysfs, attr, buf, len);
+}
+
+sampler_t *sampler_new(const char *root, const char *battery, SamplerFunc func,
+                       void *data) {
+  sampler_t *poSampler;
+  shared_t *poShared;
+  char *key;
+
+  if (!poSharedTable)
+    poSharedTable = g_hash_table_new(g_str_hash, g_str_equal);
+
+  key = g_build_filename(root, battery, NULL);
+  poShared = g_hash_table_lookup(poSharedTable, key);
+  if (poShared) {
+    g_free(key);
+  } else {
+    poShared = g_new0(shared_t, 1);
+    poShared->acKey = key;
+    poShared->poSysfs = sysfs_new(root, battery);
+    /* Even finding the attributes reads from the battery, leave it to the
+       first worker */
+    poShared->bProbe = 1;
+    g_hash_table_insert(poSharedTable, poShared->acKey, poShared);
+  }
+  poShared->iRefs++;
+
+  poSampler = g_new0(sampler_t, 1);
+  poSampler->poShared = poShared;
+  poSampler->pfFunc = func;
+  poSampler->pvData = data;
+  poShared->poSubs = g_slist_append(poShared->poSubs, poSampler);
+  return poSampler;
+}
+
+void sampler_free(sampler_t *poSampler) {
+  shared_t *poShared;
+
+  if (!poSampler)
+    return;
+
+  poShared = poSampler->poShared;
+  poShared->poSubs = g_slist_remove(poShared->poSubs, poSampler);
+  g_free(poSampler);
+  UnrefShared(poShared);
+}
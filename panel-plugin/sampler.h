@@ -0,0 +1,82 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Battery sampling on a worker thread
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef BATTMON_SAMPLER_H
+#define BATTMON_SAMPLER_H
+
+#include <stdint.h>
+
+#include "battery.h"
+
+/* A sample still busy after this long is considered hung */
+#define SAMPLER_HUNG_US (5 * 1000 * 1000)
+
+/* Timer ticks are happy with a sample this old. Instances in one process
+   fire their timers in the same second, so one of them reads for all */
+#define SAMPLER_SHARE_US (2 * 1000 * 1000)
+
+/* What a worker hands back to the main loop. It is not touched by anybody
+   else once delivered */
+typedef struct samplerresult_t {
+  battsample_t oSample;
+  int64_t iTime_us;     /* Monotonic clock, when the sample was taken */
+  int64_t iDuration_ns; /* Time spent reading */
+  unsigned int iSyscalls;
+  unsigned int iFailedOpens;
+  unsigned int iHung;      /* Attributes found hung and left alone */
+  unsigned int iCoalesced; /* Further requests this sample also answers */
+  int bDetails;            /* oDetails was read along with the sample */
+  battdetails_t oDetails;
+} samplerresult_t;
+
+/* Called on the main loop with every finished sample, also with those
+   another subscriber asked for */
+typedef void (*SamplerFunc)(const samplerresult_t *poResult, void *data);
+
+/* A subscription to the sampler of one battery. The battery is read by
+   one worker per process however many plugin instances watch it */
+typedef struct sampler_t sampler_t;
+
+sampler_t *sampler_new(const char *root, const char *battery, SamplerFunc func,
+                       void *data);
+
+/* func is not called anymore. A worker that is still blocked in a read
+   keeps the shared part alive until it returns */
+void sampler_free(sampler_t *poSampler);
+
+/* Ask for a sample, unless one no older than iMaxAge_us was delivered
+   already. Only one is read at a time. A request while another
+   subscriber's sample is read is served by it if that started no more than
+   iMaxAge_us ago, other requests arriving meanwhile are served by a single
+   further sample */
+void sampler_request(sampler_t *poSampler, int64_t iMaxAge_us);
+
+/* Ask for a sample that also carries the details */
+void sampler_request_details(sampler_t *poSampler);
+
+/* Look for the battery again before the next sample, e.g. after it was
+   added or removed. With bIfAbsent, only as long as it is missing. Applies
+   to all subscribers */
+void sampler_probe(sampler_t *poSampler, int bIfAbsent);
+
+const char *sampler_get_path(const sampler_t *poSampler, const char *attr,
+                             char *buf, size_t len);
+
+#endif /* BATTMON_SAMPLER_H */
@@ -0,0 +1,52 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Timer period by battery state
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include "schedule.h"
+
+unsigned int schedule_get_period(battstatus_t eStatus, int bCritical,
+                                 unsigned int period_ms, int bPushed) {
+  unsigned int iPeriod_s, iBase_s;
+
+  iBase_s = MAX((period_ms + 999) / 1000, SCHEDULE_MIN_PERIOD_S);
+
+  switch (eStatus) {
+  case BattStatus_Discharging:
+    if (bCritical)
+      return MAX(iBase_s / 3, SCHEDULE_MIN_PERIOD_S);
+    iPeriod_s = iBase_s;
+    break;
+  case BattStatus_Charging:
+    iPeriod_s = MAX(MIN(4 * iBase_s, SCHEDULE_IDLE_PERIOD_S), iBase_s);
+    break;
+  default:
+    iPeriod_s = MAX(SCHEDULE_IDLE_PERIOD_S, iBase_s);
+    break;
+  }
+
+  if (bPushed)
+    iPeriod_s = MAX(iPeriod_s, SCHEDULE_FALLBACK_PERIOD_S);
+  return iPeriod_s;
+}
@@ -0,0 +1,50 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Timer period by battery state
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef BATTMON_SCHEDULE_H
+#define BATTMON_SCHEDULE_H
+
+#include "battery.h"
+
+/* Timer periods by battery state, P being the configured period (rounded
+   up to whole seconds):
+
+     state                                period             wakeups/h at
+                                                             P = 30 s
+     Discharging                          P                  120
+     Discharging, critical level          MAX(P / 3, 5 s)    360
+     Charging                             MIN(4 P, 10 min)   30
+     Full, not charging or no battery     10 min             6
+
+   No period is ever shorter than SCHEDULE_MIN_PERIOD_S, and none but the
+   critical one is shorter than P. When changes are pushed (power_supply
+   events or UPower), status changes need no polling and the timer only has
+   to catch the slow drift of the remaining time. All but the critical
+   period are then at least SCHEDULE_FALLBACK_PERIOD_S, which takes
+   discharging and charging down to 30 wakeups/h */
+#define SCHEDULE_MIN_PERIOD_S 5
+#define SCHEDULE_IDLE_PERIOD_S (10 * 60)
+#define SCHEDULE_FALLBACK_PERIOD_S 120
+
+/* Seconds until the next update. period_ms is the configured period */
+unsigned int schedule_get_period(battstatus_t eStatus, int bCritical,
+                                 unsigned int period_ms, int bPushed);
+
+#endif /* BATTMON_SCHEDULE_H */
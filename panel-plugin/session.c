@@ -0,0 +1,334 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Following suspend, session locking and screen blanking
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gio/gio.h>
+
+#include <libxfce4util/libxfce4util.h>
+
+#include <string.h>
+#include <unistd.h>
+
+#include "session.h"
+
+#define LOGIN1_NAME "org.freedesktop.login1"
+#define LOGIN1_PATH "/org/freedesktop/login1"
+#define LOGIN1_MANAGER LOGIN1_NAME ".Manager"
+#define LOGIN1_SESSION LOGIN1_NAME ".Session"
+#define SCREENSAVER_NAME "org.freedesktop.ScreenSaver"
+#define SCREENSAVER_PATH "/org/freedesktop/ScreenSaver"
+#define PROPERTIES "org.freedesktop.DBus.Properties"
+
+struct session_t {
+  SessionFunc pfFunc;
+  void *pvData;
+  GCancellable *poCancel;
+  GDBusConnection *poSystem;
+  GDBusConnection *poSessionBus;
+  guint iSleepId;
+  guint iLockId;
+  guint iUnlockId;
+  guint iPropsId;
+  guint iSaverId;
+  /* Reasons for not sampling, any of them is enough */
+  int bSleeping;
+  int bLocked;
+  int bInactive;
+  int bBlanked;
+  int bWasActive;
+  int bSlept; /* Since session_monitor_take_slept() was last called */
+};
+
+static void Update(session_t *poSession) {
+  int bActive = session_monitor_is_active(poSession);
+
+  if (bActive == poSession->bWasActive)
+    return;
+
+  DBG("session %s (sleeping %d, locked %d, inactive %d, blanked %d)",
+      bActive ? "active" : "idle", poSession->bSleeping, poSession->bLocked,
+      poSession->bInactive, poSession->bBlanked);
+  poSession->bWasActive = bActive;
+  poSession->pfFunc(bActive, poSession->pvData);
+}
+
+static void OnPrepareForSleep(GDBusConnection *conn, const gchar *sender,
+                              const gchar *path, const gchar *iface,
+                              const gchar *signal, GVariant *params,
+                              gpointer data) {
+  session_t *poSession = (session_t *)data;
+  gboolean bSleeping;
+
+  if (!g_variant_is_of_type(params, G_VARIANT_TYPE("(b)")))
+    return;
+  g_variant_get(params, "(b)", &bSleeping);
+  poSession->bSleeping = bSleeping;
+  if (bSleeping)
+    poSession->bSlept = 1;
+  Update(poSession);
+}
+
+static void OnLock(GDBusConnection *conn, const gchar *sender,
+                   const gchar *path, const gchar *iface, const gchar *signal,
+                   GVariant *params, gpointer data) {
+  session_t *poSession = (session_t *)data;
+
+  poSession->bLocked = strcmp(signal, "Lock") == 0;
+  Update(poSession);
+}
+
+/* Takes what we need from an a{sv} of session properties */
+static void ParseSession(session_t *poSession, GVariant *poProps) {
+  gboolean bValue;
+
+  if (g_variant_lookup(poProps, "Active", "b", &bValue))
+    poSession->bInactive = !bValue;
+  if (g_variant_lookup(poProps, "LockedHint", "b", &bValue))
+    poSession->bLocked = bValue;
+}
+
+static void OnSessionProperties(GDBusConnection *conn, const gchar *sender,
+                                const gchar *path, const gchar *iface,
+                                const gchar *signal, GVariant *params,
+                                gpointer data) {
+  session_t *poSession = (session_t *)data;
+  GVariant *poChanged;
+
+  if (!g_variant_is_of_type(params, G_VARIANT_TYPE("(sa{sv}as)")))
+    return;
+
+  poChanged = g_variant_get_child_value(params, 1);
+  ParseSession(poSession, poChanged);
+  g_variant_unref(poChanged);
+
+  Update(poSession);
+}
+
+static void OnSessionGetAll(GObject *source, GAsyncResult *res,
+                            gpointer data) {
+  session_t *poSession;
+  GVariant *poReply, *poProps;
+  GError *poError = NULL;
+
+  poReply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res,
+                                          &poError);
+  if (!poReply) {
+    /* data is gone if we were cancelled */
+    if (!g_error_matches(poError, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      DBG("no logind session properties: %s", poError->message);
+    g_error_free(poError);
+    return;
+  }
+
+  poSession = (session_t *)data;
+  poProps = g_variant_get_child_value(poReply, 0);
+  ParseSession(poSession, poProps);
+  g_variant_unref(poProps);
+  g_variant_unref(poReply);
+
+  Update(poSession);
+}
+
+static void OnScreenSaver(GDBusConnection *conn, const gchar *sender,
+                          const gchar *path, const gchar *iface,
+                          const gchar *signal, GVariant *params,
+                          gpointer data) {
+  session_t *poSession = (session_t *)data;
+  gboolean bActive;
+
+  if (!g_variant_is_of_type(params, G_VARIANT_TYPE("(b)")))
+    return;
+  g_variant_get(params, "(b)", &bActive);
+  poSession->bBlanked = bActive;
+  Update(poSession);
+}
+
+static void OnSessionPath(GObject *source, GAsyncResult *res, gpointer data) {
+  session_t *poSession;
+  GVariant *poReply;
+  GError *poError = NULL;
+  const gchar *path;
+
+  poReply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res,
+                                          &poError);
+  if (!poReply) {
+    /* data is gone if we were cancelled */
+    if (!g_error_matches(poError, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      DBG("no logind session: %s", poError->message);
+    g_error_free(poError);
+    return;
+  }
+
+  poSession = (session_t *)data;
+  g_variant_get(poReply, "(&o)", &path);
+  DBG("logind session %s", path);
+
+  poSession->iLockId = g_dbus_connection_signal_subscribe(
+      poSession->poSystem, LOGIN1_NAME, LOGIN1_SESSION, "Lock", path, NULL,
+      G_DBUS_SIGNAL_FLAGS_NONE, OnLock, poSession, NULL);
+  poSession->iUnlockId = g_dbus_connection_signal_subscribe(
+      poSession->poSystem, LOGIN1_NAME, LOGIN1_SESSION, "Unlock", path, NULL,
+      G_DBUS_SIGNAL_FLAGS_NONE, OnLock, poSession, NULL);
+  poSession->iPropsId = g_dbus_connection_signal_subscribe(
+      poSession->poSystem, LOGIN1_NAME, PROPERTIES,
+      "PropertiesChanged", path, LOGIN1_SESSION, G_DBUS_SIGNAL_FLAGS_NONE,
+      OnSessionProperties, poSession, NULL);
+
+  /* A panel started while locked or switched away would otherwise sample
+     until the next change. Asked after subscribing, so none is missed */
+  g_dbus_connection_call(poSession->poSystem, LOGIN1_NAME, path, PROPERTIES,
+                         "GetAll", g_variant_new("(s)", LOGIN1_SESSION),
+                         G_VARIANT_TYPE("(a{sv})"), G_DBUS_CALL_FLAGS_NONE, -1,
+                         poSession->poCancel, OnSessionGetAll, poSession);
+
+  g_variant_unref(poReply);
+}
+
+static void OnSystemBus(GObject *source, GAsyncResult *res, gpointer data) {
+  session_t *poSession;
+  GDBusConnection *poConn;
+  GError *poError = NULL;
+
+  if (!(poConn = g_bus_get_finish(res, &poError))) {
+    if (!g_error_matches(poError, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      DBG("no system bus: %s", poError->message);
+    g_error_free(poError);
+    return;
+  }
+
+  poSession = (session_t *)data;
+  poSession->poSystem = poConn;
+
+  poSession->iSleepId = g_dbus_connection_signal_subscribe(
+      poConn, LOGIN1_NAME, LOGIN1_MANAGER, "PrepareForSleep", LOGIN1_PATH,
+      NULL, G_DBUS_SIGNAL_FLAGS_NONE, OnPrepareForSleep, poSession, NULL);
+
+  g_dbus_connection_call(poConn, LOGIN1_NAME, LOGIN1_PATH, LOGIN1_MANAGER,
+                         "GetSessionByPID",
+                         g_variant_new("(u)", (guint32)getpid()),
+                         G_VARIANT_TYPE("(o)"), G_DBUS_CALL_FLAGS_NONE, -1,
+                         poSession->poCancel, OnSessionPath, poSession);
+}
+
+static void OnSaverActive(GObject *source, GAsyncResult *res, gpointer data) {
+  session_t *poSession;
+  GVariant *poReply;
+  GError *poError = NULL;
+  gboolean bActive;
+
+  poReply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res,
+                                          &poError);
+  if (!poReply) {
+    /* data is gone if we were cancelled */
+    if (!g_error_matches(poError, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      DBG("no screensaver: %s", poError->message);
+    g_error_free(poError);
+    return;
+  }
+
+  poSession = (session_t *)data;
+  g_variant_get(poReply, "(b)", &bActive);
+  poSession->bBlanked = bActive;
+  g_variant_unref(poReply);
+
+  Update(poSession);
+}
+
+static void OnSessionBus(GObject *source, GAsyncResult *res, gpointer data) {
+  session_t *poSession;
+  GDBusConnection *poConn;
+  GError *poError = NULL;
+
+  if (!(poConn = g_bus_get_finish(res, &poError))) {
+    if (!g_error_matches(poError, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      DBG("no session bus: %s", poError->message);
+    g_error_free(poError);
+    return;
+  }
+
+  poSession = (session_t *)data;
+  poSession->poSessionBus = poConn;
+
+  poSession->iSaverId = g_dbus_connection_signal_subscribe(
+      poConn, SCREENSAVER_NAME, SCREENSAVER_NAME, "ActiveChanged", NULL, NULL,
+      G_DBUS_SIGNAL_FLAGS_NONE, OnScreenSaver, poSession, NULL);
+
+  g_dbus_connection_call(poConn, SCREENSAVER_NAME, SCREENSAVER_PATH,
+                         SCREENSAVER_NAME, "GetActive", NULL,
+                         G_VARIANT_TYPE("(b)"), G_DBUS_CALL_FLAGS_NONE, -1,
+                         poSession->poCancel, OnSaverActive, poSession);
+}
+
+session_t *session_monitor_new(SessionFunc func, void *data) {
+  session_t *poSession;
+
+  poSession = g_new0(session_t, 1);
+  poSession->pfFunc = func;
+  poSession->pvData = data;
+  poSession->bWasActive = 1;
+  poSession->poCancel = g_cancellable_new();
+
+  g_bus_get(G_BUS_TYPE_SYSTEM, poSession->poCancel, OnSystemBus, poSession);
+  g_bus_get(G_BUS_TYPE_SESSION, poSession->poCancel, OnSessionBus, poSession);
+
+  return poSession;
+}
+
+int session_monitor_is_active(const session_t *poSession) {
+  return !(poSession->bSleeping || poSession->bLocked ||
+           poSession->bInactive || poSession->bBlanked);
+}
+
+int session_monitor_take_slept(session_t *poSession) {
+  int bSlept = poSession->bSlept;
+
+  poSession->bSlept = 0;
+  return bSlept;
+}
+
+static void Unsubscribe(GDBusConnection *poConn, guint *piId) {
+  if (*piId)
+    g_dbus_connection_signal_unsubscribe(poConn, *piId);
+  *piId = 0;
+}
+
+void session_monitor_free(session_t *poSession) {
+  if (!poSession)
+    return;
+
+  g_cancellable_cancel(poSession->poCancel);
+  g_object_unref(poSession->poCancel);
+
+  if (poSession->poSystem) {
+    Unsubscribe(poSession->poSystem, &poSession->iSleepId);
+    Unsubscribe(poSession->poSystem, &poSession->iLockId);
+    Unsubscribe(poSession->poSystem, &poSession->iUnlockId);
+    Unsubscribe(poSession->poSystem, &poSession->iPropsId);
+    g_object_unref(poSession->poSystem);
+  }
+  if (poSession->poSessionBus) {
+    Unsubscribe(poSession->poSessionBus, &poSession->iSaverId);
+    g_object_unref(poSession->poSessionBus);
+  }
+  g_free(poSession);
+}
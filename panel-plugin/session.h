@@ -0,0 +1,44 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Following suspend, session locking and screen blanking
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef BATTMON_SESSION_H
+#define BATTMON_SESSION_H
+
+/* Called whenever the answer to "is anybody looking at the panel" changes.
+   It is not while the machine is about to sleep, the session is locked or
+   inactive (another user on the seat), or the screensaver has blanked the
+   screen */
+typedef void (*SessionFunc)(int bActive, void *data);
+
+typedef struct session_t session_t;
+
+/* Follows org.freedesktop.login1 on the system bus and
+   org.freedesktop.ScreenSaver on the session bus. Both buses are looked up
+   the usual way, so DBUS_SYSTEM_BUS_ADDRESS and DBUS_SESSION_BUS_ADDRESS
+   can point it at a private bus with mock services. Everything is
+   asynchronous, a missing bus or service simply never reports inactive */
+session_t *session_monitor_new(SessionFunc func, void *data);
+int session_monitor_is_active(const session_t *poSession);
+/* Whether the machine went to sleep since the last call. Locking and
+   blanking do not count, the clocks keep running through those */
+int session_monitor_take_slept(session_t *poSession);
+void session_monitor_free(session_t *poSession);
+
+#endif /* BATTMON_SESSION_H */
@@ -0,0 +1,131 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Interchangeable sources of battery samples
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include "replay.h"
+#include "source.h"
+#include "upower.h"
+
+struct source_t {
+  sourcetype_t eType;
+  union {
+    sampler_t *poSampler;
+    upower_t *poUPower;
+    replay_t *poReplay;
+  } u;
+};
+
+source_t *source_new(sourcetype_t eType, const char *arg, const char *battery,
+                     SamplerFunc func, void *data) {
+  source_t *poSource;
+
+  g_return_val_if_fail(eType < SourceType_Max, NULL);
+
+  poSource = g_new0(source_t, 1);
+  poSource->eType = eType;
+  switch (eType) {
+  case SourceType_Sysfs:
+    poSource->u.poSampler = sampler_new(arg, battery, func, data);
+    break;
+  case SourceType_UPower:
+    poSource->u.poUPower = upower_new(battery, func, data);
+    break;
+  case SourceType_Replay:
+    poSource->u.poReplay = replay_new(arg, func, data);
+    break;
+  default:
+    break;
+  }
+  return poSource;
+}
+
+void source_free(source_t *poSource) {
+  if (!poSource)
+    return;
+
+  switch (poSource->eType) {
+  case SourceType_Sysfs:
+    sampler_free(poSource->u.poSampler);
+    break;
+  case SourceType_UPower:
+    upower_free(poSource->u.poUPower);
+    break;
+  case SourceType_Replay:
+    replay_free(poSource->u.poReplay);
+    break;
+  default:
+    break;
+  }
+  g_free(poSource);
+}
+
+int source_pushes(const source_t *poSource) {
+  return poSource->eType != SourceType_Sysfs;
+}
+
+void source_request(source_t *poSource, int64_t iMaxAge_us) {
+  switch (poSource->eType) {
+  case SourceType_Sysfs:
+    sampler_request(poSource->u.poSampler, iMaxAge_us);
+    break;
+  case SourceType_UPower:
+    upower_request(poSource->u.poUPower);
+    break;
+  case SourceType_Replay:
+    replay_request(poSource->u.poReplay);
+    break;
+  default:
+    break;
+  }
+}
+
+void source_request_details(source_t *poSource) {
+  switch (poSource->eType) {
+  case SourceType_Sysfs:
+    sampler_request_details(poSource->u.poSampler);
+    break;
+  case SourceType_UPower:
+    upower_request_details(poSource->u.poUPower);
+    break;
+  case SourceType_Replay:
+    replay_request_details(poSource->u.poReplay);
+    break;
+  default:
+    break;
+  }
+}
+
+void source_probe(source_t *poSource, int bIfAbsent) {
+  /* The others learn about the battery coming and going by themselves */
+  if (poSource->eType == SourceType_Sysfs)
+    sampler_probe(poSource->u.poSampler, bIfAbsent);
+}
+
+const char *source_get_path(const source_t *poSource, const char *attr,
+                            char *buf, size_t len) {
+  if (poSource->eType != SourceType_Sysfs)
+    return NULL;
+  return sampler_get_path(poSource->u.poSampler, attr, buf, len);
+}
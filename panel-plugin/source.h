@@ -0,0 +1,60 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Interchangeable sources of battery samples
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef BATTMON_SOURCE_H
+#define BATTMON_SOURCE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sampler.h"
+
+/* Where samples come from. All of them deliver samplerresult_t to a
+   SamplerFunc on the main loop, see sampler.h */
+typedef enum sourcetype_t {
+  SourceType_Sysfs,  /* The kernel's power_supply class, read by a worker */
+  SourceType_UPower, /* org.freedesktop.UPower, which does the polling */
+  SourceType_Replay, /* Recorded or made up samples, for testing */
+  SourceType_Max
+} sourcetype_t;
+
+typedef struct source_t source_t;
+
+/* arg is the sysfs root or the replay file, NULL for the default */
+source_t *source_new(sourcetype_t eType, const char *arg, const char *battery,
+                     SamplerFunc func, void *data);
+void source_free(source_t *poSource);
+
+/* Whether the source reports changes by itself. The timer then only has
+   to catch the drift of the estimate */
+int source_pushes(const source_t *poSource);
+
+/* See sampler_request(), sampler_request_details() and sampler_probe().
+   Sources that push answer from what they have, probing is a no-op for
+   them */
+void source_request(source_t *poSource, int64_t iMaxAge_us);
+void source_request_details(source_t *poSource);
+void source_probe(source_t *poSource, int bIfAbsent);
+
+/* Path of a sysfs attribute of the battery, NULL for other sources */
+const char *source_get_path(const source_t *poSource, const char *attr,
+                            char *buf, size_t len);
+
+#endif /* BATTMON_SOURCE_H */
@@ -0,0 +1,322 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Small graph of the recent charge and power draw
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gtk/gtk.h>
+
+#include <libxfce4util/libxfce4util.h>
+
+#include <string.h>
+
+#include "sparkline.h"
+
+typedef struct sparkcol_t {
+  int iPercent; /* -1 for a minute without samples */
+  int bCharging;
+  long lRate;
+} sparkcol_t;
+
+struct sparkline_t {
+  GtkWidget *wArea; /* NULL when drawing offscreen */
+  GtkOrientation eOrientation;
+  /* Ring of the values shown, only needed to redraw everything when the
+     size, orientation or scale change */
+  sparkcol_t *aoCols;
+  int iColumns;
+  int iNewest;
+  time_t iNewestMinute; /* 0 while empty */
+  long lScale;          /* Rate drawn at the full breadth */
+  /* The graph as currently drawn, a ring as well: slot i of aoCols is
+     pixel column (or row) i. New samples only draw their own slots, the
+     ring is rotated into place when painted */
+  cairo_surface_t *poSurf;
+  int bValid;
+  int iWidth, iHeight, iScale;
+  unsigned int iFullDraws, iColumnDraws;
+};
+
+static const sparkcol_t oEmptyCol = {-1, 0, -1};
+
+static void ColumnRect(sparkline_t *poSpark, cairo_t *cr, int c, double from,
+                       double to)
+/* Add the part of slot c between from and to (fractions of the breadth,
+   0 being the base line) to the path */
+{
+  if (poSpark->eOrientation == GTK_ORIENTATION_HORIZONTAL)
+    cairo_rectangle(cr, c, poSpark->iHeight * (1.0 - to), 1,
+                    poSpark->iHeight * (to - from));
+  else
+    cairo_rectangle(cr, poSpark->iWidth * from, c,
+                    poSpark->iWidth * (to - from), 1);
+}
+
+static void DrawColumn(sparkline_t *poSpark, cairo_t *cr, int c) {
+  const sparkcol_t *poCol = &poSpark->aoCols[c];
+  double level;
+
+  cairo_save(cr);
+  cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+  ColumnRect(poSpark, cr, c, 0.0, 1.0);
+  cairo_fill(cr);
+  cairo_restore(cr);
+
+  if (poCol->iPercent < 0)
+    return;
+
+  if (poCol->bCharging)
+    cairo_set_source_rgba(cr, 0.53, 0.81, 0.92, 0.6);
+  else
+    cairo_set_source_rgba(cr, 0.45, 0.75, 0.30, 0.6);
+  ColumnRect(poSpark, cr, c, 0.0, CLAMP(poCol->iPercent, 0, 100) / 100.0);
+  cairo_fill(cr);
+
+  if (poCol->lRate > 0 && poSpark->lScale > 0) {
+    level = MIN((double)poCol->lRate / poSpark->lScale, 1.0);
+    cairo_set_source_rgba(cr, 1.0, 0.55, 0.0, 1.0);
+    ColumnRect(poSpark, cr, c, MAX(level - 0.05, 0.0), level);
+    cairo_fill(cr);
+  }
+}
+
+static void FreeSurface(sparkline_t *poSpark) {
+  if (poSpark->poSurf)
+    cairo_surface_destroy(poSpark->poSurf);
+  poSpark->poSurf = NULL;
+  poSpark->bValid = 0;
+}
+
+static int Rebuild(sparkline_t *poSpark) {
+  GdkWindow *window = NULL;
+  cairo_t *cr;
+  int c;
+
+  if (poSpark->wArea) {
+    if (!(window = gtk_widget_get_window(poSpark->wArea)))
+      return 0;
+    poSpark->iWidth = gtk_widget_get_allocated_width(poSpark->wArea);
+    poSpark->iHeight = gtk_widget_get_allocated_height(poSpark->wArea);
+    poSpark->iScale = gtk_widget_get_scale_factor(poSpark->wArea);
+  }
+
+  FreeSurface(poSpark);
+  /* Similar surfaces carry the device scale, so HiDPI is taken care of */
+  poSpark->poSurf =
+      window ? gdk_window_create_similar_surface(
+                   window, CAIRO_CONTENT_COLOR_ALPHA, poSpark->iWidth,
+                   poSpark->iHeight)
+             : cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+                                          poSpark->iWidth, poSpark->iHeight);
+
+  cr = cairo_create(poSpark->poSurf);
+  for (c = 0; c < poSpark->iColumns; c++)
+    DrawColumn(poSpark, cr, c);
+  cairo_destroy(cr);
+
+  poSpark->bValid = 1;
+  poSpark->iFullDraws++;
+  return 1;
+}
+
+static void DrawNewest(sparkline_t *poSpark, int n)
+/* Draw the newest slot and the n - 1 empty ones before it. Nothing else
+   moves, so the cost depends neither on the size of the widget nor on how
+   much history it shows */
+{
+  cairo_t *cr = cairo_create(poSpark->poSurf);
+  int i;
+
+  for (i = 0; i < MAX(n, 1); i++)
+    DrawColumn(poSpark, cr,
+               (poSpark->iNewest - i + poSpark->iColumns) % poSpark->iColumns);
+  cairo_destroy(cr);
+
+  poSpark->iColumnDraws++;
+}
+
+void sparkline_push(sparkline_t *poSpark, int percent, long rate, int charging,
+                    time_t now) {
+  time_t minute = now / SPARKLINE_INTERVAL_S;
+  sparkcol_t *poCol;
+  int n = 0, i;
+
+  if (poSpark->iNewestMinute && minute > poSpark->iNewestMinute)
+    n = MIN(minute - poSpark->iNewestMinute, poSpark->iColumns);
+  if (!poSpark->iNewestMinute || minute > poSpark->iNewestMinute)
+    poSpark->iNewestMinute = minute;
+
+  /* Minutes without samples stay empty */
+  for (i = 0; i < n; i++) {
+    poSpark->iNewest = (poSpark->iNewest + 1) % poSpark->iColumns;
+    poSpark->aoCols[poSpark->iNewest] = oEmptyCol;
+  }
+
+  poCol = &poSpark->aoCols[poSpark->iNewest];
+  poCol->iPercent = percent;
+  poCol->lRate = rate;
+  poCol->bCharging = charging;
+
+  /* Keep headroom so that the scale, and with it every column, rarely has
+     to change */
+  if (rate > poSpark->lScale) {
+    poSpark->lScale = rate + rate / 2;
+    poSpark->bValid = 0;
+  }
+
+  if (poSpark->bValid)
+    DrawNewest(poSpark, n);
+  else if (!poSpark->wArea)
+    Rebuild(poSpark); /* There is no draw to do it */
+  DBG("sparkline: %u full draws, %u column draws", poSpark->iFullDraws,
+      poSpark->iColumnDraws);
+  if (poSpark->wArea)
+    gtk_widget_queue_draw(poSpark->wArea);
+}
+
+void sparkline_paint(sparkline_t *poSpark, cairo_t *cr) {
+  /* The oldest slot goes first, the two parts of the ring do not overlap */
+  int iOldest = (poSpark->iNewest + 1) % poSpark->iColumns;
+  int iSplit = poSpark->iColumns - iOldest;
+
+  if (!poSpark->bValid)
+    return;
+  if (poSpark->eOrientation == GTK_ORIENTATION_HORIZONTAL) {
+    cairo_set_source_surface(cr, poSpark->poSurf, -iOldest, 0);
+    cairo_paint(cr);
+    cairo_set_source_surface(cr, poSpark->poSurf, iSplit, 0);
+  } else {
+    cairo_set_source_surface(cr, poSpark->poSurf, 0, -iOldest);
+    cairo_paint(cr);
+    cairo_set_source_surface(cr, poSpark->poSurf, 0, iSplit);
+  }
+  cairo_paint(cr);
+}
+
+static gboolean OnDraw(GtkWidget *widget, cairo_t *cr, gpointer data) {
+  sparkline_t *poSpark = (sparkline_t *)data;
+
+  if (poSpark->bValid || Rebuild(poSpark))
+    sparkline_paint(poSpark, cr);
+  return FALSE;
+}
+
+static void OnSizeAllocate(GtkWidget *widget, GdkRectangle *allocation,
+                           gpointer data) {
+  sparkline_t *poSpark = (sparkline_t *)data;
+
+  if (allocation->width != poSpark->iWidth ||
+      allocation->height != poSpark->iHeight)
+    poSpark->bValid = 0;
+}
+
+static void OnScaleChanged(GObject *object, GParamSpec *pspec, gpointer data) {
+  sparkline_t *poSpark = (sparkline_t *)data;
+
+  poSpark->bValid = 0;
+  gtk_widget_queue_draw(poSpark->wArea);
+}
+
+static void OnUnrealize(GtkWidget *widget, gpointer data) {
+  /* The surface was made for the window that is going away */
+  FreeSurface((sparkline_t *)data);
+}
+
+static void SparklineFree(gpointer data) {
+  sparkline_t *poSpark = (sparkline_t *)data;
+
+  FreeSurface(poSpark);
+  g_free(poSpark->aoCols);
+  g_free(poSpark);
+}
+
+void sparkline_set_orientation(sparkline_t *poSpark,
+                               GtkOrientation orientation) {
+  poSpark->eOrientation = orientation;
+  poSpark->bValid = 0;
+  if (!poSpark->wArea)
+    return;
+  if (orientation == GTK_ORIENTATION_HORIZONTAL)
+    gtk_widget_set_size_request(poSpark->wArea, poSpark->iColumns, -1);
+  else
+    gtk_widget_set_size_request(poSpark->wArea, -1, poSpark->iColumns);
+  gtk_widget_queue_draw(poSpark->wArea);
+}
+
+static sparkline_t *New(GtkOrientation orientation, int columns) {
+  sparkline_t *poSpark;
+  int i;
+
+  poSpark = g_new0(sparkline_t, 1);
+  poSpark->iColumns = columns;
+  poSpark->aoCols = g_new(sparkcol_t, columns);
+  for (i = 0; i < columns; i++)
+    poSpark->aoCols[i] = oEmptyCol;
+  poSpark->eOrientation = orientation;
+  return poSpark;
+}
+
+sparkline_t *sparkline_new_offscreen(GtkOrientation orientation, int columns,
+                                     int width, int height) {
+  sparkline_t *poSpark = New(orientation, columns);
+
+  poSpark->iWidth = width;
+  poSpark->iHeight = height;
+  poSpark->iScale = 1;
+  return poSpark;
+}
+
+void sparkline_free(sparkline_t *poSpark) {
+  g_return_if_fail(!poSpark->wArea);
+  SparklineFree(poSpark);
+}
+
+void sparkline_get_draws(const sparkline_t *poSpark, unsigned int *full,
+                         unsigned int *columns) {
+  *full = poSpark->iFullDraws;
+  *columns = poSpark->iColumnDraws;
+}
+
+sparkline_t *sparkline_new(GtkOrientation orientation) {
+  sparkline_t *poSpark = New(orientation, SPARKLINE_COLUMNS);
+
+  poSpark->wArea = gtk_drawing_area_new();
+#if GTK_CHECK_VERSION(3, 16, 0)
+  gtk_style_context_add_class(gtk_widget_get_style_context(poSpark->wArea),
+                              "battmon_graph");
+#endif
+  g_object_set_data_full(G_OBJECT(poSpark->wArea), "battmon-sparkline",
+                         poSpark, SparklineFree);
+  g_signal_connect(poSpark->wArea, "draw", G_CALLBACK(OnDraw), poSpark);
+  g_signal_connect(poSpark->wArea, "size-allocate", G_CALLBACK(OnSizeAllocate),
+                   poSpark);
+  g_signal_connect(poSpark->wArea, "notify::scale-factor",
+                   G_CALLBACK(OnScaleChanged), poSpark);
+  g_signal_connect(poSpark->wArea, "unrealize", G_CALLBACK(OnUnrealize),
+                   poSpark);
+  sparkline_set_orientation(poSpark, orientation);
+
+  return poSpark;
+}
+
+GtkWidget *sparkline_get_widget(sparkline_t *poSpark) {
+  return poSpark->wArea;
+}
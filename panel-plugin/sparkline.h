@@ -0,0 +1,60 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Small graph of the recent charge and power draw
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef BATTMON_SPARKLINE_H
+#define BATTMON_SPARKLINE_H
+
+#include <gtk/gtk.h>
+
+#include <time.h>
+
+/* One column per minute */
+#define SPARKLINE_INTERVAL_S 60
+#define SPARKLINE_COLUMNS 60
+
+typedef struct sparkline_t sparkline_t;
+
+/* The graph is freed together with its widget */
+sparkline_t *sparkline_new(GtkOrientation orientation);
+GtkWidget *sparkline_get_widget(sparkline_t *poSpark);
+
+/* Add a sample taken at time now. Samples within the same minute replace
+   each other. percent is 0 to 100, rate is the power draw in any unit and
+   -1 if unknown */
+void sparkline_push(sparkline_t *poSpark, int percent, long rate, int charging,
+                    time_t now);
+
+void sparkline_set_orientation(sparkline_t *poSpark,
+                               GtkOrientation orientation);
+
+/* Without a widget, for measurements: columns of history drawn into a
+   width x height image surface, rebuilt right away when needed. Freed
+   with sparkline_free(), which is only for these */
+sparkline_t *sparkline_new_offscreen(GtkOrientation orientation, int columns,
+                                     int width, int height);
+void sparkline_free(sparkline_t *poSpark);
+/* Paint the graph as drawn at 0, 0 of cr, nothing before the first sample
+   or while a redraw is due */
+void sparkline_paint(sparkline_t *poSpark, cairo_t *cr);
+/* How often everything was drawn, and how often just the newest column */
+void sparkline_get_draws(const sparkline_t *poSpark, unsigned int *full,
+                         unsigned int *columns);
+
+#endif /* BATTMON_SPARKLINE_H */
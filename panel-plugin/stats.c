@@ -0,0 +1,162 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Counters and latency histograms of the update path
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+
+static const char *const apcCountNames[StatsCount_Max] = {
+  [StatsCount_Ticks] = "ticks",
+  [StatsCount_Events] = "events",
+  [StatsCount_Refreshes] = "refreshes",
+  [StatsCount_Updates] = "updates",
+  [StatsCount_UpdatesSkipped] = "updates skipped",
+  [StatsCount_Coalesced] = "coalesced",
+  [StatsCount_Syscalls] = "sysfs syscalls",
+  [StatsCount_FailedOpens] = "failed opens",
+  [StatsCount_Hung] = "hung reads",
+};
+
+static const char *const apcTimeNames[StatsTime_Max] = {
+  [StatsTime_Sample] = "sample",
+  [StatsTime_Render] = "render",
+  [StatsTime_Startup] = "startup",
+  [StatsTime_FirstSample] = "first sample",
+};
+
+void stats_reset(stats_t *poStats) {
+  memset(poStats, 0, sizeof(*poStats));
+  poStats->iSince_us = g_get_monotonic_time();
+}
+
+int64_t stats_begin(void) {
+  struct timespec ts;
+
+  /* Served from the vDSO, no system call */
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int GetBucket(uint64_t iDuration_ns) {
+  int i = 0;
+
+  iDuration_ns >>= 8;
+  while (iDuration_ns > 1 && i < STATS_BUCKETS - 1) {
+    iDuration_ns >>= 1;
+    i++;
+  }
+  return i;
+}
+
+void stats_end(stats_t *poStats, statstime_t eTime, int64_t iStart_ns) {
+  stats_add(poStats, eTime, stats_begin() - iStart_ns);
+}
+
+void stats_add(stats_t *poStats, statstime_t eTime, int64_t iDuration) {
+  uint64_t iDuration_ns = iDuration > 0 ? iDuration : 0;
+  statsrecent_t *poRecent;
+
+  poStats->aaiBuckets[eTime][GetBucket(iDuration_ns)]++;
+  poStats->aiTotal_ns[eTime] += iDuration_ns;
+  if (iDuration_ns > poStats->aiMax_ns[eTime])
+    poStats->aiMax_ns[eTime] = iDuration_ns;
+
+  poRecent = &poStats->aoRecent[poStats->iRecentHead];
+  poRecent->iTime_us = g_get_monotonic_time();
+  poRecent->iDuration_ns = (uint32_t)MIN(iDuration_ns, UINT32_MAX);
+  poRecent->eTime = eTime;
+  poStats->iRecentHead = (poStats->iRecentHead + 1) % STATS_RECENT;
+}
+
+static double GetPercentile(const stats_t *poStats, statstime_t eTime,
+                            uint64_t iCount, unsigned int iPercent)
+/* Upper bound of the bucket the percentile falls into, in us */
+{
+  uint64_t iSeen = 0, iWanted = (iCount * iPercent + 99) / 100;
+  int i;
+
+  for (i = 0; i < STATS_BUCKETS - 1; i++) {
+    iSeen += poStats->aaiBuckets[eTime][i];
+    if (iSeen >= iWanted)
+      break;
+  }
+  return ((uint64_t)1 << (i + 9)) / 1000.0;
+}
+
+void stats_log(const stats_t *poStats) {
+  const statsrecent_t *poRecent;
+  GString *line;
+  uint64_t iCount;
+  int64_t now = g_get_monotonic_time();
+  int i, j;
+
+  g_message("Battmon: statistics over the last %" G_GINT64_FORMAT " s",
+            (now - poStats->iSince_us) / G_USEC_PER_SEC);
+  for (i = 0; i < StatsCount_Max; i++)
+    g_message("Battmon:   %-16s %" G_GUINT64_FORMAT, apcCountNames[i],
+              poStats->aiCounts[i]);
+
+  line = g_string_new(NULL);
+  for (i = 0; i < StatsTime_Max; i++) {
+    iCount = 0;
+    g_string_truncate(line, 0);
+    for (j = 0; j < STATS_BUCKETS; j++) {
+      iCount += poStats->aaiBuckets[i][j];
+      if (poStats->aaiBuckets[i][j])
+        g_string_append_printf(line, " %s%g:%u",
+                               j == STATS_BUCKETS - 1 ? ">=" : "<",
+                               ((uint64_t)1 << (j + (j == STATS_BUCKETS - 1
+                                                         ? 8 : 9))) / 1000.0,
+                               poStats->aaiBuckets[i][j]);
+    }
+    if (!iCount)
+      continue;
+    g_message("Battmon:   %s: n %" G_GUINT64_FORMAT ", mean %.1f us, "
+              "p50 < %g us, p99 < %g us, max %.1f us",
+              apcTimeNames[i], iCount,
+              (double)poStats->aiTotal_ns[i] / iCount / 1000,
+              GetPercentile(poStats, i, iCount, 50),
+              GetPercentile(poStats, i, iCount, 99),
+              poStats->aiMax_ns[i] / 1000.0);
+    g_message("Battmon:   %s histogram (us):%s", apcTimeNames[i], line->str);
+  }
+
+  /* Oldest first */
+  g_string_truncate(line, 0);
+  for (i = 0; i < STATS_RECENT; i++) {
+    poRecent = &poStats->aoRecent[(poStats->iRecentHead + i) % STATS_RECENT];
+    if (!poRecent->iTime_us)
+      continue;
+    g_string_append_printf(line, " %s %.1f us %" G_GINT64_FORMAT " s ago;",
+                           apcTimeNames[poRecent->eTime],
+                           poRecent->iDuration_ns / 1000.0,
+                           (now - poRecent->iTime_us) / G_USEC_PER_SEC);
+  }
+  if (line->len)
+    g_message("Battmon:   recent:%s", line->str);
+  g_string_free(line, TRUE);
+}
@@ -0,0 +1,89 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Counters and latency histograms of the update path
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef BATTMON_STATS_H
+#define BATTMON_STATS_H
+
+#include <stdint.h>
+
+/* Recording costs a clock read and a few increments per update, the
+   formatting is only done when somebody asks for it with
+   "xfce4-panel --plugin-event=<plugin>:stats:bool:true" */
+
+typedef enum statscount_t {
+  StatsCount_Ticks,          /* Timer expirations */
+  StatsCount_Events,         /* power_supply uevents and attribute notifies */
+  StatsCount_Refreshes,      /* Requests, debounced into updates */
+  StatsCount_Updates,        /* Calls to DisplayBatteryLevel() */
+  StatsCount_UpdatesSkipped, /* Updates that found nothing to change */
+  StatsCount_Coalesced,      /* Update requests served by another's sample */
+  StatsCount_Syscalls,       /* Issued by the sysfs readers */
+  StatsCount_FailedOpens,    /* sysfs attributes that could not be opened */
+  StatsCount_Hung,           /* sysfs attributes found hung, then retried */
+  StatsCount_Max
+} statscount_t;
+
+typedef enum statstime_t {
+  StatsTime_Sample, /* Reading sysfs */
+  StatsTime_Render, /* Building and applying the view */
+  StatsTime_Startup, /* battmon_construct(), once per instance */
+  StatsTime_FirstSample, /* From construction to the first sample shown */
+  StatsTime_Max
+} statstime_t;
+
+/* Bucket i holds durations below 2^(i + 9) ns (512 ns, 1 us, 2 us, ...),
+   the last one everything from about 67 ms */
+#define STATS_BUCKETS 19
+/* Most recent durations, to see what the last minutes looked like */
+#define STATS_RECENT 32
+
+typedef struct statsrecent_t {
+  int64_t iTime_us; /* Monotonic clock */
+  uint32_t iDuration_ns;
+  uint8_t eTime; /* statstime_t */
+} statsrecent_t;
+
+typedef struct stats_t {
+  uint64_t aiCounts[StatsCount_Max];
+  uint32_t aaiBuckets[StatsTime_Max][STATS_BUCKETS];
+  uint64_t aiMax_ns[StatsTime_Max];
+  uint64_t aiTotal_ns[StatsTime_Max];
+  statsrecent_t aoRecent[STATS_RECENT];
+  int iRecentHead; /* Where the next duration goes */
+  int64_t iSince_us;
+} stats_t;
+
+void stats_reset(stats_t *poStats);
+
+static inline void stats_count(stats_t *poStats, statscount_t eCount,
+                               unsigned int n) {
+  poStats->aiCounts[eCount] += n;
+}
+
+/* Returns the start time to hand to stats_end() */
+int64_t stats_begin(void);
+void stats_end(stats_t *poStats, statstime_t eTime, int64_t iStart_ns);
+/* For durations measured elsewhere, e.g. on another thread */
+void stats_add(stats_t *poStats, statstime_t eTime, int64_t iDuration_ns);
+
+/* Write everything to the log */
+void stats_log(const stats_t *poStats);
+
+#endif /* BATTMON_STATS_H */
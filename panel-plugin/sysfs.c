@@ -0,0 +1,495 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Reading the battery from /sys/class/power_supply
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include <libxfce4util/libxfce4util.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sysfs.h"
+
+typedef enum sysfsattr_t {
+  SysfsAttr_Capacity,
+  SysfsAttr_Status,
+  SysfsAttr_Now,
+  SysfsAttr_Full,
+  SysfsAttr_Rate,
+  SysfsAttr_Max
+} sysfsattr_t;
+
+/* Attributes plus the uevent file, for the hung attribute bookkeeping */
+#define SLOT_UEVENT SysfsAttr_Max
+#define SLOT_NONE -1
+
+/* Attribute names for each family, indexed by sysfsattr_t */
+static const char *const aapcFamilyAttrs[][SysfsAttr_Max] = {
+  [SysfsFamily_None] = {"capacity", "status", NULL, NULL, NULL},
+  [SysfsFamily_Charge] = {"capacity", "status", "charge_now", "charge_full",
+                          "current_now"},
+  [SysfsFamily_Energy] = {"capacity", "status", "energy_now", "energy_full",
+                          "power_now"},
+};
+
+/* The same values as they appear in the uevent file. Keys of a family are
+   only taken if the probe picked it, SysfsFamily_None ones always */
+static const struct {
+  const char *pcKey;
+  size_t iKeyLen;
+  sysfsattr_t eAttr;
+  sysfsfamily_t eFamily;
+} aoUeventKeys[] = {
+#define UEVENT_KEY(k, a, f)                                                    \
+  { "POWER_SUPPLY_" k "=", sizeof("POWER_SUPPLY_" k), a, f }
+  UEVENT_KEY("STATUS", SysfsAttr_Status, SysfsFamily_None),
+  UEVENT_KEY("CAPACITY", SysfsAttr_Capacity, SysfsFamily_None),
+  UEVENT_KEY("CHARGE_NOW", SysfsAttr_Now, SysfsFamily_Charge),
+  UEVENT_KEY("ENERGY_NOW", SysfsAttr_Now, SysfsFamily_Energy),
+  UEVENT_KEY("CHARGE_FULL", SysfsAttr_Full, SysfsFamily_Charge),
+  UEVENT_KEY("ENERGY_FULL", SysfsAttr_Full, SysfsFamily_Energy),
+  UEVENT_KEY("CURRENT_NOW", SysfsAttr_Rate, SysfsFamily_Charge),
+  UEVENT_KEY("POWER_NOW", SysfsAttr_Rate, SysfsFamily_Energy),
+#undef UEVENT_KEY
+};
+
+/* sysfs attributes never exceed a page */
+#define UEVENT_FILE_SIZE 4096
+
+struct sysfs_t {
+  char *acDir; /* e.g. /sys/class/power_supply/BAT0 */
+  int bPresent;
+  sysfsfamily_t eFamily;
+  /* Descriptor of every attribute found by the probe, -1 if missing. They
+     stay open and are re-read with pread() so that a sample costs one
+     syscall per attribute and no allocation */
+  int aiFds[SysfsAttr_Max];
+  /* The uevent file carries all of the above. When the driver provides it,
+     it is the only descriptor kept open and a sample is a single read */
+  int iUeventFd;
+  unsigned int iSyscalls;
+  unsigned int iFailedOpens;
+  /* Shared with sysfs_mark_hung(), which may run on another thread while a
+     read blocks. Slots are sysfsattr_t or SLOT_UEVENT */
+  gint iReading; /* Slot being read, SLOT_NONE between reads */
+  gint iHungMask;
+  /* Slots already closed because of iHungMask, they are opened again by
+     the next probe. One is forced after iRetry samples */
+  int iDropped;
+  unsigned int iRetry;
+  unsigned int iHung;
+};
+
+static int AttrExists(const sysfs_t *poSysfs, const char *attr) {
+  char path[PATH_MAX];
+
+  sysfs_get_path(poSysfs, attr, path, sizeof(path));
+  return access(path, R_OK) == 0;
+}
+
+static int OpenAttr(sysfs_t *poSysfs, const char *attr) {
+  char path[PATH_MAX];
+  int fd;
+
+  sysfs_get_path(poSysfs, attr, path, sizeof(path));
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  /* Attributes the driver does not provide are expected */
+  if (fd < 0 && errno != ENOENT)
+    poSysfs->iFailedOpens++;
+  return fd;
+}
+
+static void CloseAttrs(sysfs_t *poSysfs) {
+  int i;
+
+  for (i = 0; i < SysfsAttr_Max; i++) {
+    if (poSysfs->aiFds[i] >= 0)
+      close(poSysfs->aiFds[i]);
+    poSysfs->aiFds[i] = -1;
+  }
+  if (poSysfs->iUeventFd >= 0)
+    close(poSysfs->iUeventFd);
+  poSysfs->iUeventFd = -1;
+}
+
+static ssize_t ReadFd(sysfs_t *poSysfs, int iSlot, int fd, char *buf,
+                      size_t len);
+
+static int UeventUsable(sysfs_t *poSysfs) {
+  char buf[UEVENT_FILE_SIZE];
+
+  /* Timed like any other read, it may hang as well */
+  if (ReadFd(poSysfs, SLOT_UEVENT, poSysfs->iUeventFd, buf, sizeof(buf)) <= 0)
+    return 0;
+  return strstr(buf, "POWER_SUPPLY_STATUS=") != NULL;
+}
+
+static void OpenAttrs(sysfs_t *poSysfs) {
+  const char *const *ppcAttrs = aapcFamilyAttrs[poSysfs->eFamily];
+  int i;
+
+  for (i = 0; i < SysfsAttr_Max; i++)
+    if (ppcAttrs[i] && !(poSysfs->iDropped & (1 << i)))
+      poSysfs->aiFds[i] = OpenAttr(poSysfs, ppcAttrs[i]);
+
+  DBG("%s: family %d, capacity %d, status %d, now %d, full %d, rate %d",
+      poSysfs->acDir, poSysfs->eFamily,
+      poSysfs->aiFds[SysfsAttr_Capacity] >= 0,
+      poSysfs->aiFds[SysfsAttr_Status] >= 0, poSysfs->aiFds[SysfsAttr_Now] >= 0,
+      poSysfs->aiFds[SysfsAttr_Full] >= 0, poSysfs->aiFds[SysfsAttr_Rate] >= 0);
+}
+
+void sysfs_probe(sysfs_t *poSysfs) {
+  CloseAttrs(poSysfs);
+  /* Give whatever hung another chance */
+  poSysfs->iDropped = 0;
+  g_atomic_int_set(&poSysfs->iHungMask, 0);
+  /* Without uevents this runs on every tick while there is no battery */
+  poSysfs->iSyscalls++;
+  poSysfs->bPresent = g_file_test(poSysfs->acDir, G_FILE_TEST_IS_DIR);
+  poSysfs->eFamily = SysfsFamily_None;
+  if (!poSysfs->bPresent)
+    return;
+
+  if (AttrExists(poSysfs, "charge_now"))
+    poSysfs->eFamily = SysfsFamily_Charge;
+  else if (AttrExists(poSysfs, "energy_now"))
+    poSysfs->eFamily = SysfsFamily_Energy;
+
+  poSysfs->iUeventFd = OpenAttr(poSysfs, "uevent");
+  if (poSysfs->iUeventFd >= 0 && UeventUsable(poSysfs)) {
+    DBG("%s: family %d, sampling from uevent", poSysfs->acDir,
+        poSysfs->eFamily);
+    return;
+  }
+  if (poSysfs->iUeventFd >= 0)
+    close(poSysfs->iUeventFd);
+  poSysfs->iUeventFd = -1;
+
+  OpenAttrs(poSysfs);
+}
+
+sysfs_t *sysfs_new(const char *root, const char *battery) {
+  sysfs_t *poSysfs;
+  int i;
+
+  poSysfs = g_new0(sysfs_t, 1);
+  poSysfs->acDir = g_build_filename(root, battery, NULL);
+  for (i = 0; i < SysfsAttr_Max; i++)
+    poSysfs->aiFds[i] = -1;
+  poSysfs->iUeventFd = -1;
+  poSysfs->iReading = SLOT_NONE;
+  return poSysfs;
+}
+
+void sysfs_free(sysfs_t *poSysfs) {
+  if (!poSysfs)
+    return;
+
+  CloseAttrs(poSysfs);
+  g_free(poSysfs->acDir);
+  g_free(poSysfs);
+}
+
+int sysfs_is_present(const sysfs_t *poSysfs) {
+  return poSysfs->bPresent;
+}
+
+sysfsfamily_t sysfs_get_family(const sysfs_t *poSysfs) {
+  return poSysfs->eFamily;
+}
+
+const char *sysfs_get_path(const sysfs_t *poSysfs, const char *attr,
+                           char *buf, size_t len) {
+  snprintf(buf, len, "%s/%s", poSysfs->acDir, attr);
+  return buf;
+}
+
+static ssize_t ReadFd(sysfs_t *poSysfs, int iSlot, int fd, char *buf,
+                      size_t len) {
+  gint64 iStart_us;
+  ssize_t n;
+
+  poSysfs->iSyscalls++;
+  g_atomic_int_set(&poSysfs->iReading, iSlot);
+  iStart_us = g_get_monotonic_time();
+  n = pread(fd, buf, len - 1, 0);
+  if (g_get_monotonic_time() - iStart_us > SYSFS_HUNG_US)
+    g_atomic_int_or(&poSysfs->iHungMask, 1 << iSlot);
+  g_atomic_int_set(&poSysfs->iReading, SLOT_NONE);
+  if (n < 0) {
+    /* The battery was removed under us. Drop the stale descriptors, they
+       are opened again by the probe that follows the re-insertion */
+    if (errno == ENODEV || errno == ENOENT) {
+      CloseAttrs(poSysfs);
+      poSysfs->bPresent = 0;
+    }
+    return -1;
+  }
+
+  buf[n] = '\0';
+  return n;
+}
+
+static ssize_t ReadAttr(sysfs_t *poSysfs, sysfsattr_t eAttr, char *buf,
+                        size_t len) {
+  if (poSysfs->aiFds[eAttr] < 0)
+    return -1;
+  return ReadFd(poSysfs, eAttr, poSysfs->aiFds[eAttr], buf, len);
+}
+
+static long ParseLong(const char *buf) {
+  const char *p = buf;
+  long val = 0;
+  int neg = 0;
+
+  if (*p == '-') {
+    neg = 1;
+    p++;
+  }
+  if (*p < '0' || *p > '9')
+    return -1;
+  while (*p >= '0' && *p <= '9') {
+    if (val > (LONG_MAX - 9) / 10)
+      return -1;
+    val = val * 10 + (*p++ - '0');
+  }
+  return neg ? -val : val;
+}
+
+static battstatus_t ParseStatus(const char *buf) {
+  size_t len = strcspn(buf, "\n");
+
+  if (len == 4 && strncmp(buf, "Full", len) == 0)
+    return BattStatus_Full;
+  else if (len == 8 && strncmp(buf, "Charging", len) == 0)
+    return BattStatus_Charging;
+  else if (len == 11 && strncmp(buf, "Discharging", len) == 0)
+    return BattStatus_Discharging;
+  return BattStatus_Unknown;
+}
+
+static long ReadLong(sysfs_t *poSysfs, sysfsattr_t eAttr) {
+  char buf[32];
+
+  if (ReadAttr(poSysfs, eAttr, buf, sizeof(buf)) <= 0)
+    return -1;
+  return ParseLong(buf);
+}
+
+static void SampleAttrs(sysfs_t *poSysfs, battsample_t *poSample) {
+  char status[32];
+  long val;
+
+  if (ReadAttr(poSysfs, SysfsAttr_Status, status, sizeof(status)) < 0)
+    return;
+  poSample->eStatus = ParseStatus(status);
+
+  val = ReadLong(poSysfs, SysfsAttr_Capacity);
+  poSample->iPercent = val < 0 ? 0 : (int)val;
+  poSample->lNow = ReadLong(poSysfs, SysfsAttr_Now);
+  poSample->lFull = ReadLong(poSysfs, SysfsAttr_Full);
+  poSample->lRate = ReadLong(poSysfs, SysfsAttr_Rate);
+}
+
+static void ParseUeventLine(const char *line, sysfsfamily_t eFamily,
+                            battsample_t *poSample) {
+  const char *value;
+  size_t i;
+  long val;
+
+  for (i = 0; i < G_N_ELEMENTS(aoUeventKeys); i++) {
+    if (strncmp(line, aoUeventKeys[i].pcKey, aoUeventKeys[i].iKeyLen) == 0)
+      break;
+  }
+  if (i == G_N_ELEMENTS(aoUeventKeys))
+    return;
+  /* Drivers with both families would otherwise mix their units */
+  if (aoUeventKeys[i].eFamily != SysfsFamily_None &&
+      aoUeventKeys[i].eFamily != eFamily)
+    return;
+
+  value = line + aoUeventKeys[i].iKeyLen;
+  if (aoUeventKeys[i].eAttr == SysfsAttr_Status) {
+    poSample->eStatus = ParseStatus(value);
+    return;
+  }
+
+  val = ParseLong(value);
+  switch (aoUeventKeys[i].eAttr) {
+  case SysfsAttr_Capacity:
+    poSample->iPercent = val < 0 ? 0 : (int)val;
+    break;
+  case SysfsAttr_Now:
+    poSample->lNow = val;
+    break;
+  case SysfsAttr_Full:
+    poSample->lFull = val;
+    break;
+  case SysfsAttr_Rate:
+    poSample->lRate = val;
+    break;
+  default:
+    break;
+  }
+}
+
+static void SampleUevent(sysfs_t *poSysfs, battsample_t *poSample) {
+  char buf[UEVENT_FILE_SIZE];
+  char *line, *next;
+
+  if (ReadFd(poSysfs, SLOT_UEVENT, poSysfs->iUeventFd, buf, sizeof(buf)) <= 0)
+    return;
+
+  for (line = buf; line; line = next) {
+    if ((next = strchr(line, '\n')))
+      *next++ = '\0';
+    ParseUeventLine(line, poSysfs->eFamily, poSample);
+  }
+}
+
+static long ReadOnce(sysfs_t *poSysfs, const char *attr)
+/* For attributes that are too rarely needed to keep open */
+{
+  char buf[32];
+  ssize_t n;
+  int fd;
+
+  if ((fd = OpenAttr(poSysfs, attr)) < 0)
+    return -1;
+  poSysfs->iSyscalls += 3;
+  n = pread(fd, buf, sizeof(buf) - 1, 0);
+  close(fd);
+  if (n <= 0)
+    return -1;
+  buf[n] = '\0';
+  return ParseLong(buf);
+}
+
+void sysfs_read_details(sysfs_t *poSysfs, battdetails_t *poDetails) {
+  long val;
+
+  poDetails->bCharge = poSysfs->eFamily == SysfsFamily_Charge;
+  poDetails->lFullDesign = poDetails->lVoltage = -1;
+  poDetails->iCycles = -1;
+  if (!poSysfs->bPresent)
+    return;
+
+  if (poSysfs->eFamily != SysfsFamily_None)
+    poDetails->lFullDesign =
+        ReadOnce(poSysfs, poDetails->bCharge ? "charge_full_design"
+                                             : "energy_full_design");
+  poDetails->lVoltage = ReadOnce(poSysfs, "voltage_now");
+  val = ReadOnce(poSysfs, "cycle_count");
+  /* Many firmwares report 0 when they do not count */
+  poDetails->iCycles = val > 0 ? (int)val : -1;
+}
+
+static void DropHung(sysfs_t *poSysfs)
+/* Close what was found hanging since the last sample */
+{
+  int iNew = g_atomic_int_get(&poSysfs->iHungMask) & ~poSysfs->iDropped;
+  int i;
+
+  if (!iNew)
+    return;
+  poSysfs->iDropped |= iNew;
+  poSysfs->iHung += __builtin_popcount(iNew);
+  poSysfs->iRetry = SYSFS_HUNG_RETRY;
+
+  for (i = 0; i < SysfsAttr_Max; i++) {
+    if (!(iNew & (1 << i)) || poSysfs->aiFds[i] < 0)
+      continue;
+    g_warning("Battmon: %s/%s hangs, leaving it alone for a while",
+              poSysfs->acDir, aapcFamilyAttrs[poSysfs->eFamily][i]);
+    close(poSysfs->aiFds[i]);
+    poSysfs->aiFds[i] = -1;
+  }
+
+  /* Reading the uevent file reads every attribute. Fall back to the
+     individual ones so that only the culprit is lost */
+  if ((iNew & (1 << SLOT_UEVENT)) && poSysfs->iUeventFd >= 0) {
+    g_warning("Battmon: %s/uevent hangs, reading attributes instead",
+              poSysfs->acDir);
+    close(poSysfs->iUeventFd);
+    poSysfs->iUeventFd = -1;
+    OpenAttrs(poSysfs);
+  }
+}
+
+void sysfs_sample(sysfs_t *poSysfs, battsample_t *poSample) {
+  if (poSysfs->iDropped && --poSysfs->iRetry == 0) {
+    DBG("%s: trying hung attributes again", poSysfs->acDir);
+    sysfs_probe(poSysfs);
+  }
+  DropHung(poSysfs);
+
+  poSample->eStatus = BattStatus_NoBatt;
+  poSample->iPercent = 0;
+  poSample->lNow = poSample->lFull = poSample->lRate = -1;
+  poSample->bCharge = poSysfs->eFamily == SysfsFamily_Charge;
+
+  if (!poSysfs->bPresent)
+    return;
+
+  if (poSysfs->iUeventFd >= 0)
+    SampleUevent(poSysfs, poSample);
+  else
+    SampleAttrs(poSysfs, poSample);
+}
+
+unsigned int sysfs_take_syscalls(sysfs_t *poSysfs) {
+  unsigned int n = poSysfs->iSyscalls;
+
+  poSysfs->iSyscalls = 0;
+  return n;
+}
+
+unsigned int sysfs_take_failed_opens(sysfs_t *poSysfs) {
+  unsigned int n = poSysfs->iFailedOpens;
+
+  poSysfs->iFailedOpens = 0;
+  return n;
+}
+
+unsigned int sysfs_take_hung(sysfs_t *poSysfs) {
+  unsigned int n = poSysfs->iHung;
+
+  poSysfs->iHung = 0;
+  return n;
+}
+
+int sysfs_mark_hung(sysfs_t *poSysfs) {
+  gint iSlot = g_atomic_int_get(&poSysfs->iReading);
+
+  if (iSlot == SLOT_NONE)
+    return 0;
+  g_atomic_int_or(&poSysfs->iHungMask, 1 << iSlot);
+  return 1;
+}
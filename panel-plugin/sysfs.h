@@ -0,0 +1,88 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Reading the battery from /sys/class/power_supply
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef BATTMON_SYSFS_H
+#define BATTMON_SYSFS_H
+
+#include <stddef.h>
+
+#include "battery.h"
+
+/* Which set of attributes the battery is read with, either
+   charge_now/charge_full/current_now (uAh, uA) or
+   energy_now/energy_full/power_now (uWh, uW). Some drivers, e.g. bq27xxx,
+   report both, only the one the probe picked is ever used */
+typedef enum sysfsfamily_t {
+  SysfsFamily_None,
+  SysfsFamily_Charge,
+  SysfsFamily_Energy
+} sysfsfamily_t;
+
+typedef struct sysfs_t sysfs_t;
+
+/* A read taking longer than this marks the attribute as hung. It is closed
+   and left alone from the next sample on, until the next probe or for
+   SYSFS_HUNG_RETRY samples. Firmware often stalls only once, e.g. right
+   after a resume */
+#define SYSFS_HUNG_US (1000 * 1000)
+#define SYSFS_HUNG_RETRY 32
+
+/* Does not touch the battery yet, sysfs_probe() has to follow */
+sysfs_t *sysfs_new(const char *root, const char *battery);
+void sysfs_free(sysfs_t *poSysfs);
+
+/* Find out which attributes exist and open them. Called once after
+   creation and again whenever the battery is added or removed. Attributes
+   found missing here are not touched by the readers below, the others are
+   kept open until the next probe */
+void sysfs_probe(sysfs_t *poSysfs);
+
+int sysfs_is_present(const sysfs_t *poSysfs);
+sysfsfamily_t sysfs_get_family(const sysfs_t *poSysfs);
+const char *sysfs_get_path(const sysfs_t *poSysfs, const char *attr,
+                           char *buf, size_t len);
+
+/* Read the current state of the battery. Uses a single read of the uevent
+   file when the driver provides one, the individual attributes otherwise.
+   Reads may block for as long as the firmware takes, this is best called
+   off the main loop. Everything but sysfs_get_path() and sysfs_mark_hung()
+   must be called from the thread that samples */
+void sysfs_sample(sysfs_t *poSysfs, battsample_t *poSample);
+
+/* Read the attributes in battdetails_t. They are opened, read and closed
+   again on every call */
+void sysfs_read_details(sysfs_t *poSysfs, battdetails_t *poDetails);
+
+/* Number of system calls issued by the readers since the last call */
+unsigned int sysfs_take_syscalls(sysfs_t *poSysfs);
+
+/* Number of attributes that exist but could not be opened since the last
+   call */
+unsigned int sysfs_take_failed_opens(sysfs_t *poSysfs);
+
+/* Number of attributes found hung since the last call */
+unsigned int sysfs_take_hung(sysfs_t *poSysfs);
+
+/* Mark whatever attribute sysfs_sample() is blocked on right now as hung.
+   Meant to be called from another thread than the one sampling, returns 0
+   if no read was in progress */
+int sysfs_mark_hung(sysfs_t *poSysfs);
+
+#endif /* BATTMON_SYSFS_H */
@@ -0,0 +1,192 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Stress test of the shared memory seqlock
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Not part of the plugin, "make check" runs it. Reader processes copy
+   snapshots of the segment the way external tools do while the writer
+   updates it as fast as it can. Every field of an update is derived from
+   one counter, a snapshot that mixes two updates is caught. Tearing only
+   shows with more than one CPU, with a single one an update is seldom
+   interrupted after its first field. Skipped if there is no /dev/shm */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "battery.h"
+#include "battshm.h"
+#include "publish.h"
+
+#define READERS 8
+#define RUN_US (1000 * 1000)
+
+static void MakeSample(uint32_t k, battsample_t *poSample) {
+  poSample->eStatus = (battstatus_t)(k % 5);
+  poSample->iPercent = k % 101;
+  poSample->lNow = k;
+  poSample->lFull = 2 * (long)k;
+  poSample->lRate = 3 * (long)k;
+}
+
+static int Consistent(const battshm_t *poShm) {
+  uint32_t k = (uint32_t)poShm->iNow;
+
+  return poShm->iStatus == (int32_t)(k % 5) &&
+         poShm->iPercent == (int32_t)(k % 101) &&
+         poShm->iFull == 2 * (int64_t)k && poShm->iRate == 3 * (int64_t)k &&
+         poShm->iMinutes == (int32_t)k;
+}
+
+static int Read(const char *path)
+/* In a reader process, returns its exit status */
+{
+  const battshm_t *poShm;
+  battshm_t oSnap;
+  unsigned long iGood = 0, iBusy = 0, iTorn = 0;
+  int64_t iEnd_us = g_get_monotonic_time() + RUN_US;
+  uint32_t iLastSeq = 0;
+  void *pv;
+  int fd;
+
+  if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0 ||
+      (pv = mmap(NULL, sizeof(battshm_t), PROT_READ, MAP_SHARED, fd, 0)) ==
+          MAP_FAILED) {
+    perror(path);
+    return 1;
+  }
+  close(fd);
+  poShm = (const battshm_t *)pv;
+
+  while (g_get_monotonic_time() < iEnd_us) {
+    if (!battshm_read(poShm, &oSnap)) {
+      iBusy++;
+      continue;
+    }
+    /* Not from the middle of an update, consistent, and never older than
+       one seen before */
+    if ((oSnap.iSeq & 1) || !Consistent(&oSnap) || oSnap.iSeq < iLastSeq)
+      iTorn++;
+    else
+      iGood++;
+    iLastSeq = oSnap.iSeq;
+  }
+
+  printf("reader %d: %lu snapshots, %lu retried too often, %lu torn\n",
+         (int)getpid(), iGood, iBusy, iTorn);
+  fflush(stdout);
+  munmap(pv, sizeof(battshm_t));
+  return iTorn == 0 && iGood > 0 ? 0 : 1;
+}
+
+static int Planted(const char *path) {
+  char *other = g_strdup_printf("%s.other", path);
+  char *battery = g_strdup_printf("test-%d-planted", (int)getpid());
+  char *planted = g_strdup_printf("%s/%s%u-%s", BATTSHM_DIR, BATTSHM_PREFIX,
+                                  (unsigned int)getuid(), battery);
+  publish_t *poPub = NULL;
+  int fd;
+
+  if ((fd = open(other, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644)) >= 0) {
+    close(fd);
+    if (link(other, planted) == 0)
+      poPub = publish_open(battery);
+    else
+      perror(planted);
+  }
+  unlink(planted);
+  unlink(other);
+  if (poPub) {
+    fprintf(stderr, "%s: published although it has another name\n",
+            planted);
+    publish_close(poPub);
+  }
+  g_free(planted);
+  g_free(battery);
+  g_free(other);
+  return fd >= 0 && !poPub;
+}
+
+int main(int argc, char **argv) {
+  char *battery, *path;
+  publish_t *poPub;
+  battsample_t oSample;
+  uint32_t k = 0;
+  int i, iLive, iStatus, bOK = 1;
+  pid_t pid;
+
+  battery = g_strdup_printf("test-%d", (int)getpid());
+  if (!(poPub = publish_open(battery))) {
+    printf("no shared memory, skipped\n");
+    g_free(battery);
+    return 77;
+  }
+  path = g_strdup_printf("%s/%s%u-%s", BATTSHM_DIR, BATTSHM_PREFIX,
+                         (unsigned int)getuid(), battery);
+
+  /* A segment planted under a second name, e.g. by another user who can
+     then shrink it, is not taken over */
+  if (!Planted(path)) {
+    publish_close(poPub);
+    g_free(path);
+    g_free(battery);
+    return 1;
+  }
+
+  /* Readers find a valid segment right away */
+  MakeSample(++k, &oSample);
+  publish_update(poPub, &oSample, (int)k);
+  fflush(stdout);
+
+  for (i = 0; i < READERS; i++) {
+    if ((pid = fork()) == 0)
+      _exit(Read(path));
+    if (pid < 0) {
+      perror("fork");
+      bOK = 0;
+      break;
+    }
+  }
+  iLive = i;
+
+  while (iLive > 0) {
+    for (i = 0; i < 1000; i++) {
+      MakeSample(++k, &oSample);
+      publish_update(poPub, &oSample, (int)k);
+    }
+    while ((pid = waitpid(-1, &iStatus, WNOHANG)) > 0) {
+      iLive--;
+      if (!WIFEXITED(iStatus) || WEXITSTATUS(iStatus) != 0)
+        bOK = 0;
+    }
+  }
+  printf("writer: %u updates\n", k);
+
+  publish_close(poPub);
+  g_free(path);
+  g_free(battery);
+  return bOK ? 0 : 1;
+}
@@ -0,0 +1,254 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Test of the D-Bus export on a private bus
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Not part of the plugin, "make check" runs it. A private dbus-daemon is
+   started as the session bus, a client on its own connection reads the
+   exported properties and listens to their changes. Skipped if there is
+   no dbus-daemon to start */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gio/gio.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "battery.h"
+#include "busexport.h"
+
+#define EXPORT_NAME "org.xfce.Battmon.BAT0"
+#define EXPORT_PATH "/org/xfce/Battmon"
+#define EXPORT_IFACE "org.xfce.Battmon.Battery"
+#define PROPERTIES "org.freedesktop.DBus.Properties"
+#define TIMEOUT_S 5
+
+typedef struct test_t {
+  int bOwned;
+  GVariant *poProps;   /* Of the last GetAll */
+  int bReplied;
+  GVariant *poChanged; /* Of the last PropertiesChanged */
+  int iChanges;
+  int bTimedOut;
+} test_t;
+
+static void OnAppeared(GDBusConnection *conn, const gchar *name,
+                       const gchar *owner, gpointer data) {
+  ((test_t *)data)->bOwned = 1;
+}
+
+static void OnChanged(GDBusConnection *conn, const gchar *sender,
+                      const gchar *path, const gchar *iface,
+                      const gchar *signal, GVariant *params, gpointer data) {
+  test_t *poTest = (test_t *)data;
+
+  if (poTest->poChanged)
+    g_variant_unref(poTest->poChanged);
+  poTest->poChanged = g_variant_get_child_value(params, 1);
+  poTest->iChanges++;
+}
+
+static void OnGetAll(GObject *source, GAsyncResult *res, gpointer data) {
+  test_t *poTest = (test_t *)data;
+  GVariant *poReply;
+
+  /* NULL until the object is registered */
+  poReply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res,
+                                          NULL);
+  if (poReply) {
+    poTest->poProps = g_variant_get_child_value(poReply, 0);
+    g_variant_unref(poReply);
+  }
+  poTest->bReplied = 1;
+}
+
+static gboolean OnTimeout(gpointer data) {
+  ((test_t *)data)->bTimedOut = 1;
+  return G_SOURCE_REMOVE;
+}
+
+/* Runs the loop until *pbDone is set or for iWait_ms, returns *pbDone */
+static int Run(test_t *poTest, const int *pbDone, unsigned int iWait_ms) {
+  unsigned int iTimeoutId;
+
+  poTest->bTimedOut = 0;
+  iTimeoutId = g_timeout_add(iWait_ms, OnTimeout, poTest);
+  while (!*pbDone && !poTest->bTimedOut)
+    g_main_context_iteration(NULL, TRUE);
+  if (!poTest->bTimedOut)
+    g_source_remove(iTimeoutId);
+  return *pbDone;
+}
+
+static int GetAll(test_t *poTest, GDBusConnection *poClient) {
+  int i;
+
+  /* The exporter registers the object when it hears about the name, which
+     may be after the client does */
+  for (i = 0; i < 50 && !poTest->poProps; i++) {
+    poTest->bReplied = 0;
+    g_dbus_connection_call(poClient, EXPORT_NAME, EXPORT_PATH, PROPERTIES,
+                           "GetAll", g_variant_new("(s)", EXPORT_IFACE),
+                           G_VARIANT_TYPE("(a{sv})"), G_DBUS_CALL_FLAGS_NONE,
+                           -1, NULL, OnGetAll, poTest);
+    if (!Run(poTest, &poTest->bReplied, TIMEOUT_S * 1000))
+      break;
+    if (!poTest->poProps)
+      g_usleep(20 * 1000);
+  }
+  return poTest->poProps != NULL;
+}
+
+static int CheckInt(GVariant *poDict, const char *key, const char *type,
+                    gint64 iExpected) {
+  gint64 v = G_MININT64;
+  gint32 i;
+
+  if (strcmp(type, "i") == 0) {
+    if (g_variant_lookup(poDict, key, "i", &i))
+      v = i;
+  } else {
+    g_variant_lookup(poDict, key, "x", &v);
+  }
+  if (v != iExpected) {
+    fprintf(stderr, "%s: %" G_GINT64_FORMAT ", expected %" G_GINT64_FORMAT
+            "\n", key, v, iExpected);
+    return 0;
+  }
+  return 1;
+}
+
+static int CheckString(GVariant *poDict, const char *key,
+                       const char *acExpected) {
+  const char *pc = NULL;
+
+  g_variant_lookup(poDict, key, "&s", &pc);
+  if (g_strcmp0(pc, acExpected) != 0) {
+    fprintf(stderr, "%s: %s, expected %s\n", key, pc ? pc : "(none)",
+            acExpected);
+    return 0;
+  }
+  return 1;
+}
+
+int main(int argc, char **argv) {
+  GTestDBus *poBus;
+  GDBusConnection *poClient;
+  busexport_t *poExp, *poSecond;
+  battsample_t oSample = { BattStatus_Discharging, 57, 28500000, 50000000,
+                           12500000, 0 };
+  test_t oTest = { 0 };
+  unsigned int iWatchId = 0;
+  int bNever = 0, bOK = 0;
+  char *pc;
+
+  if (!(pc = g_find_program_in_path("dbus-daemon"))) {
+    printf("no dbus-daemon, skipped\n");
+    return 77;
+  }
+  g_free(pc);
+
+  poBus = g_test_dbus_new(G_TEST_DBUS_NONE);
+  g_test_dbus_up(poBus);
+
+  /* Remembered until the name is acquired */
+  poExp = busexport_open("BAT0");
+  busexport_update(poExp, &oSample, BattLevel_OK, 90);
+
+  poClient = g_dbus_connection_new_for_address_sync(
+      g_test_dbus_get_bus_address(poBus),
+      G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+          G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+      NULL, NULL, NULL);
+  if (!poClient) {
+    fprintf(stderr, "cannot connect to the private bus\n");
+    goto done;
+  }
+  /* The match is in place once any later call has been answered */
+  g_dbus_connection_signal_subscribe(
+      poClient, EXPORT_NAME, PROPERTIES, "PropertiesChanged", EXPORT_PATH,
+      EXPORT_IFACE, G_DBUS_SIGNAL_FLAGS_NONE, OnChanged, &oTest, NULL);
+  iWatchId = g_bus_watch_name_on_connection(poClient, EXPORT_NAME,
+                                            G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                            OnAppeared, NULL, &oTest, NULL);
+  if (!Run(&oTest, &oTest.bOwned, TIMEOUT_S * 1000)) {
+    fprintf(stderr, "%s never owned\n", EXPORT_NAME);
+    goto done;
+  }
+
+  /* A second instance of the same battery stays out of the way, also when
+     it goes */
+  poSecond = busexport_open("BAT0");
+  busexport_close(poSecond);
+
+  if (!GetAll(&oTest, poClient)) {
+    fprintf(stderr, "GetAll: no answer\n");
+    goto done;
+  }
+  if (!CheckInt(oTest.poProps, "Percent", "i", 57) ||
+      !CheckString(oTest.poProps, "Status", "discharging") ||
+      !CheckString(oTest.poProps, "Level", "ok") ||
+      !CheckInt(oTest.poProps, "TimeToEmpty", "x", 90 * 60) ||
+      !CheckInt(oTest.poProps, "TimeToFull", "x", -1) ||
+      !CheckInt(oTest.poProps, "Rate", "x", 12500000) ||
+      !CheckString(oTest.poProps, "RateUnit", "uW"))
+    goto done;
+
+  /* Nothing new, nothing said */
+  busexport_update(poExp, &oSample, BattLevel_OK, 90);
+  Run(&oTest, &bNever, 200);
+  if (oTest.iChanges != 0) {
+    fprintf(stderr, "unchanged update: %d signals\n", oTest.iChanges);
+    goto done;
+  }
+
+  /* Only what changed */
+  oSample.iPercent = 56;
+  busexport_update(poExp, &oSample, BattLevel_OK, 90);
+  if (!Run(&oTest, &oTest.iChanges, TIMEOUT_S * 1000)) {
+    fprintf(stderr, "change: no signal\n");
+    goto done;
+  }
+  if (g_variant_n_children(oTest.poChanged) != 1 ||
+      !CheckInt(oTest.poChanged, "Percent", "i", 56)) {
+    pc = g_variant_print(oTest.poChanged, TRUE);
+    fprintf(stderr, "change: %s, expected only Percent 56\n", pc);
+    g_free(pc);
+    goto done;
+  }
+
+  printf("export: properties read back, changes signalled alone\n");
+  bOK = 1;
+
+done:
+  busexport_close(poExp);
+  if (poClient) {
+    g_bus_unwatch_name(iWatchId);
+    g_object_unref(poClient);
+  }
+  if (oTest.poProps)
+    g_variant_unref(oTest.poProps);
+  if (oTest.poChanged)
+    g_variant_unref(oTest.poChanged);
+  g_test_dbus_down(poBus);
+  g_object_unref(poBus);
+  return bOK ? 0 : 1;
+}
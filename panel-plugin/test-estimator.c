@@ -0,0 +1,162 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Simulated discharges through the time left estimator
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Not part of the plugin, "make check" runs it. A battery drained at a
+   constant power is sampled every 60 to 120 s, as the timer does on
+   battery, while the driver's power_now is exact, noisy or 0. The energy
+   is reported in firmware sized steps. Once the estimator has its ten
+   minutes of history the time left has to be right within MAX_ERROR, the
+   predicted time of empty may move by MAX_JITTER of the time left per
+   sample at most and the confidence has to be 1. Before that the
+   confidence may only grow. The jitter of a plain power_now division is
+   printed for comparison */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include <stdio.h>
+
+#include "battery.h"
+#include "estimator.h"
+
+#define FULL_UWH 50000000L
+#define POWER_UW 10000000L
+/* Many firmwares move energy_now in steps of this much */
+#define STEP_UWH 100000L
+#define MIN_SPACING_S 60
+#define MAX_SPACING_S 120
+#define DURATION_S (3 * 3600)
+#define WARMUP_S (10 * 60)
+#define MAX_ERROR 0.05
+/* 1.8 min at one hour left */
+#define MAX_JITTER 0.03
+#define SEED 4242
+
+typedef struct case_t {
+  const char *acName;
+  double dNoise; /* power_now is off by up to this fraction */
+  int bZero;     /* power_now is always 0 */
+} case_t;
+
+static const case_t aoCases[] = {
+  { "exact power_now", 0.0, 0 },
+  { "power_now +-50%", 0.5, 0 },
+  { "power_now 0", 0.0, 1 },
+};
+
+static int Simulate(const case_t *poCase, GRand *poRand) {
+  estimator_t oEst;
+  battsample_t oSample = { 0 };
+  double dHours, dConfidence, dLast = 0.0, dTrue, dError, dEmpty;
+  double dMaxError = 0.0, dMaxJitter = 0.0, dRawJitter = 0.0;
+  double dLastEmpty = -1.0, dLastRaw = -1.0;
+  int64_t iTime_s = 0;
+  long lEnergy;
+  int bOK = 1;
+
+  estimator_reset(&oEst);
+  oSample.eStatus = BattStatus_Discharging;
+  oSample.lFull = FULL_UWH;
+
+  for (iTime_s = 0; iTime_s < DURATION_S;
+       iTime_s += g_rand_int_range(poRand, MIN_SPACING_S, MAX_SPACING_S + 1)) {
+    lEnergy = FULL_UWH - (long)(POWER_UW * (iTime_s / 3600.0));
+    oSample.lNow = lEnergy - lEnergy % STEP_UWH;
+    if (poCase->bZero)
+      oSample.lRate = 0;
+    else
+      oSample.lRate = (long)(POWER_UW *
+                             (1.0 + g_rand_double_range(poRand, -poCase->dNoise,
+                                                        poCase->dNoise)));
+
+    estimator_add(&oEst, &oSample, iTime_s * 1000000);
+    estimator_get_hours(&oEst, &oSample, &dHours, &dConfidence);
+
+    if (dConfidence < 0.0 || dConfidence > 1.0 || dConfidence < dLast) {
+      fprintf(stderr, "%s: confidence %.2f after %.2f at %lds\n",
+              poCase->acName, dConfidence, dLast, (long)iTime_s);
+      bOK = 0;
+    }
+    if (!poCase->bZero && dConfidence < 0.3) {
+      fprintf(stderr, "%s: confidence %.2f at %lds with power_now given\n",
+              poCase->acName, dConfidence, (long)iTime_s);
+      bOK = 0;
+    }
+    dLast = dConfidence;
+
+    /* What a plain power_now division would show, for comparison */
+    if (oSample.lRate > 0) {
+      dEmpty = iTime_s + 3600.0 * oSample.lNow / oSample.lRate;
+      if (dLastRaw >= 0.0 && iTime_s >= WARMUP_S)
+        dRawJitter =
+            MAX(dRawJitter, ABS(dEmpty - dLastRaw) / (dEmpty - iTime_s));
+      dLastRaw = dEmpty;
+    }
+
+    if (iTime_s < WARMUP_S)
+      continue;
+
+    if (dConfidence < 1.0) {
+      fprintf(stderr, "%s: confidence %.2f at %lds\n", poCase->acName,
+              dConfidence, (long)iTime_s);
+      bOK = 0;
+    }
+    dTrue = (double)lEnergy / POWER_UW;
+    dError = ABS(dHours - dTrue) / dTrue;
+    dMaxError = MAX(dMaxError, dError);
+    dEmpty = iTime_s + 3600.0 * dHours;
+    if (dLastEmpty >= 0.0)
+      dMaxJitter =
+          MAX(dMaxJitter, ABS(dEmpty - dLastEmpty) / (3600.0 * dTrue));
+    dLastEmpty = dEmpty;
+  }
+
+  printf("%-18s %10.1f %10.1f %14.1f\n", poCase->acName, 100.0 * dMaxError,
+         100.0 * dMaxJitter, 100.0 * dRawJitter);
+  if (dMaxError > MAX_ERROR) {
+    fprintf(stderr, "%s: off by %.1f%%, at most %.1f%% allowed\n",
+            poCase->acName, 100.0 * dMaxError, 100.0 * MAX_ERROR);
+    bOK = 0;
+  }
+  if (dMaxJitter > MAX_JITTER) {
+    fprintf(stderr,
+            "%s: empty moved by %.1f%% of the time left, at most %.1f%% "
+            "allowed\n",
+            poCase->acName, 100.0 * dMaxJitter, 100.0 * MAX_JITTER);
+    bOK = 0;
+  }
+  return bOK;
+}
+
+int main(int argc, char **argv) {
+  GRand *poRand = g_rand_new_with_seed(SEED);
+  unsigned int i;
+  int bOK = 1;
+
+  printf("%-18s %10s %10s %14s\n", "driver", "error/%", "jitter/%",
+         "raw jitter/%");
+  for (i = 0; i < G_N_ELEMENTS(aoCases); i++)
+    bOK &= Simulate(&aoCases[i], poRand);
+  g_rand_free(poRand);
+  return bOK ? 0 : 1;
+}
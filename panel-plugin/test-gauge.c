@@ -0,0 +1,310 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Test that reconfiguring the gauge does not grow the process
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Not part of the plugin, "make check" runs it. Skipped without a display.
+
+   - The gauge is compared pixel by pixel with the label it replaced, styled
+     by the old p0..p20/pblue/pgray stylesheet, at every 5% step.
+   - Style recomputations per tick of both are counted while the charge
+     runs down.
+   - The font is set as often as a long session of dialog closes and
+     orientation changes would, RSS has to stay flat. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gtk/gtk.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "gauge.h"
+
+#define WARMUP 200
+#define ROUNDS 5000
+/* Allocator noise, a leak of even 100 bytes a round is way beyond it */
+#define MAX_GROWTH_KB 256
+/* A channel differing by more than this is a different pixel, text is
+   allowed to be antialiased a little differently */
+#define PIXEL_TOLERANCE 32
+#define MAX_DIFFERENT_PERCENT 2
+
+/* The label backgrounds as they were, one per 5% */
+static const char *const apcOldSteps[21] = {
+  "#FF0000", "#FF1A00", "#FF3500", "#FF5000", "#FF6B00", "#FF8600",
+  "#FFA100", "#FFBB00", "#FFD600", "#FFF100", "#F1FF00", "#D6FF00",
+  "#BBFF00", "#A1FF00", "#86FF00", "#6BFF00", "#50FF00", "#35FF00",
+  "#1AFF00", "#00FF00", "#00FF00"
+};
+
+static long GetRSS_kB(void) {
+  FILE *pf = fopen("/proc/self/statm", "r");
+  long lSize, lResident = -1;
+
+  if (pf) {
+    if (fscanf(pf, "%ld %ld", &lSize, &lResident) != 2)
+      lResident = -1;
+    fclose(pf);
+  }
+  return lResident < 0 ? -1 : lResident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static GtkWidget *NewOldLabel(void)
+/* The label and its stylesheet before the gauge, GTK 3.20 and later */
+{
+  GtkWidget *wLabel = gtk_label_new("");
+  GtkCssProvider *poCss = gtk_css_provider_new();
+  GString *css = g_string_new(
+      "label { background-color: #0000FF; padding: 4px; } "
+      "label#pblue { background-color: skyblue; } "
+      "label#pgray { background-color: darkgray; } ");
+  int i;
+
+  for (i = 0; i < 21; i++)
+    g_string_append_printf(css, "label#p%d { background-color: %s; } ", i,
+                           apcOldSteps[i]);
+  gtk_css_provider_load_from_data(poCss, css->str, -1, NULL);
+  gtk_style_context_add_provider(gtk_widget_get_style_context(wLabel),
+                                 GTK_STYLE_PROVIDER(poCss),
+                                 GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
+  g_object_unref(poCss);
+  g_string_free(css, TRUE);
+  return wLabel;
+}
+
+static void SetOldLabel(GtkWidget *wLabel, const char *text, int colour) {
+  char acName[8];
+
+  /* What the old ApplyView() did */
+  if (colour == GAUGE_COLOUR_CHARGING)
+    g_strlcpy(acName, "pblue", sizeof(acName));
+  else if (colour == GAUGE_COLOUR_UNKNOWN)
+    g_strlcpy(acName, "pgray", sizeof(acName));
+  else
+    g_snprintf(acName, sizeof(acName), "p%d", CLAMP(colour / 5, 0, 20));
+  if (strcmp(gtk_widget_get_name(wLabel), acName) != 0)
+    gtk_widget_set_name(wLabel, acName);
+  if (strcmp(gtk_label_get_text(GTK_LABEL(wLabel)), text) != 0)
+    gtk_label_set_text(GTK_LABEL(wLabel), text);
+}
+
+static GtkWidget *Offscreen(GtkWidget *widget) {
+  GtkWidget *wWindow = gtk_offscreen_window_new();
+
+  /* Realized and drawn, but never mapped on screen */
+  gtk_container_add(GTK_CONTAINER(wWindow), widget);
+  gtk_widget_show_all(wWindow);
+  return wWindow;
+}
+
+static void Settle(void) {
+  while (gtk_events_pending())
+    gtk_main_iteration();
+}
+
+static cairo_surface_t *Snapshot(GtkWidget *widget) {
+  cairo_surface_t *poSurface;
+  cairo_t *cr;
+
+  Settle();
+  poSurface = cairo_image_surface_create(
+      CAIRO_FORMAT_ARGB32, gtk_widget_get_allocated_width(widget),
+      gtk_widget_get_allocated_height(widget));
+  cr = cairo_create(poSurface);
+  gtk_widget_draw(widget, cr);
+  cairo_destroy(cr);
+  cairo_surface_flush(poSurface);
+  return poSurface;
+}
+
+static int Compare(const char *what, cairo_surface_t *poOld,
+                   cairo_surface_t *poNew)
+/* The bar rows at the bottom are the gauge's own */
+{
+  int w = cairo_image_surface_get_width(poOld);
+  int h = cairo_image_surface_get_height(poOld);
+  int x, y, c, iDiff, iMax = 0, iDifferent = 0;
+  const unsigned char *pOld, *pNew;
+
+  if (w != cairo_image_surface_get_width(poNew) ||
+      h != cairo_image_surface_get_height(poNew)) {
+    fprintf(stderr, "%s: label %dx%d, gauge %dx%d\n", what, w, h,
+            cairo_image_surface_get_width(poNew),
+            cairo_image_surface_get_height(poNew));
+    return 0;
+  }
+
+  for (y = 0; y < h - GAUGE_BAR; y++) {
+    pOld = cairo_image_surface_get_data(poOld) +
+           y * cairo_image_surface_get_stride(poOld);
+    pNew = cairo_image_surface_get_data(poNew) +
+           y * cairo_image_surface_get_stride(poNew);
+    for (x = 0; x < 4 * w; x += 4) {
+      iDiff = 0;
+      for (c = 0; c < 4; c++)
+        iDiff = MAX(iDiff, abs(pOld[x + c] - pNew[x + c]));
+      iMax = MAX(iMax, iDiff);
+      if (iDiff > PIXEL_TOLERANCE)
+        iDifferent++;
+    }
+  }
+
+  if (iDifferent * 100 > MAX_DIFFERENT_PERCENT * w * (h - GAUGE_BAR)) {
+    fprintf(stderr, "%s: %d of %d pixels differ, by up to %d\n", what,
+            iDifferent, w * (h - GAUGE_BAR), iMax);
+    return 0;
+  }
+  return 1;
+}
+
+static int CompareLook(void)
+/* Only the steps can match, in between the gauge is continuous */
+{
+  GtkWidget *wLabel = NewOldLabel();
+  GtkWidget *wLabelWindow = Offscreen(wLabel);
+  gauge_t *poGauge = gauge_new();
+  GtkWidget *wGaugeWindow = Offscreen(gauge_get_widget(poGauge));
+  cairo_surface_t *poOld, *poNew;
+  char what[32];
+  int i, colour, bOK = 1;
+
+  for (i = 0; i <= 22; i++) {
+    /* 0%, 5%, ... 100%, then the two fixed colours */
+    colour = i <= 20 ? 5 * i
+                     : (i == 21 ? GAUGE_COLOUR_CHARGING : GAUGE_COLOUR_UNKNOWN);
+    SetOldLabel(wLabel, "1:23", colour);
+    gauge_set(poGauge, "1:23", colour, i <= 20 ? colour : -1);
+    poOld = Snapshot(wLabel);
+    poNew = Snapshot(gauge_get_widget(poGauge));
+    g_snprintf(what, sizeof(what), "colour %d", colour);
+    bOK &= Compare(what, poOld, poNew);
+    cairo_surface_destroy(poOld);
+    cairo_surface_destroy(poNew);
+  }
+
+  gtk_widget_destroy(wLabelWindow);
+  gtk_widget_destroy(wGaugeWindow);
+  printf("look: %s the old label at every step\n",
+         bOK ? "matches" : "differs from");
+  return bOK;
+}
+
+static void OnStyleUpdated(GtkWidget *widget, gpointer data) {
+  (*(unsigned int *)data)++;
+}
+
+static int CountRestyles(void)
+/* A discharge from 100% to 0%, one tick per percent */
+{
+  GtkWidget *wLabel = NewOldLabel();
+  GtkWidget *wLabelWindow = Offscreen(wLabel);
+  gauge_t *poGauge = gauge_new();
+  GtkWidget *wGaugeWindow = Offscreen(gauge_get_widget(poGauge));
+  unsigned int iLabel = 0, iGauge = 0;
+  gint64 iStart_us, iLabel_us, iGauge_us;
+  char acText[8];
+  int i;
+
+  Settle();
+  g_signal_connect(wLabel, "style-updated", G_CALLBACK(OnStyleUpdated),
+                   &iLabel);
+  g_signal_connect(gauge_get_widget(poGauge), "style-updated",
+                   G_CALLBACK(OnStyleUpdated), &iGauge);
+
+  iStart_us = g_get_monotonic_time();
+  for (i = 100; i >= 0; i--) {
+    g_snprintf(acText, sizeof(acText), "%d:%02d", i / 60, i % 60);
+    SetOldLabel(wLabel, acText, i);
+    Settle();
+  }
+  iLabel_us = g_get_monotonic_time() - iStart_us;
+
+  iStart_us = g_get_monotonic_time();
+  for (i = 100; i >= 0; i--) {
+    g_snprintf(acText, sizeof(acText), "%d:%02d", i / 60, i % 60);
+    gauge_set(poGauge, acText, i, i);
+    Settle();
+  }
+  iGauge_us = g_get_monotonic_time() - iStart_us;
+
+  gtk_widget_destroy(wLabelWindow);
+  gtk_widget_destroy(wGaugeWindow);
+
+  printf("%-6s %10s %10s\n", "", "restyles", "us/tick");
+  printf("%-6s %10u %10.0f\n", "label", iLabel, iLabel_us / 101.0);
+  printf("%-6s %10u %10.0f\n", "gauge", iGauge, iGauge_us / 101.0);
+  if (iGauge != 0) {
+    fprintf(stderr, "gauge: restyled %u times in 101 ticks\n", iGauge);
+    return 0;
+  }
+  return 1;
+}
+
+static void Reconfigure(gauge_t *poGauge, unsigned int i) {
+  static const char *const apcFonts[] = { "Sans 10", "Sans Bold 12",
+                                          "(default)", "Monospace 9px" };
+  char acText[8];
+
+  /* What UpdateConf() and battmon_set_orientation() do to it */
+  gauge_set_font(poGauge, apcFonts[i % G_N_ELEMENTS(apcFonts)]);
+  g_snprintf(acText, sizeof(acText), "%u%%", i % 101);
+  gauge_set(poGauge, acText, i % 101, i % 101);
+  Settle();
+}
+
+int main(int argc, char **argv) {
+  GtkWidget *wWindow;
+  gauge_t *poGauge;
+  long lBefore_kB, lAfter_kB;
+  unsigned int i;
+  int bOK = 1;
+
+  if (!gtk_init_check(&argc, &argv)) {
+    printf("no display, skipped\n");
+    return 77;
+  }
+
+  bOK &= CompareLook();
+  bOK &= CountRestyles();
+
+  poGauge = gauge_new();
+  wWindow = Offscreen(gauge_get_widget(poGauge));
+
+  for (i = 0; i < WARMUP; i++)
+    Reconfigure(poGauge, i);
+  lBefore_kB = GetRSS_kB();
+  for (i = 0; i < ROUNDS; i++)
+    Reconfigure(poGauge, i);
+  lAfter_kB = GetRSS_kB();
+
+  gtk_widget_destroy(wWindow);
+
+  printf("RSS %ld kB after %d font changes, %ld kB after %d more\n",
+         lBefore_kB, WARMUP, lAfter_kB, ROUNDS);
+  if (lBefore_kB < 0 || lAfter_kB - lBefore_kB > MAX_GROWTH_KB) {
+    fprintf(stderr, "RSS grew by %ld kB, at most %d expected\n",
+            lAfter_kB - lBefore_kB, MAX_GROWTH_KB);
+    bOK = 0;
+  }
+  return bOK ? 0 : 1;
+}
@@ -0,0 +1,197 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Test of the handling of attributes that hang
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Not part of the plugin, "make check" runs it. pread() is interposed to
+   stall one attribute of a fake tree for longer than SYSFS_HUNG_US, the
+   way some firmware does right after a resume. The attribute has to be
+   left alone from the next sample on, without losing the others, and be
+   read again after SYSFS_HUNG_RETRY samples */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "battery.h"
+#include "sysfs.h"
+
+static const char *const apcAttrs[] = {
+  "status", "Discharging\n",
+  "capacity", "57\n",
+  "energy_now", "28500000\n",
+  "energy_full", "50000000\n",
+  "power_now", "12500000\n",
+  NULL
+};
+
+/* Reads of the file ending in acSlow take too long while bSlow is set */
+static const char *acSlow;
+static int bSlow;
+static unsigned int iSlowReads;
+
+extern ssize_t __pread64(int fd, void *buf, size_t len, off_t offset);
+
+ssize_t pread(int fd, void *buf, size_t len, off_t offset) {
+  char acLink[32], acPath[256];
+  ssize_t n;
+
+  if (bSlow) {
+    g_snprintf(acLink, sizeof(acLink), "/proc/self/fd/%d", fd);
+    n = readlink(acLink, acPath, sizeof(acPath) - 1);
+    if (n > 0) {
+      acPath[n] = '\0';
+      if (g_str_has_suffix(acPath, acSlow)) {
+        iSlowReads++;
+        g_usleep(SYSFS_HUNG_US + 200 * 1000);
+      }
+    }
+  }
+  return __pread64(fd, buf, len, offset);
+}
+
+static char *MakeTree(int bUevent) {
+  GString *uevent = g_string_new("POWER_SUPPLY_NAME=BAT0\n");
+  char *root, *dir, *path, *key;
+  int i;
+
+  root = g_build_filename(g_get_tmp_dir(), "battmon-hung-XXXXXX", NULL);
+  if (!g_mkdtemp(root))
+    g_error("test-hung: cannot create %s", root);
+  dir = g_build_filename(root, "BAT0", NULL);
+  g_mkdir(dir, 0755);
+  for (i = 0; apcAttrs[i]; i += 2) {
+    path = g_build_filename(dir, apcAttrs[i], NULL);
+    g_file_set_contents(path, apcAttrs[i + 1], -1, NULL);
+    g_free(path);
+    key = g_ascii_strup(apcAttrs[i], -1);
+    g_string_append_printf(uevent, "POWER_SUPPLY_%s=%s", key,
+                           apcAttrs[i + 1]);
+    g_free(key);
+  }
+  if (bUevent) {
+    path = g_build_filename(dir, "uevent", NULL);
+    g_file_set_contents(path, uevent->str, -1, NULL);
+    g_free(path);
+  }
+  g_string_free(uevent, TRUE);
+  g_free(dir);
+  return root;
+}
+
+static void RemoveTree(const char *root) {
+  char *dir = g_build_filename(root, "BAT0", NULL);
+  char *path;
+  int i;
+
+  for (i = 0; apcAttrs[i]; i += 2) {
+    path = g_build_filename(dir, apcAttrs[i], NULL);
+    g_unlink(path);
+    g_free(path);
+  }
+  path = g_build_filename(dir, "uevent", NULL);
+  g_unlink(path);
+  g_free(path);
+  g_rmdir(dir);
+  g_free(dir);
+  g_rmdir(root);
+}
+
+static int Check(const char *what, const battsample_t *poSample, long lRate) {
+  if (poSample->eStatus != BattStatus_Discharging ||
+      poSample->iPercent != 57 || poSample->lNow != 28500000 ||
+      poSample->lFull != 50000000 || poSample->lRate != lRate) {
+    fprintf(stderr,
+            "%s: read status %d, %d%%, %ld/%ld, rate %ld, expected "
+            "discharging, 57%%, 28500000/50000000, rate %ld\n",
+            what, poSample->eStatus, poSample->iPercent, poSample->lNow,
+            poSample->lFull, poSample->lRate, lRate);
+    return 0;
+  }
+  return 1;
+}
+
+static int RunCase(const char *name, int bUevent, const char *slow,
+                   long lDroppedRate)
+/* lDroppedRate is what is read while the slow file is left alone */
+{
+  char *root = MakeTree(bUevent);
+  sysfs_t *poSysfs = sysfs_new(root, "BAT0");
+  battsample_t oSample;
+  unsigned int i;
+  int bOK = 0;
+
+  acSlow = slow;
+  iSlowReads = 0;
+  sysfs_probe(poSysfs);
+  sysfs_sample(poSysfs, &oSample);
+  if (!Check(name, &oSample, 12500000))
+    goto done;
+
+  /* It answers, but too late */
+  bSlow = 1;
+  sysfs_sample(poSysfs, &oSample);
+  if (!Check(name, &oSample, 12500000) || iSlowReads != 1)
+    goto done;
+
+  /* Not waited for again, the rest still comes in */
+  sysfs_sample(poSysfs, &oSample);
+  if (iSlowReads != 1 || sysfs_take_hung(poSysfs) != 1) {
+    fprintf(stderr, "%s: %u slow reads, expected 1\n", name, iSlowReads);
+    goto done;
+  }
+  if (!Check(name, &oSample, lDroppedRate))
+    goto done;
+
+  /* Tried again a while later, in case the firmware has recovered */
+  for (i = 1; i <= SYSFS_HUNG_RETRY; i++) {
+    sysfs_sample(poSysfs, &oSample);
+    if (iSlowReads == 2)
+      break;
+  }
+  if (i > SYSFS_HUNG_RETRY || i < SYSFS_HUNG_RETRY / 2) {
+    fprintf(stderr, "%s: read again after %u samples, expected about %d\n",
+            name, i, SYSFS_HUNG_RETRY);
+    goto done;
+  }
+  printf("%-12s dropped for %u samples\n", name, i);
+  bOK = 1;
+
+done:
+  bSlow = 0;
+  sysfs_free(poSysfs);
+  RemoveTree(root);
+  g_free(root);
+  return bOK;
+}
+
+int main(int argc, char **argv) {
+  int bOK = 1;
+
+  /* A hung uevent file costs nothing, the attributes take over */
+  bOK &= RunCase("power_now", 0, "/power_now", -1);
+  bOK &= RunCase("uevent", 1, "/uevent", 12500000);
+  return bOK ? 0 : 1;
+}
@@ -0,0 +1,235 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Test of one sampler shared by several subscribers
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Not part of the plugin, "make check" runs it. pread() is interposed to
+   count the reads from a fake tree. Four subscribers to one battery, as
+   four panel instances are, must cost exactly the reads of one, whether
+   their timers fire together or one after another. Every subscriber has
+   to be handed every sample */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "battery.h"
+#include "sampler.h"
+
+#define SUBSCRIBERS 4
+#define TICKS 10
+/* Stands in for SAMPLER_SHARE_US, so that a tick need not be two seconds
+   after the last one to read again */
+#define TICK_AGE_US (100 * 1000)
+#define TIMEOUT_S 5
+
+static const char *const apcAttrs[] = {
+  "status", "Discharging\n",
+  "capacity", "57\n",
+  "energy_now", "28500000\n",
+  "energy_full", "50000000\n",
+  "power_now", "12500000\n",
+  NULL
+};
+
+/* Reads of files below acRoot, from whichever thread */
+static const char *acRoot;
+static volatile gint iReads;
+
+typedef struct test_t {
+  unsigned int aiSamples[SUBSCRIBERS];
+  int bTimedOut;
+} test_t;
+
+typedef struct sub_t {
+  test_t *poTest;
+  int i;
+} sub_t;
+
+extern ssize_t __pread64(int fd, void *buf, size_t len, off_t offset);
+
+ssize_t pread(int fd, void *buf, size_t len, off_t offset) {
+  char acLink[32], acPath[256];
+  ssize_t n;
+
+  g_snprintf(acLink, sizeof(acLink), "/proc/self/fd/%d", fd);
+  n = readlink(acLink, acPath, sizeof(acPath) - 1);
+  if (n > 0 && acRoot) {
+    acPath[n] = '\0';
+    if (g_str_has_prefix(acPath, acRoot))
+      g_atomic_int_inc(&iReads);
+  }
+  return __pread64(fd, buf, len, offset);
+}
+
+static char *MakeTree(void) {
+  char *root, *dir, *path;
+  int i;
+
+  root = g_build_filename(g_get_tmp_dir(), "battmon-sampler-XXXXXX", NULL);
+  if (!g_mkdtemp(root))
+    g_error("test-sampler: cannot create %s", root);
+  dir = g_build_filename(root, "BAT0", NULL);
+  g_mkdir(dir, 0755);
+  for (i = 0; apcAttrs[i]; i += 2) {
+    path = g_build_filename(dir, apcAttrs[i], NULL);
+    g_file_set_contents(path, apcAttrs[i + 1], -1, NULL);
+    g_free(path);
+  }
+  g_free(dir);
+  return root;
+}
+
+static void RemoveTree(const char *root) {
+  char *dir = g_build_filename(root, "BAT0", NULL);
+  char *path;
+  int i;
+
+  for (i = 0; apcAttrs[i]; i += 2) {
+    path = g_build_filename(dir, apcAttrs[i], NULL);
+    g_unlink(path);
+    g_free(path);
+  }
+  g_rmdir(dir);
+  g_free(dir);
+  g_rmdir(root);
+}
+
+static void OnSample(const samplerresult_t *poResult, void *data) {
+  sub_t *poSub = (sub_t *)data;
+
+  poSub->poTest->aiSamples[poSub->i]++;
+}
+
+static gboolean OnTimeout(gpointer data) {
+  ((test_t *)data)->bTimedOut = 1;
+  return G_SOURCE_REMOVE;
+}
+
+/* Runs the main loop until the last sample is older than TICK_AGE_US.
+   Whatever a tick set off is read and delivered by then */
+static void Settle(void) {
+  gint64 iEnd = g_get_monotonic_time() + TICK_AGE_US + 50 * 1000;
+
+  while (g_get_monotonic_time() < iEnd)
+    if (!g_main_context_iteration(NULL, FALSE))
+      g_usleep(1000);
+}
+
+/* Until the first iSubs subscribers have iSamples samples each this tick */
+static int WaitFor(test_t *poTest, int iSubs, unsigned int iSamples) {
+  unsigned int iTimeoutId;
+  int i = 0;
+
+  poTest->bTimedOut = 0;
+  iTimeoutId = g_timeout_add_seconds(TIMEOUT_S, OnTimeout, poTest);
+  while (i < iSubs && !poTest->bTimedOut) {
+    if (poTest->aiSamples[i] >= iSamples)
+      i++;
+    else
+      g_main_context_iteration(NULL, TRUE);
+  }
+  if (!poTest->bTimedOut)
+    g_source_remove(iTimeoutId);
+  else
+    fprintf(stderr, "no sample in %d s\n", TIMEOUT_S);
+  return !poTest->bTimedOut;
+}
+
+/* Reads per tick into aiReads. Even ticks have every timer fire while the
+   first sample is read, odd ones have the others fire after it came in.
+   Returns 0 if a tick did not get its samples at all, a tick that got
+   more is reported and compared on its reads */
+static int Run(const char *root, int iSubs, int *aiReads, int *pbOK) {
+  sampler_t *apoSamplers[SUBSCRIBERS];
+  sub_t aoSubs[SUBSCRIBERS];
+  test_t oTest = { { 0 } };
+  int iTick, i, bOK = 1;
+
+  for (i = 0; i < iSubs; i++) {
+    aoSubs[i].poTest = &oTest;
+    aoSubs[i].i = i;
+    apoSamplers[i] = sampler_new(root, "BAT0", OnSample, &aoSubs[i]);
+  }
+
+  for (iTick = 0; iTick < TICKS && bOK; iTick++) {
+    memset(oTest.aiSamples, 0, sizeof(oTest.aiSamples));
+    g_atomic_int_set(&iReads, 0);
+    if (iTick % 2 == 0) {
+      for (i = 0; i < iSubs; i++)
+        sampler_request(apoSamplers[i], TICK_AGE_US);
+    } else {
+      sampler_request(apoSamplers[0], TICK_AGE_US);
+      bOK = WaitFor(&oTest, 1, 1);
+      for (i = 1; i < iSubs; i++)
+        sampler_request(apoSamplers[i], TICK_AGE_US);
+    }
+    bOK = bOK && WaitFor(&oTest, iSubs, 1);
+    Settle();
+    aiReads[iTick] = g_atomic_int_get(&iReads);
+
+    /* One sample per tick, handed to everybody */
+    for (i = 0; i < iSubs && bOK; i++)
+      if (oTest.aiSamples[i] != 1) {
+        fprintf(stderr, "%d subscribers, tick %d: subscriber %d got %u "
+                "samples, expected 1\n", iSubs, iTick, i,
+                oTest.aiSamples[i]);
+        *pbOK = 0;
+      }
+  }
+
+  for (i = 0; i < iSubs; i++)
+    sampler_free(apoSamplers[i]);
+  return bOK;
+}
+
+int main(int argc, char **argv) {
+  char *root = MakeTree();
+  char *real = realpath(root, NULL);
+  int aiOne[TICKS], aiMany[TICKS];
+  int iTick, bOK = 1;
+
+  /* As /proc/self/fd shows it */
+  acRoot = real;
+  if (Run(root, 1, aiOne, &bOK) && Run(root, SUBSCRIBERS, aiMany, &bOK)) {
+    printf("%-6s %12s %9d subs\n", "tick", "1 sub", SUBSCRIBERS);
+    for (iTick = 0; iTick < TICKS; iTick++) {
+      printf("%-6d %12d %12d\n", iTick, aiOne[iTick], aiMany[iTick]);
+      if (aiMany[iTick] != aiOne[iTick] || aiOne[iTick] == 0) {
+        fprintf(stderr, "tick %d: %d preads with %d subscribers, %d with "
+                "one\n", iTick, aiMany[iTick], SUBSCRIBERS, aiOne[iTick]);
+        bOK = 0;
+      }
+    }
+  } else
+    bOK = 0;
+  acRoot = NULL;
+
+  RemoveTree(root);
+  free(real);
+  g_free(root);
+  return bOK ? 0 : 1;
+}
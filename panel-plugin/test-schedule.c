@@ -0,0 +1,84 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Test of the timer periods against the documented table
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Not part of the plugin, "make check" runs it. Wakeups per hour for every
+   state, as documented in schedule.h, and the bounds around the configured
+   period */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include <stdio.h>
+
+#include "battery.h"
+#include "schedule.h"
+
+typedef struct case_t {
+  const char *acName;
+  battstatus_t eStatus;
+  int bCritical;
+  unsigned int iPeriod_ms; /* Configured */
+  int bPushed;
+  unsigned int iWakeups; /* Per hour */
+} case_t;
+
+static const case_t aoCases[] = {
+  /* The table in schedule.h, P = 30 s */
+  { "discharging", BattStatus_Discharging, 0, 30000, 0, 120 },
+  { "critical", BattStatus_Discharging, 1, 30000, 0, 360 },
+  { "charging", BattStatus_Charging, 0, 30000, 0, 30 },
+  { "full", BattStatus_Full, 0, 30000, 0, 6 },
+  { "unknown", BattStatus_Unknown, 0, 30000, 0, 6 },
+  { "no battery", BattStatus_NoBatt, 0, 30000, 0, 6 },
+  /* Pushed changes, only the critical level keeps polling fast */
+  { "discharging, pushed", BattStatus_Discharging, 0, 30000, 1, 30 },
+  { "critical, pushed", BattStatus_Discharging, 1, 30000, 1, 360 },
+  { "charging, pushed", BattStatus_Charging, 0, 30000, 1, 30 },
+  { "full, pushed", BattStatus_Full, 0, 30000, 1, 6 },
+  /* P is a bound: never below the minimum, only critical goes below P */
+  { "discharging, P = 1 s", BattStatus_Discharging, 0, 1000, 0, 720 },
+  { "critical, P = 1 s", BattStatus_Discharging, 1, 1000, 0, 720 },
+  { "discharging, P = 2.5 s", BattStatus_Discharging, 0, 2500, 0, 720 },
+  { "charging, P = 1 h", BattStatus_Charging, 0, 3600000, 0, 1 },
+  { "full, P = 1 h", BattStatus_Full, 0, 3600000, 0, 1 },
+};
+
+int main(int argc, char **argv) {
+  unsigned int i, iPeriod_s;
+  int bOK = 1;
+
+  printf("%-24s %10s %10s\n", "state", "period/s", "wakeups/h");
+  for (i = 0; i < G_N_ELEMENTS(aoCases); i++) {
+    const case_t *poCase = &aoCases[i];
+
+    iPeriod_s = schedule_get_period(poCase->eStatus, poCase->bCritical,
+                                    poCase->iPeriod_ms, poCase->bPushed);
+    printf("%-24s %10u %10u\n", poCase->acName, iPeriod_s, 3600 / iPeriod_s);
+    if (3600 / iPeriod_s != poCase->iWakeups) {
+      fprintf(stderr, "%s: %u wakeups/h, expected %u\n", poCase->acName,
+              3600 / iPeriod_s, poCase->iWakeups);
+      bOK = 0;
+    }
+  }
+  return bOK ? 0 : 1;
+}
@@ -0,0 +1,350 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Test of the session monitor against mocks on a private bus
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Not part of the plugin, "make check" runs it. A private dbus-daemon is
+   started and announced as both system and session bus. A mock logind and
+   screensaver on it start out locked and blanked, the monitor has to ask
+   for that itself, then every signal it follows is sent once each way.
+   Skipped if there is no dbus-daemon to start */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gio/gio.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "session.h"
+
+#define LOGIN1_NAME "org.freedesktop.login1"
+#define LOGIN1_PATH "/org/freedesktop/login1"
+#define LOGIN1_MANAGER LOGIN1_NAME ".Manager"
+#define LOGIN1_SESSION LOGIN1_NAME ".Session"
+#define SESSION_PATH LOGIN1_PATH "/session/_31"
+#define SCREENSAVER_NAME "org.freedesktop.ScreenSaver"
+#define SCREENSAVER_PATH "/org/freedesktop/ScreenSaver"
+#define TIMEOUT_S 5
+/* Long enough for a signal that should change nothing to have arrived */
+#define SETTLE_MS 200
+
+static const char acIntrospection[] =
+    "<node>"
+    "<interface name='" LOGIN1_MANAGER "'>"
+    "<method name='GetSessionByPID'>"
+    "<arg direction='in' type='u'/><arg direction='out' type='o'/>"
+    "</method>"
+    "</interface>"
+    "<interface name='" LOGIN1_SESSION "'>"
+    "<property name='Active' type='b' access='read'/>"
+    "<property name='LockedHint' type='b' access='read'/>"
+    "</interface>"
+    "<interface name='" SCREENSAVER_NAME "'>"
+    "<method name='GetActive'><arg direction='out' type='b'/></method>"
+    "</interface>"
+    "</node>";
+
+/* What the mocks say when asked */
+static gboolean bSessionActive = TRUE;
+static gboolean bLockedHint = TRUE;
+static gboolean bSaverActive = TRUE;
+static int iSessionAsked;
+static int iSaverAsked;
+
+typedef struct test_t {
+  int iCalls;
+  int bLastActive;
+  int bTimedOut;
+} test_t;
+
+static void OnMethod(GDBusConnection *conn, const gchar *sender,
+                     const gchar *path, const gchar *iface,
+                     const gchar *method, GVariant *params,
+                     GDBusMethodInvocation *invocation, gpointer data) {
+  if (g_strcmp0(method, "GetSessionByPID") == 0)
+    g_dbus_method_invocation_return_value(
+        invocation, g_variant_new("(o)", SESSION_PATH));
+  else if (g_strcmp0(method, "GetActive") == 0) {
+    iSaverAsked++;
+    g_dbus_method_invocation_return_value(invocation,
+                                          g_variant_new("(b)", bSaverActive));
+  }
+}
+
+static GVariant *GetProperty(GDBusConnection *conn, const gchar *sender,
+                             const gchar *path, const gchar *iface,
+                             const gchar *prop, GError **error,
+                             gpointer data) {
+  iSessionAsked++;
+  if (g_strcmp0(prop, "Active") == 0)
+    return g_variant_new_boolean(bSessionActive);
+  if (g_strcmp0(prop, "LockedHint") == 0)
+    return g_variant_new_boolean(bLockedHint);
+  return NULL;
+}
+
+static const GDBusInterfaceVTable oVTable = { OnMethod, GetProperty, NULL };
+
+static int Own(GDBusConnection *poConn, const char *name) {
+  GVariant *poReply;
+  GError *poError = NULL;
+
+  poReply = g_dbus_connection_call_sync(
+      poConn, "org.freedesktop.DBus", "/org/freedesktop/DBus",
+      "org.freedesktop.DBus", "RequestName", g_variant_new("(su)", name, 0),
+      G_VARIANT_TYPE("(u)"), G_DBUS_CALL_FLAGS_NONE, -1, NULL, &poError);
+  if (!poReply) {
+    fprintf(stderr, "mock: cannot own %s: %s\n", name, poError->message);
+    g_error_free(poError);
+    return 0;
+  }
+  g_variant_unref(poReply);
+  return 1;
+}
+
+static GDBusConnection *StartMock(const char *address) {
+  GDBusConnection *poConn;
+  GDBusNodeInfo *poInfo;
+  GError *poError = NULL;
+
+  poConn = g_dbus_connection_new_for_address_sync(
+      address,
+      G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+          G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+      NULL, NULL, &poError);
+  if (!poConn) {
+    fprintf(stderr, "mock: cannot connect: %s\n", poError->message);
+    g_error_free(poError);
+    return NULL;
+  }
+
+  poInfo = g_dbus_node_info_new_for_xml(acIntrospection, NULL);
+  g_dbus_connection_register_object(poConn, LOGIN1_PATH, poInfo->interfaces[0],
+                                    &oVTable, NULL, NULL, NULL);
+  g_dbus_connection_register_object(poConn, SESSION_PATH,
+                                    poInfo->interfaces[1], &oVTable, NULL,
+                                    NULL, NULL);
+  g_dbus_connection_register_object(poConn, SCREENSAVER_PATH,
+                                    poInfo->interfaces[2], &oVTable, NULL,
+                                    NULL, NULL);
+  g_dbus_node_info_unref(poInfo);
+
+  /* Owned before the monitor looks, it need not wait for the names */
+  if (!Own(poConn, LOGIN1_NAME) || !Own(poConn, SCREENSAVER_NAME)) {
+    g_object_unref(poConn);
+    return NULL;
+  }
+  return poConn;
+}
+
+static void Emit(GDBusConnection *poConn, const char *path, const char *iface,
+                 const char *signal, GVariant *params) {
+  g_dbus_connection_emit_signal(poConn, NULL, path, iface, signal, params,
+                                NULL);
+  g_dbus_connection_flush_sync(poConn, NULL, NULL);
+}
+
+static void EmitSession(GDBusConnection *poConn, const char *prop,
+                        gboolean bValue) {
+  GVariantBuilder oChanged;
+
+  g_variant_builder_init(&oChanged, G_VARIANT_TYPE("a{sv}"));
+  g_variant_builder_add(&oChanged, "{sv}", prop,
+                        g_variant_new_boolean(bValue));
+  Emit(poConn, SESSION_PATH, "org.freedesktop.DBus.Properties",
+       "PropertiesChanged",
+       g_variant_new("(sa{sv}as)", LOGIN1_SESSION, &oChanged, NULL));
+}
+
+static void OnSession(int bActive, void *data) {
+  test_t *poTest = (test_t *)data;
+
+  poTest->iCalls++;
+  poTest->bLastActive = bActive;
+}
+
+static gboolean OnTimeout(gpointer data) {
+  ((test_t *)data)->bTimedOut = 1;
+  return G_SOURCE_REMOVE;
+}
+
+static void Settle(void) {
+  gint64 iEnd = g_get_monotonic_time() + SETTLE_MS * 1000;
+
+  while (g_get_monotonic_time() < iEnd)
+    g_main_context_iteration(NULL, FALSE);
+}
+
+/* Waits for the next call of the callback and checks it went to bActive,
+   as session_monitor_is_active must have */
+static int Expect(test_t *poTest, session_t *poSession, int bActive,
+                  const char *what) {
+  unsigned int iTimeoutId;
+  int iCalls = poTest->iCalls;
+
+  poTest->bTimedOut = 0;
+  iTimeoutId = g_timeout_add_seconds(TIMEOUT_S, OnTimeout, poTest);
+  while (poTest->iCalls == iCalls && !poTest->bTimedOut)
+    g_main_context_iteration(NULL, TRUE);
+  if (poTest->bTimedOut) {
+    fprintf(stderr, "%s: no callback in %d s\n", what, TIMEOUT_S);
+    return 0;
+  }
+  g_source_remove(iTimeoutId);
+
+  /* One call per change, never a repeat of the same answer */
+  Settle();
+  if (poTest->iCalls != iCalls + 1 || poTest->bLastActive != bActive ||
+      session_monitor_is_active(poSession) != bActive) {
+    fprintf(stderr,
+            "%s: %d callbacks, last %d, is_active %d, expected 1 callback "
+            "and %d\n",
+            what, poTest->iCalls - iCalls, poTest->bLastActive,
+            session_monitor_is_active(poSession), bActive);
+    return 0;
+  }
+  return 1;
+}
+
+/* Sends something that must not change the answer */
+static int ExpectNone(test_t *poTest, session_t *poSession, int bActive,
+                      const char *what) {
+  int iCalls = poTest->iCalls;
+
+  Settle();
+  if (poTest->iCalls != iCalls ||
+      session_monitor_is_active(poSession) != bActive) {
+    fprintf(stderr, "%s: %d callbacks, is_active %d, expected none and %d\n",
+            what, poTest->iCalls - iCalls,
+            session_monitor_is_active(poSession), bActive);
+    return 0;
+  }
+  return 1;
+}
+
+int main(int argc, char **argv) {
+  GTestDBus *poBus;
+  GDBusConnection *poMock;
+  session_t *poSession;
+  test_t oTest = { 0 };
+  unsigned int iTimeoutId;
+  char *pc;
+  int bOK = 0;
+
+  if (!(pc = g_find_program_in_path("dbus-daemon"))) {
+    printf("no dbus-daemon, skipped\n");
+    return 77;
+  }
+  g_free(pc);
+
+  /* Sets DBUS_SESSION_BUS_ADDRESS, logind is looked for on the system bus */
+  poBus = g_test_dbus_new(G_TEST_DBUS_NONE);
+  g_test_dbus_up(poBus);
+  g_setenv("DBUS_SYSTEM_BUS_ADDRESS", g_test_dbus_get_bus_address(poBus),
+           TRUE);
+
+  if (!(poMock = StartMock(g_test_dbus_get_bus_address(poBus)))) {
+    g_test_dbus_down(poBus);
+    g_object_unref(poBus);
+    return 1;
+  }
+
+  /* Started locked and blanked: nothing will be signalled, the monitor has
+     to ask. Both questions are answered before the checks go on, so no
+     late reply can undo a signal below */
+  poSession = session_monitor_new(OnSession, &oTest);
+  if (!Expect(&oTest, poSession, 0, "startup"))
+    goto done;
+  oTest.bTimedOut = 0;
+  iTimeoutId = g_timeout_add_seconds(TIMEOUT_S, OnTimeout, &oTest);
+  while ((!iSessionAsked || !iSaverAsked) && !oTest.bTimedOut)
+    g_main_context_iteration(NULL, TRUE);
+  if (oTest.bTimedOut) {
+    fprintf(stderr, "startup: session asked %d, screensaver asked %d\n",
+            iSessionAsked, iSaverAsked);
+    goto done;
+  }
+  g_source_remove(iTimeoutId);
+
+  /* Still blanked after the unlock */
+  bLockedHint = FALSE;
+  EmitSession(poMock, "LockedHint", FALSE);
+  if (!ExpectNone(&oTest, poSession, 0, "unlocked while blanked"))
+    goto done;
+  bSaverActive = FALSE;
+  Emit(poMock, SCREENSAVER_PATH, SCREENSAVER_NAME, "ActiveChanged",
+       g_variant_new("(b)", FALSE));
+  if (!Expect(&oTest, poSession, 1, "unblanked"))
+    goto done;
+
+  Emit(poMock, LOGIN1_PATH, LOGIN1_MANAGER, "PrepareForSleep",
+       g_variant_new("(b)", TRUE));
+  if (!Expect(&oTest, poSession, 0, "suspending"))
+    goto done;
+  Emit(poMock, LOGIN1_PATH, LOGIN1_MANAGER, "PrepareForSleep",
+       g_variant_new("(b)", FALSE));
+  if (!Expect(&oTest, poSession, 1, "resumed"))
+    goto done;
+  if (!session_monitor_take_slept(poSession) ||
+      session_monitor_take_slept(poSession)) {
+    fprintf(stderr, "resumed: the sleep was not reported exactly once\n");
+    goto done;
+  }
+
+  Emit(poMock, SESSION_PATH, LOGIN1_SESSION, "Lock", NULL);
+  if (!Expect(&oTest, poSession, 0, "Lock"))
+    goto done;
+  Emit(poMock, SESSION_PATH, LOGIN1_SESSION, "Unlock", NULL);
+  if (!Expect(&oTest, poSession, 1, "Unlock"))
+    goto done;
+
+  Emit(poMock, SCREENSAVER_PATH, SCREENSAVER_NAME, "ActiveChanged",
+       g_variant_new("(b)", TRUE));
+  if (!Expect(&oTest, poSession, 0, "blanked"))
+    goto done;
+  Emit(poMock, SCREENSAVER_PATH, SCREENSAVER_NAME, "ActiveChanged",
+       g_variant_new("(b)", FALSE));
+  if (!Expect(&oTest, poSession, 1, "unblanked again"))
+    goto done;
+
+  EmitSession(poMock, "Active", FALSE);
+  if (!Expect(&oTest, poSession, 0, "switched away"))
+    goto done;
+  EmitSession(poMock, "Active", TRUE);
+  if (!Expect(&oTest, poSession, 1, "switched back"))
+    goto done;
+
+  /* Blanking does not count as sleep */
+  if (session_monitor_take_slept(poSession)) {
+    fprintf(stderr, "blanked: reported as a sleep\n");
+    goto done;
+  }
+
+  printf("session monitor: initial state read, every signal followed\n");
+  bOK = 1;
+
+done:
+  session_monitor_free(poSession);
+  g_object_unref(poMock);
+  g_test_dbus_down(poBus);
+  g_object_unref(poBus);
+  return bOK ? 0 : 1;
+}
@@ -0,0 +1,136 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Benchmark of the sparkline against history length
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Not part of the plugin, "make check" runs it. Needs no display, the
+   graph is drawn into an image surface, one pixel per column as on the
+   panel. For several history lengths samples are pushed a minute apart:
+   everything may only be drawn once, and the time per push must not grow
+   with the length. A full redraw is timed for comparison */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gtk/gtk.h>
+
+#include <stdio.h>
+
+#include "sparkline.h"
+
+#define HEIGHT 32
+#define PUSHES 5000
+#define RUNS 5
+/* The longest history may take this much longer per push than the
+   shortest, timing noise included */
+#define MAX_RATIO 2.0
+#define SLACK_NS 2000
+
+static const int aiLengths[] = {60, 240, 960, 3840};
+
+static double TimePushes(sparkline_t *poSpark, time_t *pNow, int n)
+/* ns per push */
+{
+  gint64 iStart_us = g_get_monotonic_time();
+  int i;
+
+  for (i = 0; i < n; i++) {
+    *pNow += SPARKLINE_INTERVAL_S;
+    /* The rate never rises above the first one, the scale stays */
+    sparkline_push(poSpark, 100 - i % 100, 10000 - i % 5000, 0, *pNow);
+  }
+  return (g_get_monotonic_time() - iStart_us) * 1000.0 / n;
+}
+
+static guint32 Pixel(cairo_surface_t *poSurface, int x, int y) {
+  cairo_surface_flush(poSurface);
+  return *(guint32 *)(cairo_image_surface_get_data(poSurface) +
+                      y * cairo_image_surface_get_stride(poSurface) + 4 * x);
+}
+
+static int CheckLayout(sparkline_t *poSpark, int columns, time_t now)
+/* The newest sample is on the right, a minute without one is empty */
+{
+  cairo_surface_t *poSurface =
+      cairo_image_surface_create(CAIRO_FORMAT_ARGB32, columns, HEIGHT);
+  cairo_t *cr = cairo_create(poSurface);
+  int bOK;
+
+  sparkline_push(poSpark, 100, 10000, 0, now + SPARKLINE_INTERVAL_S);
+  sparkline_push(poSpark, 50, -1, 0, now + 3 * SPARKLINE_INTERVAL_S);
+  sparkline_paint(poSpark, cr);
+  cairo_destroy(cr);
+
+  bOK = Pixel(poSurface, columns - 3, 0) != 0 &&      /* 100% */
+        Pixel(poSurface, columns - 2, HEIGHT - 1) == 0 && /* Empty */
+        Pixel(poSurface, columns - 1, HEIGHT - 1) != 0 && /* 50% */
+        Pixel(poSurface, columns - 1, 0) == 0;
+  cairo_surface_destroy(poSurface);
+  if (!bOK)
+    fprintf(stderr, "%d columns: the newest samples are not on the right\n",
+            columns);
+  return bOK;
+}
+
+int main(int argc, char **argv) {
+  double adPush_ns[G_N_ELEMENTS(aiLengths)];
+  double d, dFull_ns;
+  unsigned int i, iFull, iColumns;
+  sparkline_t *poSpark;
+  time_t now;
+  int r, bOK = 1;
+
+  printf("%-8s %12s %12s %12s\n", "columns", "ns/push", "full draws",
+         "ns/redraw");
+  for (i = 0; i < G_N_ELEMENTS(aiLengths); i++) {
+    poSpark = sparkline_new_offscreen(GTK_ORIENTATION_HORIZONTAL,
+                                      aiLengths[i], aiLengths[i], HEIGHT);
+    now = 1000000 * SPARKLINE_INTERVAL_S;
+
+    /* Fill the history first, the best of a few runs is the least noisy */
+    TimePushes(poSpark, &now, aiLengths[i]);
+    adPush_ns[i] = G_MAXDOUBLE;
+    for (r = 0; r < RUNS; r++)
+      if ((d = TimePushes(poSpark, &now, PUSHES)) < adPush_ns[i])
+        adPush_ns[i] = d;
+    sparkline_get_draws(poSpark, &iFull, &iColumns);
+
+    /* What every push would cost without the cache */
+    sparkline_set_orientation(poSpark, GTK_ORIENTATION_HORIZONTAL);
+    dFull_ns = TimePushes(poSpark, &now, 1);
+
+    printf("%-8d %12.0f %12u %12.0f\n", aiLengths[i], adPush_ns[i], iFull,
+           dFull_ns);
+    if (iFull != 1) {
+      fprintf(stderr, "%d columns: drawn completely %u times\n",
+              aiLengths[i], iFull);
+      bOK = 0;
+    }
+    bOK &= CheckLayout(poSpark, aiLengths[i], now);
+    sparkline_free(poSpark);
+  }
+
+  i = G_N_ELEMENTS(aiLengths) - 1;
+  if (adPush_ns[i] > MAX_RATIO * adPush_ns[0] + SLACK_NS) {
+    fprintf(stderr, "a push costs %.0f ns with %d columns, %.0f ns with %d\n",
+            adPush_ns[i], aiLengths[i], adPush_ns[0], aiLengths[0]);
+    bOK = 0;
+  }
+  return bOK ? 0 : 1;
+}
@@ -0,0 +1,173 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Test of the power_supply event listener on a fake tree
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Not part of the plugin, "make check" runs it. Events in the kernel's
+   wire format are injected through the socket the monitor binds in a fake
+   tree, the time from sending to the callback is printed */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "uevent.h"
+
+#define TIMEOUT_S 5
+
+typedef struct test_t {
+  const char *acRoot;
+  int iEvents;
+  char acAction[16];
+  char acName[32];
+  int64_t iReceived_us;
+  int bTimedOut;
+} test_t;
+
+static void OnEvent(const char *action, const char *name, void *data) {
+  test_t *poTest = (test_t *)data;
+
+  poTest->iEvents++;
+  poTest->iReceived_us = g_get_monotonic_time();
+  g_strlcpy(poTest->acAction, action, sizeof(poTest->acAction));
+  g_strlcpy(poTest->acName, name ? name : "", sizeof(poTest->acName));
+}
+
+static int Inject(const char *root, const char *action, const char *name,
+                  const char *subsystem) {
+  struct sockaddr_un oAddr;
+  GString *msg;
+  char *path = g_build_filename(root, ".uevent", NULL);
+  ssize_t len;
+  int iSock;
+
+  /* The environment is a list of NUL-terminated strings, as on netlink */
+  msg = g_string_new(NULL);
+  g_string_append_printf(msg, "%s@/devices/LNXSYSTM:00/power_supply/%s",
+                         action, name);
+  g_string_append_c(msg, '\0');
+  g_string_append_printf(msg, "ACTION=%s", action);
+  g_string_append_c(msg, '\0');
+  g_string_append_printf(msg, "SUBSYSTEM=%s", subsystem);
+  g_string_append_c(msg, '\0');
+  g_string_append_printf(msg, "POWER_SUPPLY_NAME=%s", name);
+  g_string_append_c(msg, '\0');
+
+  memset(&oAddr, 0, sizeof(oAddr));
+  oAddr.sun_family = AF_UNIX;
+  g_strlcpy(oAddr.sun_path, path, sizeof(oAddr.sun_path));
+  iSock = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  len = sendto(iSock, msg->str, msg->len, 0, (struct sockaddr *)&oAddr,
+               sizeof(oAddr));
+  close(iSock);
+  g_string_free(msg, TRUE);
+  g_free(path);
+  return len > 0;
+}
+
+static gboolean OnTimeout(gpointer data) {
+  ((test_t *)data)->bTimedOut = 1;
+  return G_SOURCE_REMOVE;
+}
+
+/* Runs the loop until iEvents have come in or for iWait_ms, whatever comes
+   first */
+static void Run(test_t *poTest, int iEvents, unsigned int iWait_ms) {
+  unsigned int iTimeoutId;
+
+  poTest->bTimedOut = 0;
+  iTimeoutId = g_timeout_add(iWait_ms, OnTimeout, poTest);
+  while (poTest->iEvents < iEvents && !poTest->bTimedOut)
+    g_main_context_iteration(NULL, TRUE);
+  if (!poTest->bTimedOut)
+    g_source_remove(iTimeoutId);
+}
+
+static int Expect(test_t *poTest, const char *action, const char *name) {
+  int64_t iSent_us = g_get_monotonic_time();
+  int iEvents = poTest->iEvents;
+
+  if (!Inject(poTest->acRoot, action, name, "power_supply")) {
+    fprintf(stderr, "%s %s: cannot inject\n", action, name);
+    return 0;
+  }
+  Run(poTest, iEvents + 1, TIMEOUT_S * 1000);
+  if (poTest->iEvents != iEvents + 1 ||
+      strcmp(poTest->acAction, action) != 0 ||
+      strcmp(poTest->acName, name) != 0) {
+    fprintf(stderr, "%s %s: got %d events, last %s %s\n", action, name,
+            poTest->iEvents - iEvents, poTest->acAction, poTest->acName);
+    return 0;
+  }
+  printf("%-8s %-6s %6ld us\n", action, name,
+         (long)(poTest->iReceived_us - iSent_us));
+  return 1;
+}
+
+int main(int argc, char **argv) {
+  char *root = g_dir_make_tmp("battmon-uevent-XXXXXX", NULL);
+  test_t oTest = { 0 };
+  uevent_t *poMon;
+  int bOK = 0;
+
+  if (!root || !(poMon = uevent_monitor_new(root, OnEvent, &oTest))) {
+    fprintf(stderr, "cannot set up a fake tree\n");
+    return 1;
+  }
+  oTest.acRoot = root;
+
+  if (!Expect(&oTest, "add", "BAT0") || !Expect(&oTest, "change", "BAT0") ||
+      !Expect(&oTest, "change", "AC") || !Expect(&oTest, "remove", "BAT0"))
+    goto done;
+
+  /* Other subsystems are not passed on */
+  Inject(root, "change", "input3", "input");
+  Run(&oTest, oTest.iEvents + 1, 200);
+  if (!oTest.bTimedOut) {
+    fprintf(stderr, "input: passed on as %s %s\n", oTest.acAction,
+            oTest.acName);
+    goto done;
+  }
+
+  /* A burst is drained in one go, none of it is lost */
+  oTest.iEvents = 0;
+  Inject(root, "change", "BAT0", "power_supply");
+  Inject(root, "change", "AC", "power_supply");
+  Inject(root, "change", "BAT0", "power_supply");
+  Run(&oTest, 3, TIMEOUT_S * 1000);
+  if (oTest.iEvents != 3) {
+    fprintf(stderr, "burst: got %d of 3 events\n", oTest.iEvents);
+    goto done;
+  }
+  bOK = 1;
+
+done:
+  uevent_monitor_free(poMon);
+  g_rmdir(root);
+  g_free(root);
+  return bOK ? 0 : 1;
+}
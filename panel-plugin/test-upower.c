@@ -0,0 +1,248 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Test of the UPower source against a mock on a private bus
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Not part of the plugin, "make check" runs it. A private dbus-daemon is
+   started and announced as the system bus, a mock UPower on it serves one
+   battery. Skipped if there is no dbus-daemon to start */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gio/gio.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "battery.h"
+#include "upower.h"
+
+#define DEVICE_PATH "/org/freedesktop/UPower/devices/battery_BAT0"
+#define DEVICE_IFACE "org.freedesktop.UPower.Device"
+#define TIMEOUT_S 5
+
+static const char acIntrospection[] =
+    "<node><interface name='" DEVICE_IFACE "'>"
+    "<property name='IsPresent' type='b' access='read'/>"
+    "<property name='State' type='u' access='read'/>"
+    "<property name='Percentage' type='d' access='read'/>"
+    "<property name='Energy' type='d' access='read'/>"
+    "<property name='EnergyFull' type='d' access='read'/>"
+    "<property name='EnergyRate' type='d' access='read'/>"
+    "<property name='EnergyFullDesign' type='d' access='read'/>"
+    "</interface></node>";
+
+/* What the mock says, UPower's units and states */
+static guint32 iState = 2; /* Discharging */
+static double dPercent = 57;
+
+typedef struct test_t {
+  int iSamples;
+  samplerresult_t oLast;
+  int bTimedOut;
+} test_t;
+
+static GVariant *GetProperty(GDBusConnection *conn, const gchar *sender,
+                             const gchar *path, const gchar *iface,
+                             const gchar *prop, GError **error,
+                             gpointer data) {
+  if (g_strcmp0(prop, "IsPresent") == 0)
+    return g_variant_new_boolean(TRUE);
+  if (g_strcmp0(prop, "State") == 0)
+    return g_variant_new_uint32(iState);
+  if (g_strcmp0(prop, "Percentage") == 0)
+    return g_variant_new_double(dPercent);
+  if (g_strcmp0(prop, "Energy") == 0)
+    return g_variant_new_double(28.5);
+  if (g_strcmp0(prop, "EnergyFull") == 0)
+    return g_variant_new_double(50);
+  if (g_strcmp0(prop, "EnergyRate") == 0)
+    return g_variant_new_double(12.5);
+  if (g_strcmp0(prop, "EnergyFullDesign") == 0)
+    return g_variant_new_double(57);
+  return NULL;
+}
+
+static const GDBusInterfaceVTable oVTable = { NULL, GetProperty, NULL };
+
+static GDBusConnection *StartMock(const char *address) {
+  GDBusConnection *poConn;
+  GDBusNodeInfo *poInfo;
+  GVariant *poReply;
+  GError *poError = NULL;
+
+  poConn = g_dbus_connection_new_for_address_sync(
+      address,
+      G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+          G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+      NULL, NULL, &poError);
+  if (!poConn) {
+    fprintf(stderr, "mock: cannot connect: %s\n", poError->message);
+    g_error_free(poError);
+    return NULL;
+  }
+
+  poInfo = g_dbus_node_info_new_for_xml(acIntrospection, NULL);
+  g_dbus_connection_register_object(poConn, DEVICE_PATH,
+                                    poInfo->interfaces[0], &oVTable, NULL,
+                                    NULL, NULL);
+  g_dbus_node_info_unref(poInfo);
+
+  /* Owned before the source looks, it need not wait for the name */
+  poReply = g_dbus_connection_call_sync(
+      poConn, "org.freedesktop.DBus", "/org/freedesktop/DBus",
+      "org.freedesktop.DBus", "RequestName",
+      g_variant_new("(su)", "org.freedesktop.UPower", 0),
+      G_VARIANT_TYPE("(u)"), G_DBUS_CALL_FLAGS_NONE, -1, NULL, &poError);
+  if (!poReply) {
+    fprintf(stderr, "mock: cannot own UPower: %s\n", poError->message);
+    g_error_free(poError);
+    g_object_unref(poConn);
+    return NULL;
+  }
+  g_variant_unref(poReply);
+  return poConn;
+}
+
+static void EmitChanged(GDBusConnection *poConn) {
+  GVariantBuilder oChanged;
+
+  /* Only what changed, as UPower does */
+  g_variant_builder_init(&oChanged, G_VARIANT_TYPE("a{sv}"));
+  g_variant_builder_add(&oChanged, "{sv}", "State",
+                        g_variant_new_uint32(iState));
+  g_variant_builder_add(&oChanged, "{sv}", "Percentage",
+                        g_variant_new_double(dPercent));
+  g_dbus_connection_emit_signal(
+      poConn, NULL, DEVICE_PATH, "org.freedesktop.DBus.Properties",
+      "PropertiesChanged",
+      g_variant_new("(sa{sv}as)", DEVICE_IFACE, &oChanged, NULL), NULL);
+  g_dbus_connection_flush_sync(poConn, NULL, NULL);
+}
+
+static void OnSample(const samplerresult_t *poResult, void *data) {
+  test_t *poTest = (test_t *)data;
+
+  poTest->iSamples++;
+  poTest->oLast = *poResult;
+}
+
+static gboolean OnTimeout(gpointer data) {
+  ((test_t *)data)->bTimedOut = 1;
+  return G_SOURCE_REMOVE;
+}
+
+static int WaitFor(test_t *poTest, int iSamples, const char *what) {
+  unsigned int iTimeoutId;
+
+  poTest->bTimedOut = 0;
+  iTimeoutId = g_timeout_add_seconds(TIMEOUT_S, OnTimeout, poTest);
+  while (poTest->iSamples < iSamples && !poTest->bTimedOut)
+    g_main_context_iteration(NULL, TRUE);
+  if (!poTest->bTimedOut)
+    g_source_remove(iTimeoutId);
+  else
+    fprintf(stderr, "%s: nothing delivered in %d s\n", what, TIMEOUT_S);
+  return !poTest->bTimedOut;
+}
+
+static int Check(const test_t *poTest, const char *what, battstatus_t eStatus,
+                 int iPercent) {
+  const battsample_t *poSample = &(poTest->oLast.oSample);
+
+  if (poSample->eStatus != eStatus || poSample->iPercent != iPercent ||
+      poSample->lNow != 28500000 || poSample->lFull != 50000000 ||
+      poSample->lRate != 12500000) {
+    fprintf(stderr,
+            "%s: read status %d, %d%%, %ld/%ld, rate %ld, expected status "
+            "%d, %d%%, 28500000/50000000, rate 12500000\n",
+            what, poSample->eStatus, poSample->iPercent, poSample->lNow,
+            poSample->lFull, poSample->lRate, eStatus, iPercent);
+    return 0;
+  }
+  return 1;
+}
+
+int main(int argc, char **argv) {
+  GTestDBus *poBus;
+  GDBusConnection *poMock;
+  upower_t *poUPower;
+  test_t oTest = { 0 };
+  char *pc;
+  int bOK = 0;
+
+  if (!(pc = g_find_program_in_path("dbus-daemon"))) {
+    printf("no dbus-daemon, skipped\n");
+    return 77;
+  }
+  g_free(pc);
+
+  poBus = g_test_dbus_new(G_TEST_DBUS_NONE);
+  g_test_dbus_up(poBus);
+  /* upower.c only ever asks for the system bus */
+  g_setenv("DBUS_SYSTEM_BUS_ADDRESS", g_test_dbus_get_bus_address(poBus),
+           TRUE);
+
+  if (!(poMock = StartMock(g_test_dbus_get_bus_address(poBus)))) {
+    g_test_dbus_down(poBus);
+    g_object_unref(poBus);
+    return 1;
+  }
+
+  poUPower = upower_new("BAT0", OnSample, &oTest);
+
+  /* The first values come unasked */
+  if (!WaitFor(&oTest, 1, "startup") ||
+      !Check(&oTest, "startup", BattStatus_Discharging, 57))
+    goto done;
+
+  /* Requests are answered from idle, never before they return */
+  upower_request_details(poUPower);
+  if (oTest.iSamples != 1) {
+    fprintf(stderr, "request: delivered before returning\n");
+    goto done;
+  }
+  if (!WaitFor(&oTest, 2, "request") ||
+      !Check(&oTest, "request", BattStatus_Discharging, 57))
+    goto done;
+  if (!oTest.oLast.bDetails || oTest.oLast.oDetails.lFullDesign != 57000000) {
+    fprintf(stderr, "request: details %d, design %ld, expected 57000000\n",
+            oTest.oLast.bDetails, oTest.oLast.oDetails.lFullDesign);
+    goto done;
+  }
+
+  /* A change is pushed without being asked for */
+  iState = 1; /* Charging */
+  dPercent = 58;
+  EmitChanged(poMock);
+  if (!WaitFor(&oTest, 3, "change") ||
+      !Check(&oTest, "change", BattStatus_Charging, 58))
+    goto done;
+
+  printf("UPower source: startup, request and change delivered\n");
+  bOK = 1;
+
+done:
+  upower_free(poUPower);
+  g_object_unref(poMock);
+  g_test_dbus_down(poBus);
+  g_object_unref(poBus);
+  return bOK ? 0 : 1;
+}
@@ -0,0 +1,330 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Listener for power_supply change notifications
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gio/gio.h>
+#include <glib-unix.h>
+
+#include <libxfce4util/libxfce4util.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <linux/netlink.h>
+
+#include "uevent.h"
+
+/* Kernel uevents are limited to a few KB of environment */
+#define UEVENT_BUFFER_SIZE 4096
+
+/* Attributes are only ever read by a worker, a driver may take a long time
+   to answer. While a read is running the descriptor is not polled */
+typedef struct watch_t {
+  struct uevent_t *poMon; /* NULL once the monitor is gone */
+  char *acPath;
+  int iFd;
+  int iErrno; /* Of the last read */
+  int bReading;
+  int bNotify; /* The read was started by a notification */
+  unsigned int iSourceId;
+} watch_t;
+
+struct uevent_t {
+  int iSock;
+  int bNetlink;
+  char *acSockPath; /* Only set for fake trees */
+  unsigned int iSourceId;
+  GSList *poWatches;
+  UeventFunc pfFunc;
+  void *pvData;
+};
+
+static const char *FindKey(const char *buf, size_t len, const char *key) {
+  size_t keylen = strlen(key);
+  const char *p = buf;
+  const char *end = buf + len;
+
+  while (p < end) {
+    size_t n = strnlen(p, end - p);
+    if (n > keylen && p[keylen] == '=' && strncmp(p, key, keylen) == 0)
+      return p + keylen + 1;
+    p += n + 1;
+  }
+  return NULL;
+}
+
+static gboolean OnUevent(gint fd, GIOCondition cond, gpointer data) {
+  uevent_t *poMon = (uevent_t *)data;
+  char buf[UEVENT_BUFFER_SIZE];
+  struct sockaddr_nl oSender;
+  socklen_t iSenderLen = sizeof(oSender);
+  const char *action, *subsystem, *name;
+  ssize_t len;
+
+  if (cond & (G_IO_ERR | G_IO_HUP | G_IO_NVAL)) {
+    poMon->iSourceId = 0;
+    return G_SOURCE_REMOVE;
+  }
+
+  /* Drain everything that has queued up. AC and battery usually change
+     together, the callback is expected to coalesce such bursts */
+  while (1) {
+    memset(&oSender, 0, sizeof(oSender));
+    iSenderLen = sizeof(oSender);
+    len = recvfrom(fd, buf, sizeof(buf) - 1, MSG_DONTWAIT,
+                   (struct sockaddr *)&oSender, &iSenderLen);
+    if (len <= 0)
+      break;
+    buf[len] = '\0';
+
+    /* Only trust messages coming from the kernel itself */
+    if (poMon->bNetlink && oSender.nl_pid != 0)
+      continue;
+
+    /* The header is action@devpath, the environment follows as a list of
+       NUL-terminated KEY=VALUE strings */
+    if (!strchr(buf, '@'))
+      continue;
+    subsystem = FindKey(buf, len, "SUBSYSTEM");
+    if (!subsystem || strcmp(subsystem, "power_supply") != 0)
+      continue;
+    action = FindKey(buf, len, "ACTION");
+    name = FindKey(buf, len, "POWER_SUPPLY_NAME");
+    if (!name && (name = strrchr(buf, '/')))
+      name++;
+
+    DBG("uevent: %s %s", action ? action : "?", name ? name : "?");
+    poMon->pfFunc(action ? action : "change", name, poMon->pvData);
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void FreeWatch(gpointer data) {
+  watch_t *poWatch = (watch_t *)data;
+
+  if (poWatch->iSourceId)
+    g_source_remove(poWatch->iSourceId);
+  if (poWatch->iFd >= 0)
+    close(poWatch->iFd);
+  g_free(poWatch->acPath);
+  g_free(poWatch);
+}
+
+static void ReadAttr(GTask *task, gpointer source, gpointer data,
+                     GCancellable *cancellable) {
+  watch_t *poWatch = (watch_t *)data;
+  char buf[64];
+
+  /* sysfs only re-arms POLLPRI once the attribute has been read again */
+  poWatch->iErrno = 0;
+  if (poWatch->iFd < 0)
+    poWatch->iFd = open(poWatch->acPath, O_RDONLY | O_CLOEXEC);
+  if (poWatch->iFd < 0 || pread(poWatch->iFd, buf, sizeof(buf), 0) < 0)
+    poWatch->iErrno = errno;
+  g_task_return_boolean(task, TRUE);
+}
+
+static gboolean OnAttrNotify(gint fd, GIOCondition cond, gpointer data);
+
+static void OnAttrRead(GObject *source, GAsyncResult *res, gpointer data) {
+  watch_t *poWatch = (watch_t *)data;
+  uevent_t *poMon = poWatch->poMon;
+
+  poWatch->bReading = 0;
+  if (!poMon) {
+    /* uevent_monitor_free() left this one to us */
+    FreeWatch(poWatch);
+    return;
+  }
+
+  if (poWatch->iErrno != 0 &&
+      (!poWatch->bNotify || poWatch->iErrno == ENODEV)) {
+    /* Not there, or the device is gone and the "remove" uevent takes it
+       from here */
+    DBG("not watching %s: %s", poWatch->acPath, g_strerror(poWatch->iErrno));
+    poMon->poWatches = g_slist_remove(poMon->poWatches, poWatch);
+    FreeWatch(poWatch);
+    return;
+  }
+
+  poWatch->iSourceId =
+      g_unix_fd_add(poWatch->iFd, G_IO_PRI | G_IO_ERR, OnAttrNotify, poWatch);
+  if (poWatch->bNotify)
+    poMon->pfFunc("notify", NULL, poMon->pvData);
+}
+
+static void StartRead(watch_t *poWatch, int bNotify) {
+  GTask *poTask;
+
+  poWatch->bReading = 1;
+  poWatch->bNotify = bNotify;
+  poTask = g_task_new(NULL, NULL, OnAttrRead, poWatch);
+  g_task_set_task_data(poTask, poWatch, NULL);
+  g_task_run_in_thread(poTask, ReadAttr);
+  g_object_unref(poTask);
+}
+
+static gboolean OnAttrNotify(gint fd, GIOCondition cond, gpointer data) {
+  watch_t *poWatch = (watch_t *)data;
+
+  /* Stop polling until the worker has re-armed the descriptor, it would
+     only report the same notification again */
+  poWatch->iSourceId = 0;
+  StartRead(poWatch, 1);
+  return G_SOURCE_REMOVE;
+}
+
+static int OpenNetlink(void) {
+  struct sockaddr_nl oAddr;
+  int iSock;
+
+  iSock = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                 NETLINK_KOBJECT_UEVENT);
+  if (iSock < 0)
+    return -1;
+
+  memset(&oAddr, 0, sizeof(oAddr));
+  oAddr.nl_family = AF_NETLINK;
+  oAddr.nl_pid = 0;
+  oAddr.nl_groups = 1; /* Kernel events, not the ones relayed by udevd */
+  if (bind(iSock, (struct sockaddr *)&oAddr, sizeof(oAddr)) < 0) {
+    close(iSock);
+    return -1;
+  }
+  return iSock;
+}
+
+static int OpenInjectSocket(const char *path) {
+  struct sockaddr_un oAddr;
+  int iSock;
+
+  if (strlen(path) >= sizeof(oAddr.sun_path))
+    return -1;
+
+  iSock = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+  if (iSock < 0)
+    return -1;
+
+  memset(&oAddr, 0, sizeof(oAddr));
+  oAddr.sun_family = AF_UNIX;
+  strcpy(oAddr.sun_path, path);
+  unlink(path);
+  if (bind(iSock, (struct sockaddr *)&oAddr, sizeof(oAddr)) < 0) {
+    close(iSock);
+    return -1;
+  }
+  return iSock;
+}
+
+uevent_t *uevent_monitor_new(const char *root, UeventFunc func, void *data) {
+  uevent_t *poMon;
+
+  poMon = g_new0(uevent_t, 1);
+  poMon->pfFunc = func;
+  poMon->pvData = data;
+
+  if (strcmp(root, "/sys/class/power_supply") == 0) {
+    poMon->bNetlink = 1;
+    poMon->iSock = OpenNetlink();
+  } else {
+    poMon->acSockPath = g_build_filename(root, ".uevent", NULL);
+    poMon->iSock = OpenInjectSocket(poMon->acSockPath);
+  }
+
+  if (poMon->iSock < 0) {
+    g_warning("Battmon: cannot listen for power_supply events: %s",
+              g_strerror(errno));
+    g_free(poMon->acSockPath);
+    g_free(poMon);
+    return NULL;
+  }
+
+  poMon->iSourceId = g_unix_fd_add(poMon->iSock, G_IO_IN | G_IO_ERR | G_IO_HUP,
+                                   OnUevent, poMon);
+  return poMon;
+}
+
+static GSList *FindWatch(uevent_t *poMon, const char *path) {
+  GSList *l;
+
+  for (l = poMon->poWatches; l; l = l->next)
+    if (strcmp(((watch_t *)l->data)->acPath, path) == 0)
+      return l;
+  return NULL;
+}
+
+void uevent_monitor_watch_attr(uevent_t *poMon, const char *path) {
+  watch_t *poWatch;
+
+  /* Repeated "add" events, e.g. from udevadm trigger */
+  if (FindWatch(poMon, path))
+    return;
+
+  poWatch = g_new0(watch_t, 1);
+  poWatch->poMon = poMon;
+  poWatch->acPath = g_strdup(path);
+  poWatch->iFd = -1;
+  poMon->poWatches = g_slist_prepend(poMon->poWatches, poWatch);
+  /* Opening and arming happen on the worker as well */
+  StartRead(poWatch, 0);
+}
+
+static void ReleaseWatch(gpointer data) {
+  watch_t *poWatch = (watch_t *)data;
+
+  /* A worker still has it, its completion frees it */
+  if (poWatch->bReading)
+    poWatch->poMon = NULL;
+  else
+    FreeWatch(poWatch);
+}
+
+void uevent_monitor_unwatch_attr(uevent_t *poMon, const char *path) {
+  GSList *l = FindWatch(poMon, path);
+
+  if (!l)
+    return;
+  ReleaseWatch(l->data);
+  poMon->poWatches = g_slist_delete_link(poMon->poWatches, l);
+}
+
+void uevent_monitor_free(uevent_t *poMon) {
+  if (!poMon)
+    return;
+
+  g_slist_free_full(poMon->poWatches, ReleaseWatch);
+  if (poMon->iSourceId)
+    g_source_remove(poMon->iSourceId);
+  close(poMon->iSock);
+  if (poMon->acSockPath) {
+    unlink(poMon->acSockPath);
+    g_free(poMon->acSockPath);
+  }
+  g_free(poMon);
+}
@@ -0,0 +1,51 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Listener for power_supply change notifications
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef BATTMON_UEVENT_H
+#define BATTMON_UEVENT_H
+
+/* Called for every power_supply event. action is "add", "remove", "change"
+   (from the kernel) or "notify" (an attribute watched with
+   uevent_monitor_watch_attr() was poked by the driver). name is the
+   power_supply device name, e.g. "BAT0" or "AC", and may be NULL for
+   "notify" */
+typedef void (*UeventFunc)(const char *action, const char *name, void *data);
+
+typedef struct uevent_t uevent_t;
+
+/* Listen on the kernel uevent netlink socket. If root is not the real
+   /sys/class/power_supply (i.e. a fake tree), a unix datagram socket is bound
+   at <root>/.uevent instead and events in the kernel wire format
+   ("action@devpath\0KEY=VALUE\0...") can be injected by sending to it.
+   Returns NULL if no socket could be set up */
+uevent_t *uevent_monitor_new(const char *root, UeventFunc func, void *data);
+
+/* Additionally wait for POLLPRI on a sysfs attribute. Only drivers that call
+   sysfs_notify() on the attribute will ever wake this up, for all others it
+   costs one idle descriptor. The attribute is opened and read by a worker,
+   a path that cannot be is silently dropped. A path already watched is
+   left alone */
+void uevent_monitor_watch_attr(uevent_t *poMon, const char *path);
+/* Stop waiting on path, e.g. once its device was removed */
+void uevent_monitor_unwatch_attr(uevent_t *poMon, const char *path);
+
+void uevent_monitor_free(uevent_t *poMon);
+
+#endif /* BATTMON_UEVENT_H */
@@ -0,0 +1,283 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Battery samples from UPower
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gio/gio.h>
+
+#include <libxfce4util/libxfce4util.h>
+
+#include <math.h>
+#include <string.h>
+
+#include "upower.h"
+
+#define UPOWER_NAME "org.freedesktop.UPower"
+#define UPOWER_DEVICES "/org/freedesktop/UPower/devices/battery_"
+#define UPOWER_DEVICE UPOWER_NAME ".Device"
+#define PROPERTIES "org.freedesktop.DBus.Properties"
+
+/* UPower's device states */
+enum {
+  UPowerState_Unknown,
+  UPowerState_Charging,
+  UPowerState_Discharging,
+  UPowerState_Empty,
+  UPowerState_FullyCharged,
+  UPowerState_PendingCharge,
+  UPowerState_PendingDischarge
+};
+
+struct upower_t {
+  char *acPath;
+  SamplerFunc pfFunc;
+  void *pvData;
+  GCancellable *poCancel;
+  GDBusConnection *poConn;
+  guint iChangedId;
+  unsigned int iIdleId;
+  int bValid;   /* The first GetAll is in, it answers earlier requests */
+  int bDetails; /* Requested with the next delivery */
+  /* As UPower reports them, energies in Wh, power in W */
+  int bPresent;
+  guint32 iState;
+  double dPercent;
+  double dEnergy;
+  double dEnergyFull;
+  double dEnergyRate;
+  double dEnergyFullDesign;
+  double dVoltage;
+  int iCycles;
+};
+
+static void Parse(upower_t *poUPower, GVariant *poProps)
+/* Take what we know from an a{sv} of device properties */
+{
+  GVariantIter oIter;
+  const char *key;
+  GVariant *poValue;
+
+  g_variant_iter_init(&oIter, poProps);
+  while (g_variant_iter_next(&oIter, "{&sv}", &key, &poValue)) {
+    if (strcmp(key, "IsPresent") == 0 &&
+        g_variant_is_of_type(poValue, G_VARIANT_TYPE_BOOLEAN))
+      poUPower->bPresent = g_variant_get_boolean(poValue);
+    else if (strcmp(key, "State") == 0 &&
+             g_variant_is_of_type(poValue, G_VARIANT_TYPE_UINT32))
+      poUPower->iState = g_variant_get_uint32(poValue);
+    else if (strcmp(key, "ChargeCycles") == 0 &&
+             g_variant_is_of_type(poValue, G_VARIANT_TYPE_INT32))
+      poUPower->iCycles = g_variant_get_int32(poValue);
+    else if (g_variant_is_of_type(poValue, G_VARIANT_TYPE_DOUBLE)) {
+      double d = g_variant_get_double(poValue);
+
+      if (strcmp(key, "Percentage") == 0)
+        poUPower->dPercent = d;
+      else if (strcmp(key, "Energy") == 0)
+        poUPower->dEnergy = d;
+      else if (strcmp(key, "EnergyFull") == 0)
+        poUPower->dEnergyFull = d;
+      else if (strcmp(key, "EnergyRate") == 0)
+        poUPower->dEnergyRate = d;
+      else if (strcmp(key, "EnergyFullDesign") == 0)
+        poUPower->dEnergyFullDesign = d;
+      else if (strcmp(key, "Voltage") == 0)
+        poUPower->dVoltage = d;
+    }
+    g_variant_unref(poValue);
+  }
+}
+
+static long ToMicro(double d) {
+  /* UPower says 0 for what it does not know */
+  return d > 0 ? lround(d * 1e6) : -1;
+}
+
+static void Deliver(upower_t *poUPower) {
+  samplerresult_t oResult;
+  battsample_t *poSample = &(oResult.oSample);
+
+  memset(&oResult, 0, sizeof(oResult));
+  oResult.iTime_us = g_get_monotonic_time();
+
+  if (!poUPower->bPresent)
+    poSample->eStatus = BattStatus_NoBatt;
+  else
+    switch (poUPower->iState) {
+    case UPowerState_Charging:
+      poSample->eStatus = BattStatus_Charging;
+      break;
+    case UPowerState_Discharging:
+    case UPowerState_Empty:
+      poSample->eStatus = BattStatus_Discharging;
+      break;
+    case UPowerState_FullyCharged:
+      poSample->eStatus = BattStatus_Full;
+      break;
+    default:
+      poSample->eStatus = BattStatus_Unknown;
+      break;
+    }
+  poSample->iPercent = poUPower->bPresent
+                           ? (int)lround(CLAMP(poUPower->dPercent, 0, 100))
+                           : -1;
+  poSample->lNow = poUPower->bPresent ? ToMicro(poUPower->dEnergy) : -1;
+  poSample->lFull = poUPower->bPresent ? ToMicro(poUPower->dEnergyFull) : -1;
+  /* 0 W is a real answer when not discharging */
+  poSample->lRate = poUPower->bPresent && poUPower->dEnergyRate >= 0
+                        ? lround(poUPower->dEnergyRate * 1e6)
+                        : -1;
+
+  if (poUPower->bDetails) {
+    oResult.bDetails = 1;
+    oResult.oDetails.bCharge = 0;
+    oResult.oDetails.lFullDesign = ToMicro(poUPower->dEnergyFullDesign);
+    oResult.oDetails.lVoltage = ToMicro(poUPower->dVoltage);
+    oResult.oDetails.iCycles = poUPower->iCycles > 0 ? poUPower->iCycles : -1;
+    poUPower->bDetails = 0;
+  }
+
+  poUPower->pfFunc(&oResult, poUPower->pvData);
+}
+
+static void OnChanged(GDBusConnection *conn, const gchar *sender,
+                      const gchar *path, const gchar *iface,
+                      const gchar *signal, GVariant *params, gpointer data) {
+  upower_t *poUPower = (upower_t *)data;
+  const char *pcIface;
+  GVariant *poChanged;
+
+  if (!g_variant_is_of_type(params, G_VARIANT_TYPE("(sa{sv}as)")))
+    return;
+  g_variant_get(params, "(&s@a{sv}@as)", &pcIface, &poChanged, NULL);
+  if (strcmp(pcIface, UPOWER_DEVICE) == 0) {
+    Parse(poUPower, poChanged);
+    /* Before the first GetAll the values are incomplete */
+    if (poUPower->bValid)
+      Deliver(poUPower);
+  }
+  g_variant_unref(poChanged);
+}
+
+static void OnGetAll(GObject *source, GAsyncResult *res, gpointer data) {
+  upower_t *poUPower;
+  GVariant *poReply, *poProps;
+  GError *poError = NULL;
+
+  poReply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res,
+                                          &poError);
+  if (!poReply) {
+    /* data is gone if we were cancelled */
+    if (!g_error_matches(poError, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      g_warning("Battmon: no UPower battery: %s", poError->message);
+    g_error_free(poError);
+    return;
+  }
+
+  poUPower = (upower_t *)data;
+  g_variant_get(poReply, "(@a{sv})", &poProps);
+  Parse(poUPower, poProps);
+  g_variant_unref(poProps);
+  g_variant_unref(poReply);
+
+  poUPower->bValid = 1;
+  Deliver(poUPower);
+}
+
+static void OnSystemBus(GObject *source, GAsyncResult *res, gpointer data) {
+  upower_t *poUPower;
+  GDBusConnection *poConn;
+  GError *poError = NULL;
+
+  if (!(poConn = g_bus_get_finish(res, &poError))) {
+    if (!g_error_matches(poError, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      g_warning("Battmon: no system bus: %s", poError->message);
+    g_error_free(poError);
+    return;
+  }
+
+  poUPower = (upower_t *)data;
+  poUPower->poConn = poConn;
+
+  /* Subscribed before asking, so that no change falls in between */
+  poUPower->iChangedId = g_dbus_connection_signal_subscribe(
+      poConn, UPOWER_NAME, PROPERTIES, "PropertiesChanged", poUPower->acPath,
+      UPOWER_DEVICE, G_DBUS_SIGNAL_FLAGS_NONE, OnChanged, poUPower, NULL);
+
+  g_dbus_connection_call(poConn, UPOWER_NAME, poUPower->acPath, PROPERTIES,
+                         "GetAll", g_variant_new("(s)", UPOWER_DEVICE),
+                         G_VARIANT_TYPE("(a{sv})"), G_DBUS_CALL_FLAGS_NONE,
+                         -1, poUPower->poCancel, OnGetAll, poUPower);
+}
+
+upower_t *upower_new(const char *battery, SamplerFunc func, void *data) {
+  upower_t *poUPower;
+
+  poUPower = g_new0(upower_t, 1);
+  poUPower->acPath = g_strconcat(UPOWER_DEVICES, battery, NULL);
+  poUPower->pfFunc = func;
+  poUPower->pvData = data;
+  poUPower->iCycles = -1;
+  poUPower->poCancel = g_cancellable_new();
+
+  g_bus_get(G_BUS_TYPE_SYSTEM, poUPower->poCancel, OnSystemBus, poUPower);
+  return poUPower;
+}
+
+void upower_free(upower_t *poUPower) {
+  if (!poUPower)
+    return;
+
+  g_cancellable_cancel(poUPower->poCancel);
+  g_object_unref(poUPower->poCancel);
+  if (poUPower->iIdleId)
+    g_source_remove(poUPower->iIdleId);
+  if (poUPower->poConn) {
+    if (poUPower->iChangedId)
+      g_dbus_connection_signal_unsubscribe(poUPower->poConn,
+                                           poUPower->iChangedId);
+    g_object_unref(poUPower->poConn);
+  }
+  g_free(poUPower->acPath);
+  g_free(poUPower);
+}
+
+static gboolean OnIdle(gpointer data) {
+  upower_t *poUPower = (upower_t *)data;
+
+  poUPower->iIdleId = 0;
+  Deliver(poUPower);
+  return G_SOURCE_REMOVE;
+}
+
+void upower_request(upower_t *poUPower) {
+  if (!poUPower->bValid)
+    return;
+  /* Callers do not expect to be called back before they return */
+  if (!poUPower->iIdleId)
+    poUPower->iIdleId = g_idle_add(OnIdle, poUPower);
+}
+
+void upower_request_details(upower_t *poUPower) {
+  poUPower->bDetails = 1;
+  upower_request(poUPower);
+}
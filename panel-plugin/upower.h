@@ -0,0 +1,41 @@
+/*
+ *  Battery Monitor plugin for the Xfce4 panel
+ *  Battery samples from UPower
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef BATTMON_UPOWER_H
+#define BATTMON_UPOWER_H
+
+#include "sampler.h"
+
+typedef struct upower_t upower_t;
+
+/* Follows /org/freedesktop/UPower/devices/battery_<battery> on the system
+   bus. Nothing is polled, func is called whenever UPower signals a change
+   of the device's properties, and once their first values are in. The bus
+   is looked up the usual way, so DBUS_SYSTEM_BUS_ADDRESS can point it at a
+   private bus with a mock UPower */
+upower_t *upower_new(const char *battery, SamplerFunc func, void *data);
+void upower_free(upower_t *poUPower);
+
+/* Deliver what UPower last said from an idle callback, it is as fresh as
+   it gets. Until the first answer the request waits for it */
+void upower_request(upower_t *poUPower);
+void upower_request_details(upower_t *poUPower);
+
+#endif /* BATTMON_UPOWER_H */